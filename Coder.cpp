@@ -5,191 +5,341 @@
 #include <iostream>
 #include <sstream>
 #include <ctime>
+#include <cmath>
 
 Coder::Coder() {
-	interval.base.set_zero();
-	interval.length.set_max();
 }
 
 void Coder::write(int32_t val, Distribution const &dist) {
 	assert(dist.counts.count(val));
 
-	auto range = dist.range(val);
+	auto r = dist.range(val);
+	encode(r.first, uint32_t(r.second - r.first) + 1, 0x10000);
+}
 
-	interval.length.div(0x10000);
-	assert(interval.length.is_nonzero());
+void Coder::write(int32_t val, AdaptiveModel &model) {
+	uint32_t start, length;
+	model.range(val, &start, &length);
+	encode(start, length, model.total());
+	model.update(val);
+}
 
-	bool carry_out;
-	Frac temp = interval.length;
-	temp.mul(range.first);
-	interval.base.add(temp, &carry_out);
+void Coder::write(uint32_t val, StaticModel const &model) {
+	uint32_t start, length;
+	model.range(val, &start, &length);
+	encode(start, length, StaticModel::Total);
+}
 
-	interval.length.mul(range.second - range.first + 1);
+void Coder::encode(uint32_t start, uint32_t length, uint32_t total) {
+	assert(length > 0 && start + length <= total && total <= 0x10000);
 
-	if (carry_out) {
-		carry();
-	}
+	range /= total;
+	low += uint64_t(start) * range;
+	range *= length;
 
-	while (interval.length.digits[0] == 0) {
-		assert(interval.length.is_nonzero());
-		output.push_back(interval.base.digits[0]);
-		interval.base.digits[0] = 0;
-		interval.base.mul(Frac::MaxDigit + 1);
-		interval.length.mul(Frac::MaxDigit + 1);
+	while (range < (1U << 24)) {
+		range <<= 8;
+		shift_low();
 	}
 }
 
-void Coder::carry() {
-	auto o = output.rbegin();
-	while (1) {
-		assert(o != output.rend());
-		*o += 1;
-		if (*o > Frac::MaxDigit) {
-			*o -= (Frac::MaxDigit + 1);
-		} else {
-			break;
-		}
-		++o;
+void Coder::shift_low() {
+	if (uint32_t(low) < 0xff000000U || (low >> 32) != 0) {
+		//the top byte is settled (any carry is already in it), so write out what was pending:
+		uint8_t carry = uint8_t(low >> 32);
+		uint8_t temp = cache;
+		do {
+			if (first) {
+				assert(temp + carry == 0);
+				first = false;
+			} else {
+				output.push_back(uint8_t(temp + carry));
+			}
+			temp = 0xff;
+		} while (--cache_size != 0);
+		cache = uint8_t(low >> 24);
 	}
+	cache_size += 1;
+	low = (low & 0x00ffffffU) << 8;
 }
 
 void Coder::finish() {
-	uint32_t msd_of_base = interval.base.digits[0];
-
-	if (msd_of_base + 1 > Frac::MaxDigit) {
-		carry();
-	} else {
-		output.push_back(msd_of_base + 1);
+	for (uint32_t i = 0; i < 5; ++i) {
+		shift_low();
 	}
 
-	//trim trailing zeros:
+	//trim trailing zeros (the decoder reads zeros past the end):
 	while (!output.empty() && output.back() == 0) {
 		output.pop_back();
 	}
 }
-/*
-Decoder::Decoder(uint8_t max_digit, std::vector< uint8_t > const &_input) : params(max_digit), input(_input) {
-	difference = 0; //"coded - base"
-	length = params.max_length;
 
-	next_digit = 0;
-	for (uint32_t i = 0; i < params.active_digits; ++i) {
-		difference = (difference * params.digits) + get_digit();
+Decoder::Decoder(std::vector< uint8_t > const &input_) : input(input_) {
+	for (uint32_t i = 0; i < 4; ++i) {
+		code = (code << 8) | get_byte();
 	}
-	assert(difference <= params.max_length);
 }
 
-void Decoder::read(uint8_t &val, uint8_t max_val) {
-	//figure out encoded value at current offset:
-	length /= uint32_t(max_val) + 1;
-	val = difference / length;
-	difference -= length * val;
+int32_t Decoder::read(Distribution const &dist) {
+	range >>= 16;
+	uint32_t point = std::min< uint32_t >(code / range, 0xffff);
+	std::pair< uint16_t, uint16_t > r;
+	int32_t val = dist.value_at(point, &r);
+	consume(r.first, uint32_t(r.second - r.first) + 1);
+	return val;
+}
+
+int32_t Decoder::read(AdaptiveModel &model) {
+	uint32_t total = model.total();
+	range /= total;
+	uint32_t point = std::min< uint32_t >(code / range, total - 1);
+	uint32_t start, length;
+	int32_t val = model.value_at(point, &start, &length);
+	consume(start, length);
+	model.update(val);
+	return val;
+}
 
-	//re-normalize if needed:
-	while (length <= params.renorm_length) {
-		length *= params.digits;
-		uint32_t digit = get_digit();
-		difference = difference * params.digits + digit;
+uint32_t Decoder::read(StaticModel const &model) {
+	range >>= StaticModel::Bits;
+	uint32_t point = std::min< uint32_t >(code / range, StaticModel::Total - 1);
+	uint32_t start, length;
+	uint32_t val = model.value_at(point, &start, &length);
+	consume(start, length);
+	return val;
+}
+
+uint32_t Decoder::read_uniform(uint32_t total) {
+	assert(total > 0 && total <= 0x10000);
+	range /= total;
+	uint32_t point = std::min< uint32_t >(code / range, total - 1);
+	consume(point, 1);
+	return point;
+}
+
+void Decoder::consume(uint32_t start, uint32_t length) {
+	code -= start * range;
+	range *= length;
+
+	while (range < (1U << 24)) {
+		range <<= 8;
+		code = (code << 8) | get_byte();
 	}
 }
 
-std::string in_base(uint32_t n, uint8_t max_val) {
-	std::vector< uint8_t > ret;
-	DigitParams params(max_val);
-	for (uint32_t i = 0; i < params.active_digits; ++i) {
-		ret.push_back(n % params.digits);
-		n /= params.digits;
+void AnsCoder::write(uint32_t val, StaticModel const &model) {
+	Slice slice;
+	model.range(val, &slice.start, &slice.length);
+	slice.bits = StaticModel::Bits;
+	pending.emplace_back(slice);
+}
+
+void AnsCoder::write_bits(uint32_t val, uint32_t bits) {
+	assert(bits <= 16);
+	pending.emplace_back(Slice{val & ((1U << bits) - 1), 1, bits});
+}
+
+void AnsCoder::finish() {
+	const uint32_t Low = AnsDecoder::Low;
+	//(bytes come out last first, so are reversed at the end)
+	output.clear();
+	uint32_t state = Low;
+	for (auto s = pending.rbegin(); s != pending.rend(); ++s) {
+		//shift out (at most one) 16 bits if coding the slice would leave the state
+		// at or above 2^32:
+		if ((state >> 16) >= ((Low >> s->bits) * s->length)) {
+			output.push_back(uint8_t(state));
+			output.push_back(uint8_t(state >> 8));
+			state >>= 16;
+		}
+		state = ((state / s->length) << s->bits) + (state % s->length) + s->start;
 	}
-	assert(n == 0);
-	std::ostringstream ss;
-	for (auto d = ret.rbegin(); d != ret.rend(); ++d) {
-		if (d != ret.rbegin()) ss << "|";
-		if (*d < 100 && max_val >= 100) ss << ' ';
-		if (*d < 10 && max_val >= 10) ss << ' ';
-		ss << int(*d);
+	for (uint32_t i = 0; i < 4; ++i) {
+		output.push_back(uint8_t(state));
+		state >>= 8;
 	}
-	ss << " (" << uint32_t(max_val) + 1 << ")";
-	return ss.str();
+	std::reverse(output.begin(), output.end());
+	pending.clear();
 }
 
 //------------------------------------------
 void Coder::run_test() {
-	//std::mt19937 mt(0x1112234); //error at 86-digit pass
-	std::mt19937 mt(0x3dc0ffee); //error at 87-digit pass
-	//std::mt19937 mt(0x1234abcd); //error at 42-digit pass
+	std::mt19937 mt(0x3dc0ffee);
 
 	clock_t before = std::clock();
 
-	for (uint32_t max_digit = 1; max_digit <= 255; ++max_digit) {
-	double min_delta = std::numeric_limits< double >::infinity();
-	double max_delta =-std::numeric_limits< double >::infinity();
-	DigitParams params(max_digit);
-	std::cout << "Digits: " << params.digits << ", active: " << params.active_digits << ", renorm_length: " << params.renorm_length << ", max_length: " << params.max_length << "." << std::endl;
-	for (int pass = 0; pass < 3; ++pass) {
-	//std::cout << "Digits: " << max_digit + 1 << ", Pass: " << pass << std::endl;
-	for (uint32_t iter = 0; iter < 1000; ++iter) {
-		std::vector< std::pair< uint8_t, uint8_t > > data;
-		data.resize(1 + iter);
-		for (auto d = data.begin(); d != data.end(); ++d) {
-			uint8_t a = mt();
-			uint8_t b = mt() % (uint32_t(a) + 1);
-			if (pass == 0) {
-				d->first = a;
-			} else if (pass == 1) {
-				d->first = 0;
-				//if (a == 0) d->first = 0;
-				//else  d->first = 1;
-			} else if (pass == 2) {
-				d->first = b;
+	uint64_t symbols = 0;
+	double max_overhead = 0.0;
+
+	for (uint32_t pass = 0; pass < 3; ++pass) {
+		for (uint32_t iter = 0; iter < 200; ++iter) {
+			//a random alphabet, with (on pass 1) very lopsided counts:
+			int32_t min = int32_t(mt() % 200) - 100;
+			int32_t max = min + int32_t(mt() % (pass == 2 ? 300 : 40));
+			std::map< int32_t, uint32_t > counts;
+			for (int32_t v = min; v <= max; ++v) {
+				counts[v] = (pass == 1 && v != min ? 1 : 1 + mt() % 1000);
 			}
-			d->second = a;
-			assert(d->first <= d->second);
-		}
+			if (pass == 1) counts[min] = 100000;
 
-		//uint8_t max_digit = 31;
+			//data drawn from those counts:
+			uint32_t total = 0;
+			for (auto const &c : counts) total += c.second;
+			std::vector< int32_t > data(1 + mt() % 5000);
+			for (auto &d : data) {
+				uint32_t pick = mt() % total;
+				for (auto const &c : counts) {
+					if (pick < c.second) {
+						d = c.first;
+						break;
+					}
+					pick -= c.second;
+				}
+			}
+			symbols += data.size();
 
-		Coder coder(max_digit);
-		for (auto d = data.begin(); d != data.end(); ++d) {
-			coder.write(d->first, d->second);
-		}
-		coder.finish();
+			//fixed distribution:
+			Distribution dist(counts);
+			Coder coder;
+			for (auto d : data) {
+				coder.write(d, dist);
+			}
+			coder.finish();
 
-		for (auto d = coder.output.begin(); d != coder.output.end(); ++d) {
-			assert(*d <= max_digit);
-		}
+			double ideal = 0.0;
+			for (auto d : data) {
+				auto r = dist.range(d);
+				ideal += -std::log2((uint32_t(r.second - r.first) + 1) / 65536.0);
+			}
+			//(within rounding of the ranges, plus flushing)
+			double overhead = coder.output.size() - ideal / 8.0;
+			max_overhead = std::max(max_overhead, overhead);
+			if (overhead > 4.0 + data.size() * 0.001) {
+				std::cout << "Coded " << data.size() << " symbols to " << coder.output.size() << " bytes; expected about " << ideal / 8.0 << "." << std::endl;
+				assert(0 && "coder is too far from the ideal size");
+			}
 
-		double log_sum = 0.0;
-		for (auto d = data.begin(); d != data.end(); ++d) {
-			log_sum += log(double(d->second) + 1.0);
-		}
-		log_sum /= log(double(max_digit) + 1.0);
-
-		double delta = coder.output.size() - log_sum;
-		if (delta < min_delta) min_delta = delta;
-		if (delta > max_delta) max_delta = delta;
-
-		//std::cout << "Coded: " << coder.output.size() << " Opt: " << log_sum << "\n";
-
-		Decoder decoder(max_digit, coder.output);
-		for (auto d = data.begin(); d != data.end(); ++d) {
-			uint8_t test = 0;
-			decoder.read(test, d->second);
-			//std::cout << "Digit " << (d - data.begin()) << " expected " << uint32_t(d->first) << " of " << (uint32_t(d->second)+1) << " got " << uint32_t(test) << std::endl;
-			if (test != d->first) {
-				std::cout << "[" << (d - data.begin()) << "/" << data.size() << "] " << int(d->first) << " of " << int(d->second) << ", decoded to " << int(test) << "." << std::endl;
-				//std::cout << " last value " << (was_carry ? "was a carry" : "was an output") << std::endl;
-				//std::cout << " last base:   " << in_base(last_base, max_digit) << std::endl;
-				//std::cout << " last length: " << in_base(last_length, max_digit) << std::endl;
-				assert(test == d->first);
+			Decoder decoder(coder.output);
+			for (uint32_t i = 0; i < data.size(); ++i) {
+				int32_t test = decoder.read(dist);
+				if (test != data[i]) {
+					std::cout << "[" << i << "/" << data.size() << "] " << data[i] << " decoded to " << test << "." << std::endl;
+					assert(test == data[i]);
+				}
+			}
+
+			//adaptive distribution (starting uniform):
+			Distribution enc_dist(min, max, 1);
+			Distribution dec_dist(min, max, 1);
+			Coder adapt;
+			for (auto d : data) {
+				adapt.write(d, enc_dist);
+				enc_dist.update_for_val(d);
+			}
+			adapt.finish();
+			Decoder adapt_decoder(adapt.output);
+			for (uint32_t i = 0; i < data.size(); ++i) {
+				int32_t test = adapt_decoder.read(dec_dist);
+				if (test != data[i]) {
+					std::cout << "[" << i << "/" << data.size() << "] " << data[i] << " decoded (adaptively) to " << test << "." << std::endl;
+					assert(test == data[i]);
+				}
+				dec_dist.update_for_val(test);
+			}
+
+			//adaptive model (with a low limit on pass 2, so it rescales often):
+			AdaptiveModel enc_model(min, max, 24, pass == 2 ? 1024 : 0x10000);
+			AdaptiveModel dec_model(min, max, 24, pass == 2 ? 1024 : 0x10000);
+			Coder model;
+			for (auto d : data) {
+				model.write(d, enc_model);
+			}
+			model.finish();
+			Decoder model_decoder(model.output);
+			for (uint32_t i = 0; i < data.size(); ++i) {
+				int32_t test = model_decoder.read(dec_model);
+				if (test != data[i]) {
+					std::cout << "[" << i << "/" << data.size() << "] " << data[i] << " decoded (adaptive model) to " << test << "." << std::endl;
+					assert(test == data[i]);
+				}
+			}
+
+			//static model (frequencies from the counts):
+			std::vector< uint32_t > static_counts;
+			for (auto const &c : counts) static_counts.emplace_back(c.second);
+			StaticModel fixed;
+			fixed.set(StaticModel::quantize(static_counts));
+			Coder fixed_coder;
+			for (auto d : data) {
+				fixed_coder.write(uint32_t(d - min), fixed);
+			}
+			fixed_coder.finish();
+			Decoder fixed_decoder(fixed_coder.output);
+			for (uint32_t i = 0; i < data.size(); ++i) {
+				int32_t test = int32_t(fixed_decoder.read(fixed)) + min;
+				if (test != data[i]) {
+					std::cout << "[" << i << "/" << data.size() << "] " << data[i] << " decoded (static model) to " << test << "." << std::endl;
+					assert(test == data[i]);
+				}
+			}
+
+			//the same static model through rANS, with some raw bits mixed in:
+			AnsCoder ans;
+			for (auto d : data) {
+				ans.write(uint32_t(d - min), fixed);
+				ans.write_bits(uint32_t(d) * 2654435761U, 1 + uint32_t(d - min) % 16);
+			}
+			ans.finish();
+			AnsDecoder ans_decoder(ans.output.data(), ans.output.data() + ans.output.size());
+			for (uint32_t i = 0; i < data.size(); ++i) {
+				int32_t test = int32_t(ans_decoder.read(fixed)) + min;
+				uint32_t bits = 1 + uint32_t(test - min) % 16;
+				uint32_t raw = ans_decoder.read_bits(bits);
+				if (test != data[i] || raw != ((uint32_t(data[i]) * 2654435761U) & ((1U << bits) - 1))) {
+					std::cout << "[" << i << "/" << data.size() << "] " << data[i] << " decoded (static model, rANS) to " << test << "." << std::endl;
+					assert(test == data[i]);
+					assert(0 && "raw bits didn't survive rANS");
+				}
 			}
 		}
-	} //for iter
-	} //for pass
-	std::cout << "Within [" << min_delta << ", " << max_delta << "] digits of optimal." << std::endl;
 	}
 
 	clock_t after = std::clock();
 
+	std::cout << "Round-tripped " << symbols << " symbols five ways; at most " << max_overhead << " bytes over the ideal size." << std::endl;
 	std::cout << "Whole run took " << (after - before) / double(CLOCKS_PER_SEC) << " seconds." << std::endl;
 }
-*/
+
+#ifdef CODER_TEST
+#include "pmw.hpp"
+
+//.pmw round trips of a few small word lists (out of order, without a final
+// newline, and with bytes >= 0x80, which sort after ASCII):
+static void pmw_test() {
+	std::vector< std::string > texts = {
+		"b\na\n\xc3\xa9t\xc3\xa9\nab\n",
+		"\xc3\xa9t\xc3\xa9\n\xc3\xa9\nzebra\n\xff\nz\xe9\nz",
+		"word\n",
+	};
+	for (auto const &text : texts) {
+		std::vector< uint8_t > pmw;
+		std::string error;
+		if (!PMW::encode(text, pmw, &error)) {
+			std::cout << "Failed to store a " << text.size() << "-byte word list: " << error << "." << std::endl;
+			assert(0 && "pmw round trip failed");
+		}
+		std::string check;
+		if (!PMW::decode(pmw, check) || check != text) {
+			std::cout << "A " << text.size() << "-byte word list didn't come back from .pmw." << std::endl;
+			assert(0 && "pmw round trip failed");
+		}
+	}
+	std::cout << "Round-tripped " << texts.size() << " word lists through .pmw." << std::endl;
+}
+
+int main(int argc, char **argv) {
+	Coder::run_test();
+	pmw_test();
+	return 0;
+}
+#endif
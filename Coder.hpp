@@ -9,91 +9,6 @@
 #include <iostream>
 
 
-class Frac {
-public:
-	static const uint32_t Digits = 12;
-	static const uint32_t MaxDigit = 0xff;
-
-	uint32_t digits[Digits];
-	void set_max() {
-		for (auto &d : digits) {
-			d = MaxDigit;
-		}
-	}
-	void set_zero() {
-		for (auto &d : digits) {
-			d = 0;
-		}
-	}
-	bool is_nonzero() {
-		for (auto &d : digits) {
-			if (d != 0) return true;
-		}
-		return false;
-	}
-
-	//if carry_out isn't set, you are *sure* there is no carry
-	//NOTE: it is safe to "add" a Frac to itself.
-	void add(Frac const &o, bool *carry_out) {
-		bool carry = false;
-		for (uint32_t i = Digits - 1; i < Digits; --i) {
-			uint32_t sum = digits[i] + o.digits[i] + (carry ? 1 : 0);
-			if (sum > MaxDigit) {
-				digits[i] = sum - (MaxDigit + 1);
-				carry = true;
-			} else {
-				digits[i] = sum;
-				carry = false;
-			}
-		}
-		if (carry) {
-			assert(carry_out);
-			*carry_out = true;
-		} else {
-			if (carry_out) *carry_out = false;
-		}
-	}
-
-	std::string rep() const {
-		std::string ret = ".";
-		for (auto d : digits) {
-			ret += "0123456789abcdef"[d/16];
-			ret += "0123456789abcdef"[d%16];
-		}
-		return ret;
-	}
-
-	void mul(uint32_t val) {
-		Frac acc(*this);
-		set_zero();
-		while (1) {
-			if (val % 2) {
-				add(acc, NULL);
-			}
-			val /= 2;
-			if (val == 0) break;
-			acc.add(acc, NULL);
-		}
-	}
-
-	void div(uint32_t val) {
-		uint64_t ctx = 0;
-		for (auto &d : digits) {
-			ctx = ctx * uint64_t(MaxDigit + 1) + uint64_t(d);
-			d = ctx / val;
-			assert(d <= MaxDigit);
-			ctx -= uint64_t(d) * uint64_t(val);
-		}
-	}
-};
-
-//Interval is [base, base + length]
-class Interval {
-public:
-	Frac base;
-	Frac length;
-};
-
 class Distribution {
 public:
 	Distribution(std::map< int32_t, uint32_t > const &counts_) : counts(counts_) {
@@ -105,6 +20,43 @@ public:
 	}
 	//as range of [0x0000 - 0xffff] interval
 	std::pair< uint16_t, uint16_t > range(int32_t val) const {
+		std::pair< uint16_t, uint16_t > ret;
+		bool found = false;
+		allocate([&](int32_t v, uint32_t base, uint32_t length) {
+			if (v == val) {
+				ret = std::make_pair(base, base + length - 1);
+				found = true;
+			}
+		});
+		assert(found);
+		return ret;
+	}
+	//the value whose range() holds 'point' (for decoding), and that range:
+	int32_t value_at(uint16_t point, std::pair< uint16_t, uint16_t > *range_out) const {
+		int32_t ret = 0;
+		bool found = false;
+		allocate([&](int32_t v, uint32_t base, uint32_t length) {
+			if (base <= point && point < base + length) {
+				ret = v;
+				*range_out = std::make_pair(base, base + length - 1);
+				found = true;
+			}
+		});
+		assert(found);
+		return ret;
+	}
+	void update_for_val(int32_t val) {
+		auto f = counts.find(val);
+		assert(f != counts.end());
+		assert(f->second > 0);
+		f->second += 1;
+	}
+	std::map< int32_t, uint32_t > counts;
+
+private:
+	//calls fn(val, base, length) for every value's slice of [0x0000, 0xffff]:
+	template< typename F >
+	void allocate(F const &fn) const {
 		//so out of [0x0000, 0xffff], allocate to each value:
 		// allocate code space proportional to probability,
 		//  **with the caveat** that everything we might see needs at least one
@@ -126,16 +78,10 @@ public:
 		uint32_t remain = max + 1;
 		uint32_t base = 0;
 
-		std::pair< uint16_t, uint16_t > ret;
-		bool found = false;
-
 		for (auto m : mass) {
-			uint32_t length = m.first * remain / total;
+			uint32_t length = uint64_t(m.first) * remain / total;
 			if (length < 1) length = 1;
-			if (m.second == val) {
-				ret = std::make_pair(base, base + length - 1);
-				found = true;
-			}
+			fn(m.second, base, length);
 			assert(m.first <= total);
 			total -= m.first;
 
@@ -146,60 +92,310 @@ public:
 		}
 		assert(remain == 0);
 		assert(base == max + 1);
-		assert(found);
+	}
+};
+
+//Adaptive model over the values [min, max]: counts live in a Fenwick tree, so
+// finding a value's slice, finding the value at a point, and counting a value
+// are all O(log alphabet). Each value seen gains 'increment'; when the total
+// would pass 'limit' (at most 2^16, what the coder can split), everything is
+// halved (but kept at least one), so the model also tracks drift.
+class AdaptiveModel {
+public:
+	AdaptiveModel(int32_t min_, int32_t max_, uint32_t increment_ = 24, uint32_t limit_ = 0x10000)
+		: min(min_), size(uint32_t(max_ - min_) + 1), increment(increment_), limit(limit_) {
+		assert(min_ <= max_);
+		assert(size + increment <= limit && limit <= 0x10000);
+		counts.assign(size, 1);
+		build();
+	}
 
+	uint32_t total() const { return sum; }
+
+	//[start, start + length) of total():
+	void range(int32_t val, uint32_t *start, uint32_t *length) const {
+		uint32_t i = index(val);
+		*start = prefix(i);
+		*length = counts[i];
+	}
+
+	//the value whose slice holds 'point' (< total()), and that slice:
+	int32_t value_at(uint32_t point, uint32_t *start, uint32_t *length) const {
+		assert(point < sum);
+		//descend the tree for the last index with prefix <= point (written to compile
+		// without branches, since which way it goes is exactly what's being decoded):
+		uint32_t i = 0;
+		uint32_t left = point;
+		for (uint32_t step = span >> 1; step != 0; step >>= 1) {
+			uint32_t t = tree[i + step];
+			bool take = (t <= left);
+			i += (take ? step : 0);
+			left -= (take ? t : 0);
+		}
+		assert(i < size);
+		*start = point - left;
+		*length = counts[i];
+		return min + int32_t(i);
+	}
+
+	void update(int32_t val) {
+		if (sum + increment > limit) rescale();
+		uint32_t i = index(val);
+		counts[i] += increment;
+		sum += increment;
+		for (uint32_t t = i + 1; t <= span; t += t & (~t + 1)) {
+			tree[t] += increment;
+		}
+	}
+
+private:
+	int32_t min;
+	uint32_t size;
+	uint32_t increment;
+	uint32_t limit;
+	std::vector< uint32_t > counts;
+	std::vector< uint32_t > tree; //1-based Fenwick tree over counts (padded with zeros out to span)
+	uint32_t span = 1; //smallest power of two >= size
+	uint32_t sum = 0;
+
+	uint32_t index(int32_t val) const {
+		assert(val >= min && uint32_t(val - min) < size);
+		return uint32_t(val - min);
+	}
+	//sum of counts[0, i):
+	uint32_t prefix(uint32_t i) const {
+		uint32_t ret = 0;
+		for (uint32_t t = i; t != 0; t -= t & (~t + 1)) {
+			ret += tree[t];
+		}
 		return ret;
 	}
-	void update_for_val(int32_t val) {
-		auto f = counts.find(val);
-		assert(f != counts.end());
-		assert(f->second > 0);
-		f->second += 1;
+	void rescale() {
+		for (auto &c : counts) {
+			c = (c + 1) / 2;
+		}
+		build();
+	}
+	void build() {
+		span = 1;
+		while (span < size) span *= 2;
+		tree.assign(span + 1, 0);
+		sum = 0;
+		for (uint32_t i = 0; i < span; ++i) {
+			if (i < size) {
+				tree[i + 1] += counts[i];
+				sum += counts[i];
+			}
+			uint32_t parent = (i + 1) + ((i + 1) & (~(i + 1) + 1));
+			if (parent <= span) tree[parent] += tree[i + 1];
+		}
 	}
-	std::map< int32_t, uint32_t > counts;
 };
 
+//Fixed model over the values [0, size), with frequencies summing to 2^Bits given
+// up front (both sides need the same ones), so finding a value at a point is a
+// table lookup and nothing is updated -- for when decoding speed matters more than
+// the cost of sending the frequencies along.
+class StaticModel {
+public:
+	enum : uint32_t { Bits = 10, Total = 1 << Bits };
+
+	StaticModel(uint32_t size = 1) {
+		std::vector< uint32_t > freqs(size, 0);
+		freqs[0] = Total;
+		set(freqs);
+	}
+
+	//frequencies summing to Total, roughly in proportion to 'counts' (with every
+	// nonzero count getting a nonzero frequency); counts must not all be zero:
+	static std::vector< uint32_t > quantize(std::vector< uint32_t > const &counts) {
+		uint64_t sum = 0;
+		for (auto c : counts) sum += c;
+		assert(sum > 0);
+		std::vector< uint32_t > freqs(counts.size(), 0);
+		int64_t left = Total;
+		for (uint32_t i = 0; i < counts.size(); ++i) {
+			if (counts[i] == 0) continue;
+			freqs[i] = std::max< uint64_t >(1, uint64_t(counts[i]) * Total / sum);
+			left -= freqs[i];
+		}
+		//settle the difference with the biggest frequencies:
+		while (left != 0) {
+			uint32_t big = std::max_element(freqs.begin(), freqs.end()) - freqs.begin();
+			int64_t change = (left > 0 ? left : std::max< int64_t >(left, 1 - int64_t(freqs[big])));
+			assert(change != 0 && "more values than the model can tell apart");
+			freqs[big] += change;
+			left -= change;
+		}
+		return freqs;
+	}
+
+	//freqs must sum to Total:
+	void set(std::vector< uint32_t > const &freqs) {
+		assert(!freqs.empty() && freqs.size() <= Total);
+		start.assign(freqs.size() + 1, 0);
+		for (uint32_t i = 0; i < freqs.size(); ++i) {
+			start[i + 1] = start[i] + freqs[i];
+		}
+		assert(start.back() == Total);
+		lookup.resize(Total);
+		for (uint32_t i = 0; i < freqs.size(); ++i) {
+			for (uint32_t p = start[i]; p < start[i + 1]; ++p) {
+				lookup[p] = i;
+			}
+		}
+	}
+
+	uint32_t size() const { return start.size() - 1; }
+	uint32_t freq(uint32_t val) const { return start[val + 1] - start[val]; }
+
+	//[start, start + length) of Total:
+	void range(uint32_t val, uint32_t *start_out, uint32_t *length) const {
+		assert(val < size() && freq(val) != 0);
+		*start_out = start[val];
+		*length = start[val + 1] - start[val];
+	}
+
+	//the value whose slice holds 'point' (< Total), and that slice:
+	uint32_t value_at(uint32_t point, uint32_t *start_out, uint32_t *length) const {
+		uint32_t val = lookup[point];
+		*start_out = start[val];
+		*length = start[val + 1] - start[val];
+		return val;
+	}
+
+private:
+	std::vector< uint32_t > start; //start[v] = sum of frequencies of values below v
+	std::vector< uint16_t > lookup; //lookup[p] = the value whose slice holds point p
+};
+
+//Range coder (32-bit range, carries propagated through a one-byte cache, as in LZMA).
+// Symbols are coded by their slice of a total of at most 2^16 (Distribution::range()
+// out of [0x0000, 0xffff], an AdaptiveModel's counts, or a StaticModel's
+// frequencies); the range never drops below 2^24, so every nonempty slice
+// survives the split.
 class Coder {
 public:
 	Coder();
 
 	void write(int32_t val, Distribution const &dist);
+	//(counts 'val' in the model afterward):
+	void write(int32_t val, AdaptiveModel &model);
+	void write(uint32_t val, StaticModel const &model);
 
-	void carry();
+	//code the slice [start, start + length) of [0, total); total must be at most 2^16:
+	void encode(uint32_t start, uint32_t length, uint32_t total);
 
+	//flush; output is complete after this:
 	void finish();
 
-	Interval interval;
-
 	std::vector< uint8_t > output;
 
+	//round-trip random data (fixed and adaptive distributions) through Coder and Decoder:
 	static void run_test();
+
+private:
+	uint64_t low = 0; //(bits above 32 are a pending carry)
+	uint32_t range = 0xffffffff;
+	uint8_t cache = 0; //last byte not yet written, since a carry might still change it
+	uint64_t cache_size = 1; //cache, plus this many - 1 0xff bytes, are pending
+	bool first = true; //the very first pending byte is always zero and isn't written
+	void shift_low();
 };
-/*
+
 class Decoder {
 public:
-	Decoder(uint8_t max_digit, std::vector< uint8_t > const &_digits);
+	Decoder(std::vector< uint8_t > const &input);
 
-	void read(uint8_t &val, uint8_t max_val);
+	//must be given the same distribution as the matching Coder::write():
+	int32_t read(Distribution const &dist);
+	//(counts the value in the model afterward, as Coder::write() does):
+	int32_t read(AdaptiveModel &model);
+	uint32_t read(StaticModel const &model);
+	//a value in [0, total) written as Coder::encode(value, 1, total):
+	uint32_t read_uniform(uint32_t total);
 
-	//convenience:
-	void read(uint32_t &val, uint32_t max_val) {
-		assert(max_val <= 0xff);
-		uint8_t temp;
-		read(temp, uint8_t(max_val));
-		val = temp;
+private:
+	std::vector< uint8_t > const &input;
+	size_t next = 0;
+	uint32_t code = 0;
+	uint32_t range = 0xffffffff;
+	//(after range has been divided by the total) take the slice out of code:
+	void consume(uint32_t start, uint32_t length);
+	uint8_t get_byte() {
+		//(the coder trims trailing zeros)
+		return (next < input.size() ? input[next++] : 0);
 	}
+};
 
-	DigitParams params;
+//rANS coder for StaticModels and raw bits (32-bit state, renormalized 16 bits at a
+// time, so at most once a symbol). Decoding a symbol is a table lookup, a multiply,
+// and a shift -- no division, as the range coder above needs -- so this is for data
+// decoded much more often than it is written. rANS decodes in the reverse of the order it codes, so
+// AnsCoder keeps the symbols until finish() and codes them last to first;
+// AnsDecoder then reads them in the order they were written.
+class AnsCoder {
+public:
+	void write(uint32_t val, StaticModel const &model);
+	//the low 'bits' (at most 16) of val:
+	void write_bits(uint32_t val, uint32_t bits);
+
+	//code everything written; output is complete after this:
+	void finish();
+
+	std::vector< uint8_t > output;
+
+private:
+	struct Slice {
+		uint32_t start, length; //of 2^bits
+		uint32_t bits;
+	};
+	std::vector< Slice > pending;
+};
 
-	uint32_t difference;
-	uint32_t length;
+class AnsDecoder {
+public:
+	enum : uint32_t { Low = 1U << 16 }; //the state stays in [Low, 2^32)
 
-	uint32_t get_digit() {
-		if (next_digit < input.size()) return input[next_digit++];
-		else return 0;
+	AnsDecoder(uint8_t const *begin_, uint8_t const *end_) : next(begin_), end(end_) {
+		for (uint32_t i = 0; i < 4; ++i) {
+			state = (state << 8) | get_byte();
+		}
+	}
+
+	//(both inline, since they are the whole of a decoding loop)
+	uint32_t read(StaticModel const &model) {
+		uint32_t point = state & (StaticModel::Total - 1);
+		uint32_t start, length;
+		uint32_t val = model.value_at(point, &start, &length);
+		state = length * (state >> StaticModel::Bits) + point - start;
+		renormalize();
+		return val;
+	}
+	uint32_t read_bits(uint32_t bits) {
+		assert(bits <= 16);
+		uint32_t val = state & ((1U << bits) - 1);
+		state >>= bits;
+		renormalize();
+		return val;
+	}
+
+private:
+	uint8_t const *next;
+	uint8_t const *end;
+	uint32_t state = 0;
+	void renormalize() {
+		//(one step always brings the state back up; it's arithmetic rather than a
+		// branch, since whether the step is needed is close to a coin toss. Past the
+		// end, which only happens in damaged input, it reads zeros, as Decoder does)
+		uint32_t more = (next + 1 < end); //(0 or 1)
+		uint32_t bits = (more ? (uint32_t(next[0]) << 8) | next[1] : 0);
+		uint32_t low = (state < Low);
+		state = (state << (low * 16)) | (bits & (0U - low));
+		next += (low & more) * 2;
+	}
+	uint8_t get_byte() {
+		//(past the end only happens in damaged input; read zeros, as Decoder does)
+		return (next < end ? *(next++) : 0);
 	}
-	uint32_t next_digit;
-	std::vector< uint8_t > input;
 };
-*/
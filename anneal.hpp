@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+#include "distances.hpp"
+#include "parallel.hpp"
+#include "local-search.hpp"
+
+//Parallel tempering over a path of maximal indices (same cost model as LocalSearch:
+// path[0] is fixed, stepping off the end is free). Each replica anneals its own
+// path at a fixed temperature; between batches of steps, neighboring temperatures
+// may swap paths (accepted with the usual Metropolis rule on the energy difference),
+// which lets good paths found hot settle down in the cold replicas.
+//
+//Proposals are the same segment swaps as LocalSearch, aimed with the neighbor lists:
+// a random word x, one of its cheapest successors y, and a short segment on one
+// side; the change in length is six table lookups, and only accepted moves pay
+// for the std::rotate.
+
+class Tempering {
+public:
+	Tempering(Distances const &distances_, NeighborLists const &neighbors_) : distances(distances_), neighbors(neighbors_) { }
+
+	Distances const &distances;
+	NeighborLists const &neighbors;
+
+	uint32_t segment = 3; //longest proposed segment
+	uint32_t threads = thread_count();
+
+	struct Replica {
+		double temperature = 1.0;
+		std::vector< uint32_t > path;
+		std::vector< uint32_t > pos;
+		uint32_t length = 0;
+		std::mt19937 mt;
+		uint64_t tried = 0;
+		uint64_t accepted = 0;
+		uint64_t exchanged = 0;
+	};
+	std::vector< Replica > replicas; //coldest first
+
+	std::vector< uint32_t > best;
+	uint32_t best_length = -1U;
+
+	//set up 'count' replicas of 'path' with temperatures spaced geometrically from hot to cold:
+	void start(std::vector< uint32_t > const &path, uint32_t count, double hot, double cold, uint32_t seed) {
+		replicas.assign(std::max(1U, count), Replica());
+		for (uint32_t r = 0; r < replicas.size(); ++r) {
+			Replica &replica = replicas[r];
+			double f = (replicas.size() == 1 ? 0.0 : double(r) / double(replicas.size() - 1));
+			replica.temperature = cold * std::pow(hot / cold, f);
+			replica.path = path;
+			replica.pos.assign(distances.size, -1U);
+			for (uint32_t i = 0; i < path.size(); ++i) {
+				replica.pos[path[i]] = i;
+			}
+			replica.length = LocalSearch::length(distances, path);
+			replica.mt.seed(seed + r);
+		}
+		best = path;
+		best_length = LocalSearch::length(distances, path);
+	}
+
+	//'steps' proposals in every replica (in parallel), then one round of exchanges;
+	// returns true if the best path improved:
+	bool batch(uint64_t steps) {
+		parallel_for(replicas.size(), [&](uint32_t r, uint32_t) {
+			run(replicas[r], steps);
+		}, threads);
+
+		//exchange neighboring temperatures (alternating pairings so everyone mixes):
+		std::mt19937 &mt = replicas[0].mt;
+		for (uint32_t r = (parity ^= 1); r + 1 < replicas.size(); r += 2) {
+			Replica &cold = replicas[r];
+			Replica &hot = replicas[r+1];
+			double x = (1.0 / cold.temperature - 1.0 / hot.temperature) * (double(cold.length) - double(hot.length));
+			if (x >= 0.0 || std::uniform_real_distribution< double >(0.0, 1.0)(mt) < std::exp(x)) {
+				std::swap(cold.path, hot.path);
+				std::swap(cold.pos, hot.pos);
+				std::swap(cold.length, hot.length);
+				cold.exchanged += 1;
+			}
+		}
+
+		bool improved = false;
+		for (auto const &replica : replicas) {
+			if (replica.length < best_length) {
+				best_length = replica.length;
+				best = replica.path;
+				improved = true;
+			}
+		}
+		return improved;
+	}
+
+private:
+	uint32_t parity = 0;
+
+	void run(Replica &replica, uint64_t steps) {
+		std::vector< uint32_t > &path = replica.path;
+		std::vector< uint32_t > &pos = replica.pos;
+		const uint32_t n = path.size();
+		if (n < 4) return;
+		auto cost = [&](uint32_t i, uint32_t j) -> int32_t {
+			return (j < n ? int32_t(distances(path[i], path[j])) : 0);
+		};
+		std::mt19937 &mt = replica.mt;
+		std::uniform_real_distribution< double > uniform(0.0, 1.0);
+		const double temperature = replica.temperature;
+		for (uint64_t step = 0; step < steps; ++step) {
+			uint32_t t = mt() % (n - 1);
+			uint32_t y = neighbors.begin(path[t])[mt() % neighbors.k];
+			uint32_t q = pos[y];
+			if (q == -1U || q == 0 || q == t + 1) continue;
+			uint32_t length = 1 + mt() % segment;
+			uint32_t a, b, c;
+			//(same four shapes as LocalSearch::best_move, with a random segment length)
+			if (q > t + 1) {
+				if (mt() & 1) {
+					a = t; b = q - 1; c = std::min(q + length - 1, n - 1);
+				} else {
+					if (t < length) continue;
+					a = t - length; b = t; c = q - 1;
+				}
+			} else {
+				a = q - 1; c = t;
+				if (mt() & 1) {
+					if (t < q + length) continue;
+					b = t - length;
+				} else {
+					b = q + length - 1;
+					if (b >= t) continue;
+				}
+			}
+			assert(a < b && b < c && c < n);
+			replica.tried += 1;
+			int32_t delta = cost(a, b+1) + cost(c, a+1) + cost(b, c+1) - cost(a, a+1) - cost(b, b+1) - cost(c, c+1);
+			if (delta > 0 && uniform(mt) >= std::exp(-double(delta) / temperature)) continue;
+			replica.accepted += 1;
+			replica.length += delta;
+			std::rotate(path.begin() + a + 1, path.begin() + b + 1, path.begin() + c + 1);
+			for (uint32_t i = a + 1; i <= c; ++i) {
+				pos[path[i]] = i;
+			}
+		}
+	}
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+//Minimum spanning arborescence (Edmonds' algorithm as organized by Tarjan):
+// every node but the root picks its cheapest incoming arc; cycles are contracted
+// into new node sets whose incoming arcs are reduced by what the members already
+// paid, and the sets pick again. Incoming arcs live in leftist heaps with lazy
+// adds, so everything is O(arcs * log(arcs)).
+//
+//Along the way this records the dual solution: each set S (singletons included)
+// has dual[S] = the reduced weight of the arc it picked, and
+//   sum over S containing 'to' but not 'from' of dual[S] <= weight(from, to)
+// for every arc given, with sum of all dual[S] == cost. So checking other arcs
+// against the duals (see enters()) says whether they could have helped.
+
+class Arborescence {
+public:
+	enum : uint32_t { None = -1U };
+
+	struct Arc {
+		uint32_t from, to;
+		double weight;
+	};
+
+	double cost = 0.0;
+	std::vector< uint32_t > in_arc; //chosen arc into each node (None for the root)
+
+	//node sets: [0, nodes) are singletons, the rest are contracted cycles in creation order:
+	std::vector< double > dual;
+	std::vector< uint32_t > up; //smallest set strictly containing this one, or None
+
+	//returns false if some node isn't reachable from root over the given arcs:
+	bool solve(uint32_t nodes, uint32_t root, std::vector< Arc > const &arcs) {
+		heap.clear();
+		heap.reserve(arcs.size());
+		dual.assign(nodes, 0.0);
+		up.assign(nodes, None);
+		find_up.assign(nodes, None);
+		queue.assign(nodes, None);
+		picked.assign(nodes, None);
+		state.assign(nodes, Unvisited);
+		cost = 0.0;
+
+		for (uint32_t a = 0; a < arcs.size(); ++a) {
+			auto const &arc = arcs[a];
+			assert(arc.from < nodes && arc.to < nodes);
+			if (arc.to == root || arc.from == arc.to) continue;
+			heap.emplace_back(HeapNode{arc.weight, 0.0, None, None, 1, a});
+			queue[arc.to] = merge(queue[arc.to], heap.size() - 1);
+		}
+
+		state[root] = Done;
+		std::vector< uint32_t > path;
+		for (uint32_t s = 0; s < nodes; ++s) {
+			uint32_t u = find(s);
+			while (state[u] == Unvisited) {
+				state[u] = OnPath;
+				path.emplace_back(u);
+
+				//cheapest arc from outside of u:
+				uint32_t h;
+				while (1) {
+					if (queue[u] == None) return false;
+					h = queue[u];
+					push(h);
+					queue[u] = merge(heap[h].left, heap[h].right);
+					if (find(arcs[heap[h].arc].from) != u) break;
+				}
+				double w = heap[h].key;
+				dual[u] = w;
+				cost += w;
+				picked[u] = heap[h].arc;
+				if (queue[u] != None) heap[queue[u]].lazy -= w;
+
+				uint32_t v = find(arcs[heap[h].arc].from);
+				if (state[v] == OnPath) {
+					//contract the cycle v -> ... -> u -> v into a new set:
+					uint32_t set = dual.size();
+					dual.emplace_back(0.0);
+					up.emplace_back(None);
+					find_up.emplace_back(None);
+					queue.emplace_back(None);
+					picked.emplace_back(None);
+					state.emplace_back(Unvisited);
+					while (1) {
+						uint32_t m = path.back();
+						path.pop_back();
+						up[m] = set;
+						find_up[m] = set;
+						queue[set] = merge(queue[set], queue[m]);
+						queue[m] = None;
+						if (m == v) break;
+					}
+					u = set;
+				} else {
+					u = v;
+				}
+			}
+			for (auto p : path) {
+				state[p] = Done;
+			}
+			path.clear();
+		}
+
+		//expand from the outermost sets in: each set's arc replaces the pick of the member it enters:
+		std::vector< uint32_t > chosen = picked;
+		for (uint32_t set = dual.size() - 1; set >= nodes; --set) {
+			uint32_t a = chosen[set];
+			assert(a != None);
+			uint32_t x = arcs[a].to;
+			while (up[x] != set) x = up[x];
+			chosen[x] = a;
+		}
+		in_arc.assign(chosen.begin(), chosen.begin() + nodes);
+		in_arc[root] = None;
+		return true;
+	}
+
+	//sum of duals of sets containing 'to' but not 'from'; 'from_marks' must hold
+	// mark_ancestors(from) (so a row of arcs only pays for marking once):
+	double enters(uint32_t to, std::vector< uint32_t > const &from_marks, uint32_t stamp, std::vector< double > const &prefix) const {
+		uint32_t x = to;
+		while (x != None && from_marks[x] != stamp) x = up[x];
+		return prefix[to] - (x == None ? 0.0 : prefix[x]);
+	}
+
+	//prefix[S] = sum of duals of S and every set containing it:
+	void dual_prefix(std::vector< double > &prefix) const {
+		prefix.assign(dual.size(), 0.0);
+		for (uint32_t set = dual.size() - 1; set < dual.size(); --set) {
+			prefix[set] = dual[set] + (up[set] == None ? 0.0 : prefix[up[set]]);
+		}
+	}
+
+	void mark_ancestors(uint32_t node, std::vector< uint32_t > &marks, uint32_t stamp) const {
+		for (uint32_t x = node; x != None; x = up[x]) {
+			marks[x] = stamp;
+		}
+	}
+
+private:
+	enum : uint8_t { Unvisited, OnPath, Done };
+
+	struct HeapNode {
+		double key;
+		double lazy; //still to be added to this key and everything below it
+		uint32_t left, right;
+		uint32_t rank;
+		uint32_t arc;
+	};
+	std::vector< HeapNode > heap;
+	std::vector< uint32_t > find_up; //union-find links (path-compressed version of 'up')
+	std::vector< uint32_t > queue; //heap of incoming arcs for each (top-level) set
+	std::vector< uint32_t > picked;
+	std::vector< uint8_t > state;
+
+	uint32_t find(uint32_t x) {
+		uint32_t top = x;
+		while (find_up[top] != None) top = find_up[top];
+		while (find_up[x] != None) {
+			uint32_t next = find_up[x];
+			if (next != top) find_up[x] = top;
+			x = next;
+		}
+		return top;
+	}
+
+	//apply a node's pending lazy to its key and hand it to its children:
+	void push(uint32_t h) {
+		HeapNode &n = heap[h];
+		if (n.lazy == 0.0) return;
+		n.key += n.lazy;
+		if (n.left != None) heap[n.left].lazy += n.lazy;
+		if (n.right != None) heap[n.right].lazy += n.lazy;
+		n.lazy = 0.0;
+	}
+
+	uint32_t rank(uint32_t h) const { return h == None ? 0 : heap[h].rank; }
+
+	uint32_t merge(uint32_t a, uint32_t b) {
+		if (a == None) return b;
+		if (b == None) return a;
+		push(a);
+		push(b);
+		if (heap[b].key < heap[a].key) std::swap(a, b);
+		uint32_t right = merge(heap[a].right, b);
+		heap[a].right = right;
+		if (rank(heap[a].left) < rank(heap[a].right)) std::swap(heap[a].left, heap[a].right);
+		heap[a].rank = rank(heap[a].right) + 1;
+		return a;
+	}
+};
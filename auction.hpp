@@ -0,0 +1,305 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <iostream>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+#include "parallel.hpp"
+
+//Min-cost assignment by auction with epsilon-scaling, after Bertsekas.
+//An unassigned row finds its cheapest column (weight + price) and bids the price up
+// by the gap to its second choice plus epsilon, displacing the column's previous owner.
+//With 'jacobi', every unassigned row bids each round, in parallel, against the
+// prices from the start of the round, and the highest bid for each column wins it;
+// otherwise rows bid one at a time against the current prices (Gauss-Seidel), which
+// wastes no bids on columns someone else is about to take (better on one thread).
+//Prices only ever go up, so each row caches its 'cached' cheapest edges and the
+// cheapest value among the rest as of its last full scan, and only scans again once
+// its cheapest cached edge costs more than that. (With dense rows and lots of ties
+// that happens often: on the distance tables about 90% of bids still rescan, so
+// the scan itself -- one pass into a bounded heap -- is what needs to be cheap.)
+//Each phase starts from the last one's prices and assignment, unassigning only the
+// rows that aren't within the new epsilon of their cheapest column.
+//Weights are scaled by (size + 1) so that finishing at epsilon == 1 gives an exact optimum.
+//Rows are read through the same adaptors as hungarian.hpp (size/begin/end/column/weight).
+
+class Auction {
+public:
+	enum : uint32_t { None = -1U };
+
+	std::vector< uint32_t > row_to_column;
+	std::vector< uint32_t > column_to_row;
+
+	//column prices, in units of 1 / scale:
+	std::vector< int64_t > price;
+	int64_t scale = 1;
+
+	uint32_t threads = thread_count();
+	bool jacobi = true;
+	uint32_t cached = 16; //edges cached per row
+	bool verbose = false;
+
+	uint64_t cost = 0; //of the current assignment, in unscaled weights
+
+	//Any prices at all give the lower bound
+	//   sum_r min_c (weight(r,c) + price[c]) - sum_c price[c]
+	// (the row minimums and negated prices are feasible hungarian potentials);
+	// this returns it in unscaled weights, rounded up since weights are integers.
+	//Also updates 'cost'.
+	template< typename Rows >
+	int64_t bound(Rows const &rows) {
+		const uint32_t size = rows.size();
+		std::vector< int64_t > thread_sum(threads, 0);
+		std::vector< uint64_t > thread_cost(threads, 0);
+		const uint32_t Block = 64;
+		parallel_for((size + Block - 1) / Block, [&](uint32_t block, uint32_t thread) {
+			for (uint32_t r = block * Block; r < size && r < (block + 1) * Block; ++r) {
+				int64_t min = std::numeric_limits< int64_t >::max();
+				for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+					uint32_t c = rows.column(r, e);
+					min = std::min(min, int64_t(rows.weight(r, e)) * scale + price[c]);
+					if (c == row_to_column[r]) thread_cost[thread] += rows.weight(r, e);
+				}
+				thread_sum[thread] += min;
+			}
+		}, threads);
+		int64_t dual = 0;
+		cost = 0;
+		for (uint32_t t = 0; t < threads; ++t) {
+			dual += thread_sum[t];
+			cost += thread_cost[t];
+		}
+		for (auto p : price) {
+			dual -= p;
+		}
+		//round up:
+		if (dual >= 0) return (dual + scale - 1) / scale;
+		else return -((-dual) / scale);
+	}
+
+	template< typename Rows >
+	void solve(Rows const &rows, uint32_t alpha = 4) {
+		const uint32_t size = rows.size();
+		scale = int64_t(size) + 1;
+
+		uint8_t max_weight = 0;
+		for (uint32_t r = 0; r < size; ++r) {
+			for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+				max_weight = std::max(max_weight, rows.weight(r, e));
+			}
+		}
+		//increment used when a row has only one column to bid on:
+		lone = (int64_t(max_weight) + 1) * scale;
+
+		price.assign(size, 0);
+		row_to_column.assign(size, None);
+		column_to_row.assign(size, None);
+		cache.assign(size_t(size) * cached, 0);
+		cache_count.assign(size, 0);
+		rest.assign(size, 0);
+
+		std::vector< std::vector< Value > > scratch(threads);
+		std::vector< uint64_t > thread_scans(threads, 0);
+		std::vector< std::vector< uint32_t > > thread_dropped(threads);
+
+		std::vector< uint32_t > unassigned, next_unassigned;
+		std::vector< Bid > bids;
+		std::vector< int64_t > high_bid(size);
+		std::vector< uint32_t > high_bidder(size, None);
+		std::vector< uint32_t > bid_columns;
+
+		const uint32_t Block = 16;
+		int64_t epsilon = std::max< int64_t >(1, int64_t(max_weight) * scale / alpha);
+		for (uint32_t phase = 1; ; ++phase) {
+			//refresh every row's cache, and unassign rows that aren't epsilon-happy any more:
+			parallel_for((size + Block - 1) / Block, [&](uint32_t block, uint32_t thread) {
+				for (uint32_t r = block * Block; r < size && r < (block + 1) * Block; ++r) {
+					int64_t best = scan(rows, r, scratch[thread]);
+					if (row_to_column[r] == None) continue;
+					for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+						if (rows.column(r, e) != row_to_column[r]) continue;
+						if (value(rows, r, e) > best + epsilon) thread_dropped[thread].emplace_back(r);
+						break;
+					}
+				}
+			}, threads);
+			uint32_t kept = 0;
+			for (auto const &m : row_to_column) {
+				if (m != None) ++kept;
+			}
+			for (auto &dropped : thread_dropped) {
+				for (auto r : dropped) {
+					column_to_row[row_to_column[r]] = None;
+					row_to_column[r] = None;
+				}
+				kept -= dropped.size();
+				dropped.clear();
+			}
+			unassigned.clear();
+			for (uint32_t r = 0; r < size; ++r) {
+				if (row_to_column[r] == None) unassigned.emplace_back(r);
+			}
+
+			uint64_t rounds = 0;
+			uint64_t total_bids = 0;
+			if (!jacobi) {
+				//one row at a time, straight against the current prices:
+				while (!unassigned.empty()) {
+					uint32_t r = unassigned.back();
+					unassigned.pop_back();
+					++total_bids;
+					Bid b = bid(rows, r, epsilon, scratch[0], thread_scans[0]);
+					price[b.column] = b.price;
+					if (column_to_row[b.column] != None) {
+						row_to_column[column_to_row[b.column]] = None;
+						unassigned.emplace_back(column_to_row[b.column]);
+					}
+					column_to_row[b.column] = r;
+					row_to_column[r] = b.column;
+				}
+			} else {
+				while (!unassigned.empty()) {
+					++rounds;
+					total_bids += unassigned.size();
+
+					//everyone unassigned bids (in parallel, against the prices from the start of the round):
+					bids.resize(unassigned.size());
+					parallel_for((unassigned.size() + Block - 1) / Block, [&](uint32_t block, uint32_t thread) {
+						for (uint32_t i = block * Block; i < unassigned.size() && i < (block + 1) * Block; ++i) {
+							bids[i] = bid(rows, unassigned[i], epsilon, scratch[thread], thread_scans[thread]);
+						}
+					}, threads);
+
+					//highest bid for each column wins:
+					for (uint32_t i = 0; i < bids.size(); ++i) {
+						uint32_t c = bids[i].column;
+						if (high_bidder[c] == None) {
+							bid_columns.emplace_back(c);
+						} else if (bids[i].price <= high_bid[c]) {
+							continue;
+						}
+						high_bid[c] = bids[i].price;
+						high_bidder[c] = unassigned[i];
+					}
+					next_unassigned.clear();
+					for (uint32_t i = 0; i < bids.size(); ++i) {
+						if (high_bidder[bids[i].column] != unassigned[i]) next_unassigned.emplace_back(unassigned[i]);
+					}
+					for (auto c : bid_columns) {
+						uint32_t r = high_bidder[c];
+						if (column_to_row[c] != None) {
+							row_to_column[column_to_row[c]] = None;
+							next_unassigned.emplace_back(column_to_row[c]);
+						}
+						column_to_row[c] = r;
+						row_to_column[r] = c;
+						price[c] = high_bid[c];
+						high_bidder[c] = None;
+					}
+					bid_columns.clear();
+					std::swap(unassigned, next_unassigned);
+				}
+			}
+
+			if (verbose) {
+				uint64_t scans = 0;
+				for (auto &s : thread_scans) {
+					scans += s;
+					s = 0;
+				}
+				int64_t lower = bound(rows);
+				std::cout << "  phase " << phase << " (epsilon " << epsilon << " / " << scale << "): kept " << kept << ", ";
+				if (jacobi) std::cout << rounds << " rounds, ";
+				std::cout << total_bids << " bids, " << scans << " rescans; cost " << cost << ", bound " << lower << "." << std::endl;
+			}
+
+			if (epsilon == 1) break;
+			epsilon = std::max< int64_t >(1, epsilon / alpha);
+		}
+	}
+
+private:
+	struct Bid {
+		uint32_t column;
+		int64_t price;
+	};
+	typedef std::pair< int64_t, uint32_t > Value; //(weight + price, edge)
+
+	int64_t lone = 1;
+	std::vector< uint32_t > cache; //'cached' entries per row: the cheapest edges at the time of the scan
+	std::vector< uint32_t > cache_count;
+	std::vector< int64_t > rest; //cheapest value outside the cache when it was filled (or max)
+
+	template< typename Rows >
+	int64_t value(Rows const &rows, uint32_t r, uint32_t e) const {
+		return int64_t(rows.weight(r, e)) * scale + price[rows.column(r, e)];
+	}
+
+	//fill row r's cache from every edge (keeping the cheapest in a max-heap, so most
+	// edges are one compare against its top); returns the cheapest value:
+	template< typename Rows >
+	int64_t scan(Rows const &rows, uint32_t r, std::vector< Value > &heap) {
+		heap.clear();
+		int64_t others = std::numeric_limits< int64_t >::max();
+		//(in locals, since the stores into the heap could otherwise be to them)
+		int64_t const *prices = price.data();
+		const int64_t scale_ = scale;
+		const size_t keep = cached;
+		for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+			int64_t v = int64_t(rows.weight(r, e)) * scale_ + prices[rows.column(r, e)];
+			if (heap.size() < keep) {
+				heap.emplace_back(v, e);
+				std::push_heap(heap.begin(), heap.end());
+			} else if (v < heap[0].first) {
+				others = std::min(others, heap[0].first);
+				std::pop_heap(heap.begin(), heap.end());
+				heap.back() = Value(v, e);
+				std::push_heap(heap.begin(), heap.end());
+			} else {
+				others = std::min(others, v);
+			}
+		}
+		assert(!heap.empty());
+		int64_t best = std::numeric_limits< int64_t >::max();
+		for (uint32_t i = 0; i < heap.size(); ++i) {
+			cache[size_t(r) * cached + i] = heap[i].second;
+			best = std::min(best, heap[i].first);
+		}
+		cache_count[r] = heap.size();
+		rest[r] = others;
+		return best;
+	}
+
+	//row r's bid: its cheapest column, and that column's price raised by the gap to
+	// the next cheapest (or 'lone' if there isn't one) plus epsilon:
+	template< typename Rows >
+	Bid bid(Rows const &rows, uint32_t r, int64_t epsilon, std::vector< Value > &scratch, uint64_t &scans) {
+		while (1) {
+			int64_t best = std::numeric_limits< int64_t >::max();
+			int64_t second = std::numeric_limits< int64_t >::max();
+			uint32_t best_column = None;
+			uint32_t const *edges = &cache[size_t(r) * cached];
+			for (uint32_t i = 0; i < cache_count[r]; ++i) {
+				int64_t v = value(rows, r, edges[i]);
+				if (v < best) {
+					second = best;
+					best = v;
+					best_column = rows.column(r, edges[i]);
+				} else if (v < second) {
+					second = v;
+				}
+			}
+			//(uncached edges cost at least rest[r], since prices haven't gone down)
+			if (best <= rest[r]) {
+				second = std::min(second, rest[r]);
+				int64_t gap = (second == std::numeric_limits< int64_t >::max() ? lone : second - best);
+				return Bid{best_column, price[best_column] + gap + epsilon};
+			}
+			scan(rows, r, scratch);
+			++scans;
+		}
+	}
+};
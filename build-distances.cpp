@@ -1,8 +1,153 @@
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+
 #include "graph.hpp"
 #include "stopwatch.hpp"
+#include "parallel.hpp"
+#include "distances.hpp"
+
+//A maximal word has no children, so its out-edges are exactly the children of its
+// rewind chain -- which only depends on its rewind pointer (the longest proper
+// suffix that is in the trie). So all the maximal words that share a rewind
+// pointer have the same row of distances (except for the zero on the diagonal),
+// and the "rewind" engine runs one BFS per distinct rewind pointer, seeded from
+// the shared out-edges, instead of one BFS per word like "bfs" does.
+
+struct {
+	std::string engine = "rewind"; //"bfs"
+	uint32_t threads = thread_count();
+	bool validate = false; //also run a plain BFS for every row and compare
+	bool bridges = false; //also write the letters along each shortest path to bridges.table (see Bridges)
+	void describe() {
+		std::cout << "Options:\n";
+		std::cout << "\tEngine: " << engine << "\n";
+		std::cout << "\tThreads: " << threads << "\n";
+		std::cout << "\tValidate: " << (validate ? "yes" : "no") << "\n";
+		std::cout << "\tBridges: " << (bridges ? "yes" : "no") << "\n";
+	}
+} options;
+
+//per-thread BFS scratch; 'seen' is generation-stamped so it never needs clearing:
+struct BFS {
+	BFS(uint32_t nodes, bool track) : seen(nodes, 0), distance(nodes, 0xff) {
+		if (track) {
+			from.assign(nodes, 0);
+			from_char.assign(nodes, 0);
+			head_seen.assign(nodes, 0);
+			head_index.assign(nodes, 0);
+		}
+	}
+	std::vector< uint32_t > seen;
+	std::vector< uint8_t > distance; //valid where seen == generation
+	//if tracking, the BFS tree (also valid where seen == generation):
+	std::vector< uint32_t > from;
+	std::vector< char > from_char;
+	//if tracking, which nodes are already in the current group's list of bridge heads:
+	std::vector< uint32_t > head_seen;
+	std::vector< uint8_t > head_index; //valid where head_seen == generation
+	uint32_t generation = 0;
+	std::vector< uint32_t > ply, next_ply;
+
+	//BFS from 'seed':
+	void run(Graph const &graph, uint32_t seed) {
+		++generation;
+		ply.clear();
+		ply.emplace_back(seed);
+		seen[seed] = generation;
+		distance[seed] = 0;
+		expand(graph, 0);
+	}
+
+	//BFS from everywhere 'word' steps to, without marking 'word' itself -- so distances
+	// are right for every source with the same out-edges, except at the source itself:
+	void run_from_edges(Graph const &graph, uint32_t word) {
+		++generation;
+		ply.clear();
+		for (uint32_t a = graph.adj_start[word]; a < graph.adj_start[word+1]; ++a) {
+			uint32_t n = graph.adj[a];
+			if (seen[n] != generation) {
+				seen[n] = generation;
+				distance[n] = 1;
+				if (!from.empty()) {
+					from[n] = word;
+					from_char[n] = graph.adj_char[a];
+				}
+				ply.emplace_back(n);
+			}
+		}
+		expand(graph, 1);
+	}
+
+	void expand(Graph const &graph, uint32_t dis) {
+		while (!ply.empty()) {
+			next_ply.clear();
+			dis += 1;
+			assert(dis < 0xff);
+			for (auto i : ply) {
+				for (uint32_t a = graph.adj_start[i]; a < graph.adj_start[i+1]; ++a) {
+					uint32_t n = graph.adj[a];
+					if (seen[n] != generation) {
+						seen[n] = generation;
+						distance[n] = dis;
+						if (!from.empty()) {
+							from[n] = i;
+							from_char[n] = graph.adj_char[a];
+						}
+						next_ply.emplace_back(n);
+					}
+				}
+			}
+			std::swap(ply, next_ply);
+		}
+	}
+	uint8_t operator[](uint32_t n) const {
+		return (seen[n] == generation ? distance[n] : 0xff);
+	}
+	//letters along the tree from the source to n (needs tracking; with run_from_edges,
+	// n can be the source itself, for the way back to it):
+	std::string letters(uint32_t n, uint32_t source) const {
+		std::string chars;
+		uint32_t pt = n;
+		do {
+			assert(seen[pt] == generation);
+			chars += from_char[pt];
+			pt = from[pt];
+		} while (pt != source);
+		std::reverse(chars.begin(), chars.end());
+		return chars;
+	}
+};
 
 int main(int argc, char **argv) {
 
+	for (int a = 1; a < argc; ++a) {
+		std::string arg = argv[a];
+		std::string tag;
+		std::string value;
+		auto pos = arg.find(':');
+		tag = arg.substr(0, pos+1);
+		value = arg.substr(pos+1);
+		if (tag == "engine:") {
+			options.engine = value;
+		} else if (tag == "threads:") {
+			options.threads = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "validate:") {
+			options.validate = (value == "true" || value == "yes" || value == "t" || value == "1" || value =="y");
+		} else if (tag == "bridges:") {
+			options.bridges = (value == "true" || value == "yes" || value == "t" || value == "1" || value =="y");
+		} else {
+			std::cerr << "Unknown tag '" << tag << "'" << std::endl;
+			return 1;
+		}
+	}
+	if (options.engine != "rewind" && options.engine != "bfs") {
+		std::cerr << "Unknown engine '" << options.engine << "'" << std::endl;
+		return 1;
+	}
+
+	options.describe();
+
 	stopwatch("start");
 	Graph graph;
 	if (!graph.read("wordlist.graph")) {
@@ -19,62 +164,181 @@ int main(int argc, char **argv) {
 		}
 	}
 	std::cout << "Have " << maximal.size() << " maximal nodes." << std::endl;
+	const uint32_t size = maximal.size();
 
-	std::unique_ptr< uint8_t[] > distances(new uint8_t[maximal.size() * maximal.size()]);
+	std::unique_ptr< uint8_t[] > distances(new uint8_t[size_t(size) * size]);
 
 	stopwatch("setup");
 
-	//run lots of BFS's:
-	for (auto const &seed : maximal) {
-		std::vector< uint8_t > distance(graph.nodes, 0xff);
-		std::vector< uint32_t > ply;
-		ply.emplace_back(seed);
-		distance[seed] = 0;
-		uint32_t dis = 0;
-		while (!ply.empty()) {
-			std::vector< uint32_t > next_ply;
-			dis += 1;
-			assert(dis < 0xff);
-			for (auto i : ply) {
-				for (uint32_t a = graph.adj_start[i]; a < graph.adj_start[i+1]; ++a) {
-					uint32_t n = graph.adj[a];
-					if (distance[n] == 0xff) {
-						distance[n] = dis;
-						next_ply.emplace_back(n);
-					}
-				}
+	//rows that share a rewind pointer (all of them, for the "bfs" engine) form a group:
+	std::vector< uint32_t > order(size);
+	for (uint32_t r = 0; r < size; ++r) {
+		order[r] = r;
+	}
+	if (options.engine == "rewind") {
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return graph.rewind[maximal[a]] < graph.rewind[maximal[b]];
+		});
+	}
+	std::vector< uint32_t > group_start;
+	for (uint32_t i = 0; i < size; ++i) {
+		if (options.engine == "bfs" || i == 0 || graph.rewind[maximal[order[i]]] != graph.rewind[maximal[order[i-1]]]) {
+			group_start.emplace_back(i);
+		}
+	}
+	group_start.emplace_back(size);
+	const uint32_t groups = group_start.size() - 1;
+	std::cout << "Running " << groups << " BFS's for " << size << " rows." << std::endl;
+
+	std::vector< uint8_t > thread_max(options.threads, 0);
+	std::vector< std::unique_ptr< BFS > > scratch(options.threads);
+
+	//each group's heads are spelled while its BFS tree is around, then interned once at the end:
+	Bridges bridges;
+	std::vector< std::vector< std::string > > group_heads;
+	if (options.bridges) {
+		bridges.graph_hash = graph.hash();
+		bridges.size = size;
+		bridges.groups = groups;
+		bridges.group.assign(size, 0);
+		for (uint32_t g = 0; g < groups; ++g) {
+			for (uint32_t i = group_start[g]; i < group_start[g+1]; ++i) {
+				bridges.group[order[i]] = g;
 			}
-			ply = std::move(next_ply);
 		}
+		bridges.code.assign(size_t(groups) * size, Bridges::Missing);
+		group_heads.resize(groups);
 
-		static uint8_t max = 0;
+		//each word's letters, read up its parent chain:
+		std::vector< char > letter(graph.nodes, '\0');
+		for (uint32_t n = 0; n < graph.nodes; ++n) {
+			for (uint32_t i = graph.child_start[n]; i < graph.child_start[n+1]; ++i) {
+				letter[graph.child[i]] = graph.child_char[i];
+			}
+		}
+		bridges.word_start.assign(size + 1, 0);
+		for (uint32_t c = 0; c < size; ++c) {
+			bridges.word_start[c+1] = bridges.word_start[c] + graph.depth[maximal[c]];
+		}
+		bridges.letters.resize(bridges.word_start[size]);
+		for (uint32_t c = 0; c < size; ++c) {
+			uint32_t at = bridges.word_start[c+1];
+			for (uint32_t n = maximal[c]; n != 0; n = graph.parent[n]) {
+				bridges.letters[--at] = letter[n];
+			}
+			assert(at == bridges.word_start[c]);
+		}
+	}
+
+	auto before = std::chrono::steady_clock::now();
+
+	parallel_for(groups, [&](uint32_t group, uint32_t thread) {
+		if (!scratch[thread]) scratch[thread].reset(new BFS(graph.nodes, options.bridges));
+		BFS &bfs = *scratch[thread];
+
+		uint32_t const *begin = &order[group_start[group]];
+		uint32_t const *end = &order[group_start[group+1]];
+		if (options.engine == "bfs") bfs.run(graph, maximal[*begin]);
+		else bfs.run_from_edges(graph, maximal[*begin]);
 
-		{ //copy to distances table
-			uint8_t *base = distances.get() + (&seed - &maximal[0]) * maximal.size();
-			for (auto const &m : maximal) {
-				assert(distance[m] != 0xff);
-				max = std::max(max, distance[m]);
-				*(base++) = distance[m];
+		for (auto row = begin; row != end; ++row) {
+			uint8_t *base = distances.get() + size_t(*row) * size;
+			for (uint32_t c = 0; c < size; ++c) {
+				assert(bfs[maximal[c]] != 0xff);
+				base[c] = bfs[maximal[c]];
 			}
+			base[*row] = 0;
+			thread_max[thread] = std::max(thread_max[thread], *std::max_element(base, base + size));
 		}
 
-		static uint32_t step = 0;
-		step += 1;
-		if (step == 500) {
-			stopwatch("bfs * 500");
-			std::cout << (&seed - &maximal[0]) << " / " << maximal.size()
-				<< " -- longest path so far: " << int32_t(max) << "."
-				<< std::endl;
-			step = 0;
+		if (options.bridges) {
+			//a path to c spells c last, so its head (if it's longer than c) ends where the
+			// tree path is depth(c) steps short of c:
+			uint32_t source = maximal[*begin];
+			uint8_t *code = &bridges.code[size_t(group) * size];
+			auto &heads = group_heads[group];
+			for (uint32_t c = 0; c < size; ++c) {
+				//(diagonals aren't looked up, but other members need the way to the first one)
+				uint32_t dis = (options.engine == "bfs" && c == *begin ? 0 : bfs[maximal[c]]);
+				uint32_t depth = graph.depth[maximal[c]];
+				if (dis <= depth) {
+					if (dis < Bridges::Heads) code[c] = dis;
+					continue;
+				}
+				uint32_t h = maximal[c];
+				for (uint32_t i = 0; i < depth; ++i) {
+					h = bfs.from[h];
+				}
+				if (bfs.head_seen[h] != bfs.generation) {
+					if (heads.size() == Bridges::Missing - Bridges::Heads) continue;
+					bfs.head_seen[h] = bfs.generation;
+					bfs.head_index[h] = heads.size();
+					heads.emplace_back(bfs.letters(h, source));
+				}
+				code[c] = Bridges::Heads + bfs.head_index[h];
+			}
 		}
+	}, options.threads);
+
+	auto after = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration< double >(after - before).count();
+
+	uint8_t max = 0;
+	for (auto m : thread_max) {
+		max = std::max(max, m);
 	}
+	std::cout << "Longest path: " << int32_t(max) << "; took " << seconds << "s." << std::endl;
 
-	stopwatch("last bit of calculation");
+	stopwatch("distances");
+
+	if (options.validate) {
+		//plain BFS per row, for checking (and timing) against:
+		std::vector< uint32_t > mismatches(options.threads, 0);
+		auto before = std::chrono::steady_clock::now();
+		parallel_for(size, [&](uint32_t row, uint32_t thread) {
+			if (!scratch[thread]) scratch[thread].reset(new BFS(graph.nodes, options.bridges));
+			BFS &bfs = *scratch[thread];
+			bfs.run(graph, maximal[row]);
+			uint8_t const *base = distances.get() + size_t(row) * size;
+			for (uint32_t c = 0; c < size; ++c) {
+				if (base[c] != bfs[maximal[c]]) ++mismatches[thread];
+			}
+		}, options.threads);
+		auto after = std::chrono::steady_clock::now();
+		double bfs_seconds = std::chrono::duration< double >(after - before).count();
+		uint32_t total = 0;
+		for (auto m : mismatches) total += m;
+		std::cout << "Validation: " << total << " mismatches against per-row BFS, which took " << bfs_seconds << "s ("
+			<< bfs_seconds / seconds << "x)." << std::endl;
+		if (total) return 1;
+		stopwatch("validate");
+	}
 
 	std::ofstream out("distances.table");
-	out.write(reinterpret_cast< const char * >(distances.get()), maximal.size() * maximal.size());
+	out.write(reinterpret_cast< const char * >(distances.get()), size_t(size) * size);
 
 	stopwatch("write");
 
+	if (options.bridges) {
+		std::unordered_map< std::string, uint32_t > interned;
+		bridges.head_start.assign(groups + 1, 0);
+		for (uint32_t g = 0; g < groups; ++g) {
+			for (auto const &head : group_heads[g]) {
+				auto f = interned.insert(std::make_pair(head, uint32_t(bridges.pool.size())));
+				if (f.second) {
+					bridges.pool.emplace_back(char(head.size()));
+					bridges.pool.insert(bridges.pool.end(), head.begin(), head.end());
+				}
+				bridges.heads.emplace_back(f.first->second);
+			}
+			bridges.head_start[g+1] = bridges.heads.size();
+		}
+		uint64_t missing = std::count(bridges.code.begin(), bridges.code.end(), uint8_t(Bridges::Missing));
+		bridges.write("bridges.table");
+		std::cout << "Wrote bridges.table: " << groups << " groups, " << bridges.heads.size() << " heads ("
+			<< interned.size() << " distinct), " << missing << " bridges left to search." << std::endl;
+		stopwatch("write bridges");
+	}
+
 	return 0;
 }
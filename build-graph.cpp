@@ -12,170 +12,79 @@
 #include <chrono>
 #include "stopwatch.hpp"
 #include "graph.hpp"
+#include "trie.hpp"
 
 
-class Node : public std::map< char, Node * > {
-public:
-	Node *rewind = nullptr;
-	uint32_t index = -1U;
-	bool terminal = false;
-	bool maximal = false; //terminal that isn't a substring
-
-	uint32_t depth = 0;
-
-	//------ DEBUG ------
-	Node *parent = nullptr;
-	std::string prefix() const {
-		if (!parent) return "";
-		for (auto cn : *parent) {
-			if (cn.second == this) return parent->prefix() + cn.first;
-		}
-		assert(0 && "parent pointer should be correct, y'know.");
-	}
-};
-
 int main(int argc, char **argv) {
 
-	Node root;
-	Node *start = nullptr;
-
 	stopwatch("start");
 
-	//initial tree:
-	std::ifstream wordlist("wordlist.asc");
-	std::string word;
-	while (std::getline(wordlist, word)) {
-		Node *at = &root;
-		for (auto c : word) {
-			auto f = at->insert(std::make_pair(c, nullptr)).first;
-			if (f->second == NULL) {
-				f->second = new Node();
-				f->second->parent = at;
-				f->second->depth = f->second->parent->depth + 1;
-			}
-			at = f->second;
-		}
-		assert(at);
-		assert(at->terminal == false);
-		at->terminal = true;
-		if (word == "portmanteau") {
-			start = at;
-		}
+	//trie with rewind pointers (from wordlist.asc, or wordlist.pmw if there is no text):
+	Trie trie;
+	if (!trie.load("wordlist")) {
+		std::cerr << "Failed to load word list." << std::endl;
+		return 1;
 	}
-	assert(start);
+	const uint32_t root = 0;
+	assert(trie.find("portmanteau") != Trie::None && trie.terminal[trie.find("portmanteau")]);
 
 	stopwatch("read");
 
-	//set rewind pointers:
-	{
-		std::vector< Node * > layer;
-		layer.push_back(&root);
-		while (!layer.empty()) {
-			std::vector< Node * > next_layer;
-			for (auto n : layer) {
-				//update rewind pointers for children based on current rewind pointer.
-				for (auto cn : *n) {
-					next_layer.emplace_back(cn.second);
-
-					//rewind:
-					Node *r = n->rewind;
-					while (r != nullptr) {
-						assert(r != nullptr);
-						auto f = r->find(cn.first);
-						if (f != r->end()) {
-							//great, can extend this rewind:
-							r = f->second;
-							break;
-						} else {
-							//have to rewind further:
-							r = r->rewind;
-						}
-					}
-					assert(n == &root || r != nullptr); //for everything but the root, rewind should always hit root and bounce down
-					if (r == nullptr) r = &root;
-					cn.second->rewind = r;
-				}
-			}
-			layer = next_layer;
-		}
-	}
-
 	{ //dump some info about the tree:
-		uint32_t nodes = 0;
-		uint32_t edges = 0;
 		uint32_t rewinds = 0;
 		uint32_t terminal = 0;
 		uint32_t steps = 0;
-		std::function< void(Node *) > count = [&](Node *n) {
-			nodes += 1;
-			if (n->rewind) rewinds += 1;
-			if (n->terminal) terminal += 1;
-			for (auto &c : *n) {
-				steps += 1;
-				edges += 1;
-				if (c.first != '\0') {
-					count(c.second);
-				}
-			}
+		for (uint32_t n = 0; n < trie.size(); ++n) {
+			if (trie.rewind[n] != Trie::None) rewinds += 1;
+			steps += trie.children(n);
 			//add valid next steps from rewind pointers:
-			if (n->terminal) {
-				for (Node *r = n->rewind; r != &root; r = r->rewind) {
-					assert(r);
-					steps += r->size();
+			if (trie.terminal[n]) {
+				terminal += 1;
+				for (uint32_t r = trie.rewind[n]; r != root; r = trie.rewind[r]) {
+					assert(r != Trie::None);
+					steps += trie.children(r);
 				}
 			}
-		};
-		count(&root);
-		std::cout << "Built tree with " << nodes << " nodes and " << edges << " edges." << std::endl;
+		}
+		std::cout << "Built tree with " << trie.size() << " nodes and " << trie.child.size() << " edges." << std::endl;
 		std::cout << "Have " << terminal << " terminal nodes." << std::endl;
 		std::cout << "Have " << rewinds << " rewind pointers." << std::endl;
 		std::cout << "Have " << steps << " 'next step' edges (includes rewinds at terminals)." << std::endl;
 	}
 
-	//set indices:
-	std::vector< Node * > nodes;
+	//(the trie's preorder indices are the graph's)
+	const uint32_t nodes = trie.size();
+	const uint32_t children = trie.child.size();
 	uint32_t adjacencies = 0;
-	uint32_t children = 0;
-	{
-		std::function< void(Node *) > index = [&](Node *n) {
-			n->index = nodes.size();
-			nodes.emplace_back(n);
-
-			children += n->size();
-			adjacencies += n->size();
-			//add valid next steps from rewind pointers:
-			if (n->terminal) {
-				for (Node *r = n->rewind; r != &root; r = r->rewind) {
-					assert(r);
-					adjacencies += r->size();
-				}
+	for (uint32_t n = 0; n < nodes; ++n) {
+		adjacencies += trie.children(n);
+		if (trie.terminal[n]) {
+			for (uint32_t r = trie.rewind[n]; r != root; r = trie.rewind[r]) {
+				adjacencies += trie.children(r);
 			}
-			for (auto cn : *n) {
-				index(cn.second);
-			}
-		};
-		index(&root);
+		}
 	}
 
-	for (auto n : nodes) {
-		if (n->terminal && n->size() == 0) n->maximal = true;
+	std::vector< bool > maximal(nodes, false);
+	for (uint32_t n = 0; n < nodes; ++n) {
+		if (trie.terminal[n] && trie.children(n) == 0) maximal[n] = true;
 	}
 	{
-		uint32_t maximal = 0;
-		for (auto n : nodes) {
-			if (n->maximal) ++maximal;
+		uint32_t count = 0;
+		for (auto m : maximal) {
+			if (m) ++count;
 		}
-		std::cout << "Have " << maximal << " maximal words based on child counting." << std::endl;
+		std::cout << "Have " << count << " maximal words based on child counting." << std::endl;
 	}
-	for (auto n : nodes) {
-		if (n->rewind) n->rewind->maximal = false;
+	for (uint32_t n = 0; n < nodes; ++n) {
+		if (trie.rewind[n] != Trie::None) maximal[trie.rewind[n]] = false;
 	}
 	{
-		uint32_t maximal = 0;
-		for (auto n : nodes) {
-			if (n->maximal) ++maximal;
+		uint32_t count = 0;
+		for (auto m : maximal) {
+			if (m) ++count;
 		}
-		std::cout << "Have " << maximal << " maximal words after rewind culling." << std::endl;
+		std::cout << "Have " << count << " maximal words after rewind culling." << std::endl;
 	}
 
 	//okay, a valid step is:
@@ -183,78 +92,50 @@ int main(int argc, char **argv) {
 	// - (at a terminal node) a marked next letter for some [non-root!] rewind of this node
 
 	Graph graph;
-	graph.resize(nodes.size(), adjacencies, children);
+	graph.resize(nodes, adjacencies, children);
 
 	{
 		auto adj_start = graph.adj_start;
 		auto adj = graph.adj;
 		auto adj_char = graph.adj_char;
 
-		auto child_start = graph.child_start;
-		auto child = graph.child;
-		auto child_char = graph.child_char;
+		std::copy(trie.child_start.begin(), trie.child_start.end(), graph.child_start);
+		std::copy(trie.child.begin(), trie.child.end(), graph.child);
+		std::copy(trie.child_char.begin(), trie.child_char.end(), graph.child_char);
 
-		for (auto const &n : nodes) {
-			assert(&n - &nodes[0] == n->index);
+		std::vector< std::pair< char, uint32_t > > valid;
+		for (uint32_t n = 0; n < nodes; ++n) {
 			*(adj_start++) = adj - graph.adj;
-			*(child_start++) = child - graph.child;
-			std::vector< std::pair< char, Node * > > valid(n->begin(), n->end());
-			std::stable_sort(valid.begin(), valid.end());
-			for (auto v : valid) {
-				*(child_char++) = v.first;
-				*(child++) = v.second->index;
-			}
-			if (n->terminal) {
-				for (Node *r = n->rewind; r != &root; r = r->rewind) {
-					assert(r);
-					valid.insert(valid.end(), r->begin(), r->end());
+			valid.clear();
+			auto add = [&](uint32_t m) {
+				for (uint32_t c = trie.child_start[m]; c < trie.child_start[m+1]; ++c) {
+					valid.emplace_back(trie.child_char[c], trie.child[c]);
+				}
+			};
+			add(n);
+			if (trie.terminal[n]) {
+				for (uint32_t r = trie.rewind[n]; r != root; r = trie.rewind[r]) {
+					assert(r != Trie::None);
+					add(r);
 				}
 			}
-			std::stable_sort(valid.begin(), valid.end());
+			std::sort(valid.begin(), valid.end()); //(letter order; ties by index)
 			for (auto v : valid) {
 				*(adj_char++) = v.first;
-				*(adj++) = v.second->index;
+				*(adj++) = v.second;
 			}
 		}
 		*(adj_start++) = adj - graph.adj;
-		*(child_start++) = child - graph.child;
 
 		assert(adj == graph.adj + adjacencies);
 		assert(adj_char == graph.adj_char + adjacencies);
-		assert(adj_start == graph.adj_start + nodes.size() + 1);
-
-		assert(child == graph.child + children);
-		assert(child_char == graph.child_char + children);
-		assert(child_start == graph.child_start + nodes.size() + 1);
+		assert(adj_start == graph.adj_start + nodes + 1);
 	}
 
-	{
-		auto depth = graph.depth;
-		auto maximal = graph.maximal;
-		auto parent = graph.parent;
-		auto rewind = graph.rewind;
-
-		for (uint32_t i = 0; i < nodes.size(); ++i) {
-			assert(nodes[i]->index == i);
-			*(depth++) = nodes[i]->depth;
-			*(maximal++) = nodes[i]->maximal;
-			if (nodes[i]->parent) {
-				*(parent++) = nodes[i]->parent->index;
-			} else {
-				assert(i == 0);
-				*(parent++) = -1U;
-			}
-			if (nodes[i]->rewind) {
-				*(rewind++) = nodes[i]->rewind->index;
-			} else {
-				*(rewind++) = -1U;
-			}
-		}
-		assert(depth   == graph.depth + nodes.size());
-		assert(maximal == graph.maximal + nodes.size());
-		assert(parent  == graph.parent + nodes.size());
-		assert(rewind  == graph.rewind + nodes.size());
-	}
+	std::copy(trie.depth.begin(), trie.depth.end(), graph.depth);
+	std::copy(maximal.begin(), maximal.end(), graph.maximal);
+	std::copy(trie.parent.begin(), trie.parent.end(), graph.parent);
+	std::copy(trie.rewind.begin(), trie.rewind.end(), graph.rewind);
 
 	stopwatch("build");
 
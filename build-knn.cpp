@@ -0,0 +1,116 @@
+#include <algorithm>
+
+#include "graph.hpp"
+#include "stopwatch.hpp"
+#include "parallel.hpp"
+#include "distances.hpp"
+
+//Keep only the cheapest few successors of each maximal word (cost is distance
+// minus the successor's length, i.e. -overlap, as in search-match), so that
+// the merge searches and bounds don't have to sweep the whole distance table.
+
+struct {
+	uint32_t k = 32; //successors kept per word
+	uint32_t threads = thread_count();
+	void describe() {
+		std::cout << "Options:\n";
+		std::cout << "\tSuccessors per word: " << k << "\n";
+		std::cout << "\tThreads: " << threads << "\n";
+	}
+} options;
+
+int main(int argc, char **argv) {
+
+	for (int a = 1; a < argc; ++a) {
+		std::string arg = argv[a];
+		std::string tag;
+		std::string value;
+		auto pos = arg.find(':');
+		tag = arg.substr(0, pos+1);
+		value = arg.substr(pos+1);
+		if (tag == "k:") {
+			options.k = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "threads:") {
+			options.threads = std::max(1, std::atoi(value.c_str()));
+		} else {
+			std::cerr << "Unknown tag '" << tag << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	options.describe();
+
+	stopwatch("start");
+	Graph graph;
+	if (!graph.read("wordlist.graph")) {
+		std::cerr << "Failed to read graph." << std::endl;
+		exit(1);
+	}
+	stopwatch("read graph");
+
+	std::vector< uint32_t > maximal;
+
+	for (auto m = graph.maximal; m != graph.maximal + graph.nodes; ++m) {
+		if (*m) {
+			maximal.emplace_back(m - graph.maximal);
+		}
+	}
+	std::cout << "Have " << maximal.size() << " maximal nodes." << std::endl;
+
+	Distances distances;
+	if (!distances.map("distances.table", maximal.size())) {
+		std::cerr << "failed to map distance table." << std::endl;
+		return 1;
+	}
+
+	stopwatch("map distances");
+
+	const uint32_t size = maximal.size();
+	const uint32_t k = std::min(options.k, size - 1);
+
+	std::vector< int32_t > depth(size);
+	for (uint32_t c = 0; c < size; ++c) {
+		depth[c] = graph.depth[maximal[c]];
+	}
+
+	//every row keeps exactly k successors, so rows can be filled in independently:
+	Successors successors;
+	successors.graph_hash = graph.hash();
+	successors.size = size;
+	successors.start.resize(size + 1);
+	for (uint32_t r = 0; r <= size; ++r) {
+		successors.start[r] = r * k;
+	}
+	successors.next.resize(size_t(size) * k);
+	successors.distance.resize(size_t(size) * k);
+
+	const uint32_t Block = 64;
+	std::vector< std::vector< std::pair< int32_t, uint32_t > > > scratch(options.threads);
+	parallel_for((size + Block - 1) / Block, [&](uint32_t block, uint32_t thread) {
+		auto &row = scratch[thread];
+		for (uint32_t r = block * Block; r < size && r < (block + 1) * Block; ++r) {
+			uint8_t const *dis = distances.row(r);
+			row.clear();
+			for (uint32_t c = 0; c < size; ++c) {
+				if (c == r) continue;
+				row.emplace_back(int32_t(dis[c]) - depth[c], c);
+			}
+			//(cost, column) order, so ties come out in column order:
+			std::nth_element(row.begin(), row.begin() + (k - 1), row.end());
+			std::sort(row.begin(), row.begin() + k);
+			for (uint32_t i = 0; i < k; ++i) {
+				successors.next[r * k + i] = row[i].second;
+				successors.distance[r * k + i] = dis[row[i].second];
+			}
+		}
+	}, options.threads);
+
+	stopwatch("select");
+
+	std::cout << "Writing " << successors.next.size() << " successors to 'successors.table'." << std::endl;
+	successors.write("successors.table");
+
+	stopwatch("write");
+
+	return 0;
+}
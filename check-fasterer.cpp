@@ -7,26 +7,7 @@
 #include <vector>
 #include <deque>
 #include "stopwatch.hpp"
-
-class Level : public std::map< char, Level * > {
-public:
-	Level() : length(0), depth(0), rewind(NULL), index(-1U), visited(false) { }
-	//set during initial build:
-	uint32_t length; //longest word that is a suffix of this context
-	uint32_t depth; //how long is the prefix?
-
-	bool is_terminal() const {
-		return length > 0 && length == depth;
-	}
-
-	//set during second build phase:
-	Level *rewind;
-	uint32_t index;
-
-	//to be removed at some point:
-	bool visited;
-};
-
+#include "trie.hpp"
 
 //Want to pack:
 // [char] [length] [depth] [first child] [child count]
@@ -120,123 +101,61 @@ int main(int argc, char **argv) {
 	//  would almost certainly also be a performance win.
 
 	{
-		Level root;
-		std::ifstream wordlist("wordlist.asc");
-		std::string word;
-		while (std::getline(wordlist, word)) {
-			Level *at = &root;
-			for (auto c : word) {
-				auto f = at->insert(std::make_pair(c, nullptr)).first;
-				if (f->second == NULL) {
-					f->second = new Level();
-					f->second->depth = at->depth + 1;
-				}
-				at = f->second;
-			}
-			assert(at);
-			assert(at->is_terminal() == false);
-			at->length = word.size();
-			assert(at->is_terminal() == true);
+		Trie trie;
+		if (!trie.load("wordlist")) {
+			std::cerr << "Failed to load word list." << std::endl;
+			return 1;
 		}
 
-		//set up rewind pointers in tree, level-by-level:
-		{
-			std::vector< Level * > layer;
-			layer.push_back(&root);
-			while (!layer.empty()) {
-				std::vector< Level * > next_layer;
-				for (auto l : layer) {
-					//update rewind pointers for children based on current rewind pointer.
-					for (auto cl : *l) {
-						next_layer.emplace_back(cl.second);
-
-						//rewind:
-						Level *r = l->rewind;
-						while (r != NULL) {
-							assert(r != NULL);
-							auto f = r->find(cl.first);
-							if (f != r->end()) {
-								//great, can extend this rewind:
-								r = f->second;
-								break;
-							} else {
-								//have to rewind further:
-								r = r->rewind;
-							}
-						}
-						assert(l == &root || r != NULL); //for everything but the root, rewind should always hit root and bounce down
-						if (r == NULL) r = &root;
-						cl.second->rewind = r;
-
-						//length:
-						// (a) length is already set to depth ['cause this is a terminal]
-						// (b) length can be set based on rewind ['cause if there is a word in the current context, rewind certainly is at least that long]
-						cl.second->length = std::max(cl.second->length, cl.second->rewind->length);
-					}
-				}
-				layer = next_layer;
+		//longest word that is a suffix of each node's context:
+		// (a) a terminal's own length;
+		// (b) at least its rewind's ['cause if there is a word in the current context, rewind certainly is at least that long]
+		std::vector< uint32_t > length(trie.size(), -1U);
+		std::vector< uint32_t > chain;
+		for (uint32_t n = 0; n < trie.size(); ++n) {
+			//(rewinds are shallower, so walk down the chain to something known and back up)
+			chain.clear();
+			for (uint32_t r = n; r != Trie::None && length[r] == -1U; r = trie.rewind[r]) {
+				chain.emplace_back(r);
+			}
+			for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+				uint32_t r = trie.rewind[*c];
+				length[*c] = std::max< uint32_t >(trie.terminal[*c] ? trie.depth[*c] : 0, r == Trie::None ? 0 : length[r]);
 			}
 		}
-		
-		//store tree into compressed:
-		{
-			//allocate indices (depth-first):
+
+		//store tree into compressed (nodes in the trie's order, i.e., depth-first):
+		std::vector< uint32_t > index(trie.size());
+		{ //allocate indices:
 			uint32_t next_index = 0;
-			std::deque< Level * > todo;
-			todo.push_back(&root);
-			while (!todo.empty()) {
-#define DFS
-#ifdef DFS
-				Level *l = todo.back(); todo.pop_back();
-				for (auto cl = l->rbegin(); cl != l->rend(); ++cl) {
-#else
-				Level *l = todo.front(); todo.pop_front();
-				for (auto cl = l->begin(); cl != l->end(); ++cl) {
-#endif
-					todo.push_back(cl->second);
-				}
-				l->index = next_index;
+			for (uint32_t n = 0; n < trie.size(); ++n) {
+				index[n] = next_index;
 				next_index += 2; //64 bits of header
-				next_index += l->size(); //32-bits per child
+				next_index += trie.children(n); //32-bits per child
 			}
 			std::cout << "Need " << next_index << " 32-bit storage locations for tree." << std::endl;
 			compressed.resize(next_index, 0);
 		}
-		{ //actually store data:
-			std::deque< Level * > todo;
-			todo.push_back(&root);
-			while (!todo.empty()) {
-#ifdef DFS
-				Level *l = todo.back(); todo.pop_back();
-				for (auto cl = l->rbegin(); cl != l->rend(); ++cl) {
-#else
-				Level *l = todo.front(); todo.pop_front();
-				for (auto cl = l->begin(); cl != l->end(); ++cl) {
-#endif
-					todo.push_back(cl->second);
-				}
-				assert(l->index + 1 < compressed.size());
-				CompLevel *comp = reinterpret_cast< CompLevel * >(&compressed[l->index]);
-				comp->length = l->length;
-				comp->depth = l->depth;
-				comp->visited = false;
-				comp->child_count = l->size();
-				if (l->rewind) {
-					assert(l->rewind->index < 0xffffff);
-					comp->rewind = l->rewind->index;
-				} else {
-					comp->rewind = 0xffffff;
-				}
-				uint32_t i = 0;
-				for (auto ci = l->begin(); ci != l->end(); ++ci) {
-					assert(l->index + 2 + i < compressed.size());
-					CompChild *c = reinterpret_cast< CompChild * >(&compressed[l->index + 2 + i]);
-					c->c = ci->first;
-					assert(ci->second->index <= 0xffffff);
-					c->index = ci->second->index;
-					assert(uint32_t(c->c) == *reinterpret_cast< uint32_t * >(c) >> 24);
-					++i;
-				}
+		for (uint32_t n = 0; n < trie.size(); ++n) { //actually store data:
+			assert(index[n] + 1 < compressed.size());
+			CompLevel *comp = reinterpret_cast< CompLevel * >(&compressed[index[n]]);
+			comp->length = length[n];
+			comp->depth = trie.depth[n];
+			comp->visited = false;
+			comp->child_count = trie.children(n);
+			if (trie.rewind[n] != Trie::None) {
+				assert(index[trie.rewind[n]] < 0xffffff);
+				comp->rewind = index[trie.rewind[n]];
+			} else {
+				comp->rewind = 0xffffff;
+			}
+			for (uint32_t i = 0; i < trie.children(n); ++i) {
+				assert(index[n] + 2 + i < compressed.size());
+				CompChild *c = reinterpret_cast< CompChild * >(&compressed[index[n] + 2 + i]);
+				c->c = trie.child_char[trie.child_start[n] + i];
+				assert(index[trie.child[trie.child_start[n] + i]] <= 0xffffff);
+				c->index = index[trie.child[trie.child_start[n] + i]];
+				assert(uint32_t(c->c) == *reinterpret_cast< uint32_t * >(c) >> 24);
 			}
 		}
 	}
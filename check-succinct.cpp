@@ -0,0 +1,161 @@
+#include <string>
+#include <iostream>
+#include <deque>
+#include <cassert>
+#include "stopwatch.hpp"
+#include "succinct.hpp"
+
+//check-fasterer's matcher, run on the succinct graph (see succinct.hpp) instead of
+// its packed tree: the same walk (children, else rewind and drop characters), with
+// the longest word ending at each node found along the rewind chain rather than
+// stored, and 'visited' kept as one bit per node.
+
+int main(int argc, char **argv) {
+	stopwatch("start");
+
+	SuccinctGraph graph;
+	{
+		Trie trie;
+		if (!trie.load("wordlist")) {
+			std::cerr << "Failed to load word list." << std::endl;
+			return 1;
+		}
+		graph.build(trie);
+	}
+	std::cout << "Succinct graph of " << graph.nodes << " nodes in " << graph.bytes() << " bytes ("
+		<< 8.0 * graph.bytes() / graph.nodes << " bits per node)." << std::endl;
+
+	stopwatch("build");
+
+	std::string portmantout;
+	if (!std::getline(std::cin, portmantout) || portmantout.size() == 0) {
+		std::cerr << "Please pass a portmantout on stdin." << std::endl;
+		return 1;
+	}
+
+	stopwatch("read");
+
+	std::cout << "Testing portmantout of " << portmantout.size() << " letters." << std::endl;
+
+	//longest word that is a suffix of n's context (the first terminal along its rewind chain):
+	auto length = [&graph](uint32_t n) -> uint32_t {
+		for (uint32_t r = n; r != SuccinctGraph::None; r = graph.rewind(r)) {
+			if (graph.terminal(r)) return graph.depth(r);
+		}
+		return 0;
+	};
+
+	std::vector< bool > visited(graph.nodes, false);
+	uint32_t at = 0;
+	uint32_t at_depth = 0;
+
+	//for each character in the current context, how many (including this one) remain in a word?
+	std::deque< uint32_t > lengths;
+	uint32_t count = 0;
+
+	uint32_t uncovered_characters = 0;
+	uint32_t uncovered_transitions = 0;
+	uint32_t missing_characters = 0;
+
+	for (auto iter = portmantout.begin(); iter <= portmantout.end(); ++iter) {
+		char c = (iter == portmantout.end() ? '\0' : *iter);
+
+		while (1) {
+			visited[at] = true;
+
+			uint32_t f = graph.find_child(at, c);
+			if (f != SuccinctGraph::None) {
+				at = f;
+				at_depth += 1;
+
+				lengths.push_back(0);
+				uint32_t l = length(at);
+				if (l > 0) {
+					assert(l <= lengths.size());
+					uint32_t &old = lengths[lengths.size() - l];
+					assert(l > old);
+					old = l;
+				}
+				break;
+			} else if (at != 0) {
+				//not at the root, so move up by dropping characters:
+				uint32_t rw = graph.rewind(at);
+				uint32_t rw_depth = graph.depth(rw);
+				uint32_t drop = at_depth - rw_depth;
+				at = rw;
+				at_depth = rw_depth;
+
+				for (uint32_t i = 0; i < drop; ++i) {
+					assert(!lengths.empty());
+					if (lengths[0] == 0) {
+						++uncovered_characters;
+						++uncovered_transitions; //because transition from uncovered is clearly uncovered
+					} else if (lengths[0] == 1) {
+						++uncovered_transitions;
+					} else {
+						assert(lengths.size() >= 2);
+						lengths[1] = std::max(lengths[1], lengths[0] - 1);
+					}
+					lengths.pop_front();
+					++count;
+				}
+
+			} else {
+				//at the root, so evict character:
+				assert(lengths.size() == 0);
+				missing_characters += 1;
+				uncovered_characters += 1;
+				count += 1;
+				break;
+			}
+		}
+	}
+	assert(count == portmantout.size() + 1);
+
+	//always have one of each of these because dropping the last character
+	// (assuming non-null portmantout)
+	assert(missing_characters > 0 && uncovered_characters > 0 && uncovered_transitions > 0);
+
+	missing_characters -= 1;
+	uncovered_characters -= 1;
+	uncovered_transitions -= 1;
+
+	std::cout << "Uncovered characters: " << uncovered_characters << std::endl;
+	std::cout << "Uncovered transitions: " << uncovered_transitions << std::endl;
+	std::cout << "Missing characters: " << missing_characters << std::endl;
+
+	{
+		//propagate visited up the trie (children before parents, rewinds after: so
+		// deepest first, which is just reverse level order), and count the words:
+		uint32_t found_words = 0;
+		uint32_t missed_words = 0;
+		for (uint32_t n = graph.nodes; n-- > 0; ) {
+			if (!visited[n]) {
+				auto range = graph.child_range(n);
+				for (uint32_t i = range.first; i < range.second; ++i) {
+					if (visited[i]) {
+						visited[n] = true;
+						break;
+					}
+				}
+			}
+			if (visited[n] && n != 0) {
+				visited[graph.rewind(n)] = true;
+			}
+			if (graph.terminal(n)) {
+				if (visited[n]) {
+					++found_words;
+				} else {
+					++missed_words;
+				}
+			}
+		}
+		std::cout << "Found " << found_words << " words." << std::endl;
+		std::cout << "Missed " << missed_words << " words." << std::endl;
+	}
+
+	stopwatch("test");
+
+	return 0;
+
+}
@@ -6,128 +6,71 @@
 #include <map>
 #include <set>
 #include <algorithm>
+#include <cmath>
 
-class Unique;
-class Unique2;
+#include "dawg.hpp"
 
 class Node : public std::map< char, Node * > {
 public:
 	Node() : terminal(false), src('\0'), id(-1U) { }
-	void add_string(std::string s) {
-		if (s.empty()) {
-			terminal = true;
-			return;
-		}
-		auto f = find(s[0]);
-		if (f == end()) f = insert(std::make_pair(s[0], new Node())).first;
-		f->second->add_string(s.substr(1));
-	}
-	void dagify_children(Unique &u);
-	void dagify_children(Unique2 &u);
-	uint32_t count() {
-		uint32_t ret = 1;
-		for (auto &c : *this) {
-			ret += c.second->count();
-		}
-		return ret;
-	}
 	bool terminal;
 
-	char src; //used in unique2 code
-	uint32_t id; //used in unique code
+	char src; //set if the letter is part of the node's identity
+	uint32_t id;
 };
 
 
+//The word list's trie with everything at min_depth and below merged into a
+// minimal DAWG (see dawg.hpp); store holds the merged nodes, by id. With
+// letter_in_key, nodes are only merged if they are also reached by the same letter:
 class Unique {
 public:
-	Unique() : fresh_id(0) { }
-	uint32_t fresh_id;
-	class NodeComp {
-	public:
-		bool operator()(Node *a, Node *b) {
-			if (a->terminal != b->terminal) return a->terminal < b->terminal;
-			if (a->size() != b->size()) return a->size() < b->size();
-			auto ia = a->begin(); auto ib = b->begin();
-			while (ia != a->end()) {
-				assert(ib != b->end());
-
-				if (*ia != *ib) return *ia < *ib;
-
-				++ia;
-				++ib;
+	Unique(std::vector< std::string > const &words, bool letter_in_key, uint32_t min_depth) {
+		DAWG dawg;
+		dawg.build(words, letter_in_key, min_depth);
+		trie_nodes = dawg.trie_nodes;
+
+		//(children are always finished before their parents, so come first)
+		std::vector< Node * > nodes(dawg.states.size(), nullptr);
+		store.assign(dawg.registered, nullptr);
+		for (uint32_t i = 0; i < dawg.states.size(); ++i) {
+			DAWG::State const &s = dawg.states[i];
+			Node *n = new Node();
+			n->src = s.src;
+			n->terminal = s.terminal;
+			n->id = s.id;
+			for (uint32_t e = s.first_edge; e < s.first_edge + s.edge_count; ++e) {
+				n->insert(n->end(), std::make_pair(dawg.edges[e].letter, nodes[dawg.edges[e].to]));
 			}
-			assert(ib == b->end());
-			return false;
+			nodes[i] = n;
+			if (s.id != DAWG::None) store[s.id] = n;
+			else unmerged.emplace_back(n);
 		}
-	};
-	std::set< Node *, NodeComp > store;
-	Node *unique(Node *n) {
-		assert(n->id == -1U);
-		auto res = store.insert(n);
-		if (res.second == false) delete n;
-		else n->id = fresh_id++;
-		return *res.first;
+		root = nodes[dawg.root];
 	}
-	uint32_t count() {
-		return store.size();
+	~Unique() {
+		for (auto n : store) delete n;
+		for (auto n : unmerged) delete n;
 	}
-};
-
+	Unique(Unique const &) = delete;
+	Unique &operator=(Unique const &) = delete;
 
-class Unique2 {
-public:
-	Unique2() : fresh_id(0) { }
-	uint32_t fresh_id;
-	class NodeComp {
-	public:
-		bool operator()(Node *a, Node *b) {
-			assert(a->src != '\0' && b->src != '\0');
-			if (a->src != b->src) return a->src < b->src;
-			if (a->terminal != b->terminal) return a->terminal < b->terminal;
-			if (a->size() != b->size()) return a->size() < b->size();
-			auto ia = a->begin(); auto ib = b->begin();
-			while (ia != a->end()) {
-				assert(ib != b->end());
-
-				if (*ia != *ib) return *ia < *ib;
-
-				++ia;
-				++ib;
-			}
-			assert(ib == b->end());
-			return false;
-		}
-	};
-	std::set< Node *, NodeComp > store;
-	Node *unique(char c, Node *n) {
-		assert(n->id == -1U);
-		assert(n->src == '\0');
-		n->src = c;
-		auto res = store.insert(n);
-		if (res.second == false) delete n;
-		else n->id = fresh_id++;
-		return *res.first;
-	}
+	Node *root;
+	std::vector< Node * > store;
+	std::vector< Node * > unmerged;
+	std::vector< uint32_t > trie_nodes; //trie nodes at each depth
 	uint32_t count() {
 		return store.size();
 	}
-};
-
-
-void Node::dagify_children(Unique &u) {
-	for (auto &c : *this) {
-		c.second->dagify_children(u);
-		c.second = u.unique(c.second);
-	}
-}
-
-
-void Node::dagify_children(Unique2 &u) {
-	for (auto &c : *this) {
-		c.second->dagify_children(u);
-		c.second = u.unique(c.first, c.second);
+	//trie nodes at depth and below:
+	uint32_t trie_count(uint32_t depth) {
+		uint32_t ret = 0;
+		for (uint32_t d = depth; d < trie_nodes.size(); ++d) {
+			ret += trie_nodes[d];
+		}
+		return ret;
 	}
-}
+};
 
 
 
@@ -250,10 +193,7 @@ int main(int argc, char **argv) {
 	//Okay, tree-peeling version.
 	// we're going to build a tree
 	{
-		Node root;
-		for (auto w : wordlist) {
-			root.add_string(w);
-		}
+		Unique trie(wordlist, true, -1U); //(nothing merged)
 	
 		std::map< uint32_t, uint32_t > strata_acts;
 		std::map< uint32_t, uint32_t > strata_counts;
@@ -261,7 +201,7 @@ int main(int argc, char **argv) {
 		std::map< uint32_t, uint32_t > strata_deltas;
 	
 		std::vector< std::vector< Node * > > strata;
-		strata.emplace_back(1, &root);
+		strata.emplace_back(1, trie.root);
 		while (1) {
 			std::vector< Node * > next;
 			for (auto n : strata.back()) {
@@ -295,10 +235,7 @@ int main(int argc, char **argv) {
 //	for (uint32_t split = 0; split < 10; ++split)
 	{
 		uint32_t split = 0; //6; //best so far
-		Node root;
-		for (auto w : wordlist) {
-			root.add_string(w);
-		}
+		Unique unique(wordlist, false, split + 1);
 
 		std::map< uint32_t, uint32_t > strata_counts;
 		std::map< uint32_t, uint32_t > strata_letters;
@@ -307,7 +244,7 @@ int main(int argc, char **argv) {
 
 		//levels below split get stored by strata, levels above split get id'd:
 		std::vector< std::vector< Node * > > strata;
-		strata.emplace_back(1, &root);
+		strata.emplace_back(1, unique.root);
 		for (uint32_t level = 0; level < split; ++level) {
 			std::vector< Node * > next;
 			for (auto n : strata.back()) {
@@ -335,13 +272,7 @@ int main(int argc, char **argv) {
 		std::cout << "That would be " << (opt_bits(strata_counts) + opt_bits(strata_deltas)) / 8.0 << " bytes to peel [count + delta]." << std::endl;
 */
 
-		Unique unique;
-
-		uint32_t pre_count = 0;
-		for (auto n : strata.back()) {
-			pre_count += n->count();
-			n->dagify_children(unique);
-		}
+		uint32_t pre_count = unique.trie_count(strata.size() - 1);
 
 		std::cout << "From " << pre_count << " to " << unique.count() << std::endl;
 
@@ -404,10 +335,7 @@ int main(int argc, char **argv) {
 	{
 		uint32_t split = 6; //TODO: investigate
 
-		Node root;
-		for (auto w : wordlist) {
-			root.add_string(w);
-		}
+		Unique unique(wordlist, true, split + 1);
 
 		std::map< uint32_t, uint32_t > strata_counts;
 		std::map< uint32_t, uint32_t > strata_deltas;
@@ -416,7 +344,7 @@ int main(int argc, char **argv) {
 
 		//levels below split get stored by strata, levels above split get id'd:
 		std::vector< std::vector< Node * > > strata;
-		strata.emplace_back(1, &root);
+		strata.emplace_back(1, unique.root);
 		for (uint32_t level = 0; level < split; ++level) {
 			std::vector< Node * > next;
 			for (auto n : strata.back()) {
@@ -443,13 +371,7 @@ int main(int argc, char **argv) {
 		std::cout << "That would be " << (opt_bits(strata_counts) + opt_bits(strata_deltas) + opt_bits(strata_terminals)) / 8.0 << " bytes to peel [count + delta]." << std::endl;
 
 
-		Unique2 unique;
-
-		uint32_t pre_count = 0;
-		for (auto n : strata.back()) {
-			pre_count += n->count();
-			n->dagify_children(unique);
-		}
+		uint32_t pre_count = unique.trie_count(strata.size() - 1);
 
 		std::cout << "From " << pre_count << " to " << unique.count() << std::endl;
 
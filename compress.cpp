@@ -11,89 +11,73 @@
 #include <random>
 #include <unordered_set>
 #include <list>
+#include <ctime>
+#include <iterator>
 
 #include <Eigen/Dense>
 
 #include "Coder.hpp"
-
-class Unique;
+#include "dawg.hpp"
+#include "pmw.hpp"
+#include "parallel.hpp"
 
 class Node : public std::map< char, Node * > {
 public:
 	Node() : terminal(false), src('\0'), id(-1U), refs(0) { }
-	void add_string(std::string s) {
-		if (s.empty()) {
-			terminal = true;
-			return;
-		}
-		auto f = find(s[0]);
-		if (f == end()) f = insert(std::make_pair(s[0], new Node())).first;
-		f->second->add_string(s.substr(1));
-	}
-	void dagify_children(Unique &u);
-	uint32_t count() {
-		uint32_t ret = 1;
-		for (auto &c : *this) {
-			ret += c.second->count();
-		}
-		return ret;
-	}
 	bool terminal;
 
-	char src; //used in unique2 code
-	uint32_t id; //used in unique code
+	char src; //letter on the way in
+	uint32_t id;
 	uint32_t refs;
 };
 
 
+//The minimal DAWG of a word list, as Nodes (built flat by DAWG, then handed out
+// as maps for Ply's benefit); store[id] is the node with that id:
 class Unique {
 public:
-	Unique() : fresh_id(0) { }
-	uint32_t fresh_id;
-	class NodeComp {
-	public:
-		bool operator()(Node *a, Node *b) {
-			if (a->src != b->src) return a->src < b->src;
-			if (a->terminal != b->terminal) return a->terminal < b->terminal;
-			if (a->size() != b->size()) return a->size() < b->size();
-			auto ia = a->begin(); auto ib = b->begin();
-			while (ia != a->end()) {
-				assert(ib != b->end());
-
-				if (*ia != *ib) return *ia < *ib;
-
-				++ia;
-				++ib;
+	Unique(std::vector< std::string > const &words) {
+		DAWG dawg;
+		dawg.build(words, true, 0);
+		trie_count = 0;
+		for (auto n : dawg.trie_nodes) {
+			trie_count += n;
+		}
+
+		//(children are always finished before their parents, so come first)
+		std::vector< Node * > nodes(dawg.states.size(), nullptr);
+		store.assign(dawg.registered, nullptr);
+		for (uint32_t i = 0; i < dawg.states.size(); ++i) {
+			DAWG::State const &s = dawg.states[i];
+			Node *n = new Node();
+			n->src = s.src;
+			n->terminal = s.terminal;
+			n->id = s.id;
+			for (uint32_t e = s.first_edge; e < s.first_edge + s.edge_count; ++e) {
+				assert(dawg.edges[e].to < i);
+				n->insert(n->end(), std::make_pair(dawg.edges[e].letter, nodes[dawg.edges[e].to]));
 			}
-			assert(ib == b->end());
-			return false;
+			nodes[i] = n;
+			assert(s.id < store.size());
+			store[s.id] = n;
 		}
-	};
-	std::set< Node *, NodeComp > store;
-	Node *unique(char c, Node *n) {
-		assert(n->id == -1U);
-		assert(n->src == '\0');
-		n->src = c;
-		auto res = store.insert(n);
-		if (res.second == false) {
+		fresh_id = dawg.registered;
+		root = nodes[dawg.root];
+	}
+	~Unique() {
+		for (auto n : store) {
 			delete n;
-		} else {
-			n->id = fresh_id++;
 		}
-		return *res.first;
-	}
-	uint32_t count() {
-		return store.size();
 	}
-};
+	Unique(Unique const &) = delete;
+	Unique &operator=(Unique const &) = delete;
 
+	std::vector< Node * > store;
+	uint32_t fresh_id;
+	Node *root;
+	uint64_t trie_count; //nodes before merging
+};
 
-void Node::dagify_children(Unique &u) {
-	for (auto &c : *this) {
-		c.second->dagify_children(u);
-		c.second = u.unique(c.first, c.second);
-	}
-}
 
 class Params {
 public:
@@ -115,6 +99,7 @@ public:
 	enum Split : int {
 		NoSplit,
 		SingleSplit,
+		TreeSplit, //recursive splits (see ContextTree)
 		SplitCount
 	} split;
 	bool reverse;
@@ -169,14 +154,270 @@ double est_bits_helper(std::map< int32_t, uint32_t > const &counts) {
 	return bits;
 }
 
+//same sum as above (in the same, increasing-value, order), but counting into a
+// dense array when the values span a small range, and runs of a sorted copy otherwise:
 double est_bits_helper(std::vector< int32_t > const &values) {
-	std::map< int32_t, uint32_t > counts;
-	for (auto v : values) {
-		counts.insert(std::make_pair(v, 0)).first->second += 1;
+	if (values.empty()) return 0.0;
+	auto range = std::minmax_element(values.begin(), values.end());
+	const int32_t min = *range.first;
+	const uint64_t span = uint64_t(int64_t(*range.second) - int64_t(min)) + 1;
+	const uint32_t total = values.size();
+	double bits = 0.0;
+	if (span <= uint64_t(total) * 4 + 1024) {
+		std::vector< uint32_t > counts(span, 0);
+		for (auto v : values) {
+			counts[uint32_t(int64_t(v) - int64_t(min))] += 1;
+		}
+		for (auto c : counts) {
+			if (c) bits += c * -std::log2(double(c) / total);
+		}
+	} else {
+		std::vector< int32_t > sorted = values;
+		std::sort(sorted.begin(), sorted.end());
+		for (auto run = sorted.begin(); run != sorted.end(); ) {
+			auto end = std::upper_bound(run, sorted.end(), *run);
+			uint32_t c = end - run;
+			bits += c * -std::log2(double(c) / total);
+			run = end;
+		}
 	}
-	return est_bits_helper(counts);
+	return bits;
 }
 
+//Context tree: recursively split the items on context features for as long as that
+// makes them cheaper to code. Costs are what an adaptive (Krichevsky-Trofimov) coder
+// would pay per leaf, so -- unlike the empirical entropy -- splitting isn't free and
+// the tree stops growing on its own; each node also pays to say whether (and on what)
+// it splits.
+//
+//Histograms are kept per (node, feature) as sorted (bin, symbol) counts. A split's
+// children get theirs handed down: all but the largest child are counted, and the
+// largest is the parent's minus its siblings'. Candidate features are scored on the
+// thread pool.
+class ContextTree {
+public:
+	enum : uint32_t {
+		MaxBins = 256, //features with more distinct values than this aren't split on
+		MaxDepth = 8,
+		ParallelItems = 4096, //nodes with fewer items are grown on one thread
+	};
+
+	//columns[f][i] is context feature f of item i; values[i] is what gets coded:
+	ContextTree(std::vector< std::vector< int32_t > > const &columns, std::vector< int32_t > const &values, uint32_t threads_ = thread_count()) : threads(threads_) {
+		if (values.empty()) return;
+		const uint32_t n = values.size();
+		symbols.resize(n);
+		symbol_count = dense(values, symbols);
+		half_k = 0.5 * symbol_count;
+		for (auto const &column : columns) {
+			assert(column.size() == n);
+			std::vector< uint32_t > codes(n);
+			uint32_t bins = dense(column, codes);
+			if (bins < 2 || bins > MaxBins) continue;
+			features.emplace_back(std::move(codes));
+			feature_bins.emplace_back(bins);
+		}
+		choice_bits = std::log2(double(features.size() + 1));
+
+		std::vector< uint32_t > items(n);
+		for (uint32_t i = 0; i < n; ++i) {
+			items[i] = i;
+		}
+		std::vector< Table > tables(features.size());
+		parallel_for(features.size(), [&](uint32_t f, uint32_t) {
+			tables[f] = count(items, f);
+		}, threads);
+		bits = 1.0 + grow(items, tables, leaf_bits(histogram(items)), 0);
+	}
+
+	double bits = 0.0;
+	uint32_t leaves = 0;
+	uint32_t depth = 0;
+
+	std::string describe() const {
+		return "tree(" + std::to_string(leaves) + " leaves, depth " + std::to_string(depth) + ")";
+	}
+
+private:
+	uint32_t threads;
+	std::vector< uint32_t > symbols; //values, as dense codes
+	uint32_t symbol_count = 0;
+	double half_k = 0.0;
+	std::vector< std::vector< uint32_t > > features; //splittable features, as dense codes
+	std::vector< uint32_t > feature_bins;
+	double choice_bits = 0.0;
+
+	//(bin << 32 | symbol) -> count, sorted by key:
+	typedef std::vector< std::pair< uint64_t, uint32_t > > Table;
+
+	//replace values with their ranks; returns the number of distinct values:
+	static uint32_t dense(std::vector< int32_t > const &values, std::vector< uint32_t > &codes) {
+		std::vector< int32_t > sorted = values;
+		std::sort(sorted.begin(), sorted.end());
+		sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+		for (uint32_t i = 0; i < values.size(); ++i) {
+			codes[i] = std::lower_bound(sorted.begin(), sorted.end(), values[i]) - sorted.begin();
+		}
+		return sorted.size();
+	}
+
+	//adaptive (KT) code length of a histogram over the whole alphabet:
+	double leaf_bits(std::vector< uint32_t > const &counts) const {
+		double nats = -std::lgamma(half_k);
+		uint32_t total = 0;
+		for (auto c : counts) {
+			nats -= std::lgamma(c + 0.5) - std::lgamma(0.5);
+			total += c;
+		}
+		nats += std::lgamma(total + half_k);
+		return nats / std::log(2.0);
+	}
+
+	std::vector< uint32_t > histogram(std::vector< uint32_t > const &items) const {
+		std::vector< uint32_t > sorted;
+		sorted.reserve(items.size());
+		for (auto i : items) {
+			sorted.emplace_back(symbols[i]);
+		}
+		std::sort(sorted.begin(), sorted.end());
+		std::vector< uint32_t > counts;
+		for (uint32_t i = 0; i < sorted.size(); ++i) {
+			if (i == 0 || sorted[i] != sorted[i-1]) counts.emplace_back(0);
+			counts.back() += 1;
+		}
+		return counts;
+	}
+
+	//two counting-sort passes (symbol, then bin) and run-length; or, for a few items
+	// from a big alphabet, just sort their keys:
+	Table count(std::vector< uint32_t > const &items, uint32_t f) const {
+		std::vector< uint32_t > const &codes = features[f];
+		if (items.size() * 8 < symbol_count + feature_bins[f]) {
+			std::vector< uint64_t > keys;
+			keys.reserve(items.size());
+			for (auto i : items) {
+				keys.emplace_back((uint64_t(codes[i]) << 32) | symbols[i]);
+			}
+			std::sort(keys.begin(), keys.end());
+			Table table;
+			for (auto key : keys) {
+				if (!table.empty() && table.back().first == key) table.back().second += 1;
+				else table.emplace_back(key, 1);
+			}
+			return table;
+		}
+		std::vector< uint32_t > by_symbol(items.size()), by_bin(items.size());
+		std::vector< uint32_t > start(symbol_count + 1, 0);
+		for (auto i : items) start[symbols[i] + 1] += 1;
+		for (uint32_t s = 0; s < symbol_count; ++s) start[s + 1] += start[s];
+		for (auto i : items) by_symbol[start[symbols[i]]++] = i;
+		start.assign(feature_bins[f] + 1, 0);
+		for (auto i : items) start[codes[i] + 1] += 1;
+		for (uint32_t b = 0; b < feature_bins[f]; ++b) start[b + 1] += start[b];
+		for (auto i : by_symbol) by_bin[start[codes[i]]++] = i;
+		Table table;
+		for (auto i : by_bin) {
+			uint64_t key = (uint64_t(codes[i]) << 32) | symbols[i];
+			if (!table.empty() && table.back().first == key) table.back().second += 1;
+			else table.emplace_back(key, 1);
+		}
+		return table;
+	}
+
+	static Table subtract(Table const &from, Table const &other) {
+		Table ret;
+		ret.reserve(from.size());
+		auto o = other.begin();
+		for (auto const &e : from) {
+			while (o != other.end() && o->first < e.first) ++o;
+			uint32_t c = e.second;
+			if (o != other.end() && o->first == e.first) c -= o->second;
+			if (c) ret.emplace_back(e.first, c);
+		}
+		return ret;
+	}
+
+	//'from' less every entry of 'others' (which is sorted but may repeat keys):
+	static Table subtract_all(Table const &from, Table const &others) {
+		Table summed;
+		for (auto const &e : others) {
+			if (!summed.empty() && summed.back().first == e.first) summed.back().second += e.second;
+			else summed.emplace_back(e);
+		}
+		return subtract(from, summed);
+	}
+
+	//cost of coding each bin of 'table' as its own leaf (each bin's counts are contiguous):
+	double split_bits(Table const &table) const {
+		double bits = 0.0;
+		std::vector< uint32_t > counts;
+		for (auto e = table.begin(); e != table.end(); ) {
+			uint64_t bin = e->first >> 32;
+			counts.clear();
+			for (; e != table.end() && (e->first >> 32) == bin; ++e) {
+				counts.emplace_back(e->second);
+			}
+			bits += leaf_bits(counts) + 1.0; //(+ each child's split-or-not flag)
+		}
+		return bits;
+	}
+
+	//returns the cost of the subtree (with tables[f] = count(items, f) for every feature):
+	double grow(std::vector< uint32_t > const &items, std::vector< Table > &tables, double as_leaf, uint32_t level) {
+		depth = std::max(depth, level);
+		//(small nodes aren't worth starting threads for)
+		const uint32_t node_threads = (items.size() < ParallelItems ? 1 : threads);
+		uint32_t best = -1U;
+		double best_bits = as_leaf;
+		if (level < MaxDepth && items.size() > 1) {
+			std::vector< double > scores(features.size());
+			parallel_for(features.size(), [&](uint32_t f, uint32_t) {
+				scores[f] = choice_bits + split_bits(tables[f]);
+			}, node_threads);
+			for (uint32_t f = 0; f < features.size(); ++f) {
+				if (scores[f] < best_bits) {
+					best_bits = scores[f];
+					best = f;
+				}
+			}
+		}
+		if (best == -1U) {
+			leaves += 1;
+			return as_leaf;
+		}
+
+		//split into children by the best feature's bins:
+		std::vector< std::vector< uint32_t > > children(feature_bins[best]);
+		for (auto i : items) {
+			children[features[best][i]].emplace_back(i);
+		}
+		uint32_t largest = 0;
+		for (uint32_t b = 0; b < children.size(); ++b) {
+			if (children[b].size() > children[largest].size()) largest = b;
+		}
+		std::vector< std::vector< Table > > child_tables(children.size(), std::vector< Table >(features.size()));
+		parallel_for(features.size(), [&](uint32_t f, uint32_t) {
+			Table others; //all the counted children's entries (keys may repeat)
+			for (uint32_t b = 0; b < children.size(); ++b) {
+				if (b == largest || children[b].empty()) continue;
+				child_tables[b][f] = count(children[b], f);
+				others.insert(others.end(), child_tables[b][f].begin(), child_tables[b][f].end());
+			}
+			std::sort(others.begin(), others.end());
+			child_tables[largest][f] = subtract_all(tables[f], others);
+		}, node_threads);
+		tables.clear(); //(done with the parent's)
+
+		double bits = choice_bits;
+		for (uint32_t b = 0; b < children.size(); ++b) {
+			if (children[b].empty()) continue;
+			bits += 1.0 + grow(children[b], child_tables[b], leaf_bits(histogram(children[b])), level + 1);
+			child_tables[b].clear();
+		}
+		return bits;
+	}
+};
+
 /*
 double est_bits_delta(std::vector< uint32_t > const &data) {
 	if (data.empty()) return 0.0;
@@ -236,21 +477,31 @@ double est_bits_split(std::vector< const char * > features, std::vector< std::pa
 			best_bits = bits;
 			desc = feature;
 		}
-/*
-		//TODO: recursive splitting
-		if (bins.size() > 1) {
-			std::string rec_desc = "";
-			double rec_bits = est_bits_split(features, data, params, rec_desc);
-			rec_desc = feature + std::string("|") + rec_desc;
-			rec_bits += label_bits;
-			printf("  % 6.0f saved [inc %2.0f label] w/ %s\n",
-				std::floor((basic_bits - rec_bits + label_bits) / 8.0),
-				std::ceil(label_bits / 8.0),
-				rec_desc(std::string("|" + feature));
-			if (rec_bits
+	}
+
+	if (params.split == Params::TreeSplit) {
+		std::vector< std::vector< int32_t > > columns(features.size());
+		std::vector< int32_t > values;
+		values.reserve(data.size());
+		for (auto const &d : data) {
+			for (uint32_t f = 0; f < features.size(); ++f) {
+				auto found = d.first.find(features[f]);
+				assert(found != d.first.end());
+				columns[f].emplace_back(found->second);
+			}
+			values.emplace_back(d.second);
+		}
+		//(a tree that never splits is just a costlier no-split, so keep whichever wins)
+		ContextTree tree(columns, values);
+		if (params.verbose_split) {
+			printf("  %6.0f bytes w/ %s\n", std::ceil(tree.bits / 8.0), tree.describe().c_str());
+		}
+		if (tree.bits < best_bits) {
+			best_bits = tree.bits;
+			desc = tree.describe();
 		}
-*/
 	}
+
 	return best_bits;
 }
 
@@ -294,14 +545,20 @@ double report(const char *name, std::vector< std::pair< Context, int32_t > > con
 	}
 
 #ifdef EXACT
-	Coder init, equal, adapt;
+	std::map< int32_t, uint32_t > counts;
+	for (auto const &d : data) {
+		counts.insert(std::make_pair(d.second, 0)).first->second += 1;
+	}
+	Coder init, equal, adapt, fenwick;
+	double adapt_seconds = 0.0, fenwick_seconds = 0.0;
 	{
 		std::map< int32_t, uint32_t > fixed(counts.begin(), counts.end());
 		Distribution dist(fixed);
 		std::cout << "f"; std::cout.flush();
-		for (auto d : data) {
-			init.write(d, dist);
+		for (auto const &d : data) {
+			init.write(d.second, dist);
 		}
+		init.finish();
 	}
 	{
 		std::map< int32_t, uint32_t > blank(counts.begin(), counts.end());
@@ -310,16 +567,34 @@ double report(const char *name, std::vector< std::pair< Context, int32_t > > con
 		}
 		Distribution dist(blank);
 		std::cout << "e"; std::cout.flush();
-		for (auto d : data) {
-			equal.write(d, dist);
+		for (auto const &d : data) {
+			equal.write(d.second, dist);
 		}
+		equal.finish();
 		std::cout << "a"; std::cout.flush();
-		for (auto d : data) {
-			adapt.write(d, dist);
-			dist.update_for_val(d);
+		clock_t before = std::clock();
+		for (auto const &d : data) {
+			adapt.write(d.second, dist);
+			dist.update_for_val(d.second);
 		}
+		adapt.finish();
+		adapt_seconds = (std::clock() - before) / double(CLOCKS_PER_SEC);
 	}
-	printf("   init: %d, equal: %d, adapt: %d\n", (int)init.output.size(), (int)equal.output.size(), (int)adapt.output.size());
+	//(the model needs a slot per value in [min, max], so skip very wide alphabets)
+	if (uint64_t(int64_t(counts.rbegin()->first) - counts.begin()->first) < 0x8000) {
+		AdaptiveModel model(counts.begin()->first, counts.rbegin()->first);
+		std::cout << "m"; std::cout.flush();
+		clock_t before = std::clock();
+		for (auto const &d : data) {
+			fenwick.write(d.second, model);
+		}
+		fenwick.finish();
+		fenwick_seconds = (std::clock() - before) / double(CLOCKS_PER_SEC);
+	}
+	printf("   init: %d, equal: %d, adapt: %d (%.2f Msym/s), model: %d (%.2f Msym/s)\n",
+		(int)init.output.size(), (int)equal.output.size(),
+		(int)adapt.output.size(), data.size() / std::max(adapt_seconds, 1e-9) * 1e-6,
+		(int)fenwick.output.size(), data.size() / std::max(fenwick_seconds, 1e-9) * 1e-6);
 #endif //EXACT
 	return best_bits;
 }
@@ -402,6 +677,33 @@ public:
 				+ d.ids.size() //ids themselves
 			);
 		}
+
+		//materialize every feature (inherited ones included) as a column:
+		const uint32_t n = data.size();
+		features.assign(size_t(first_feature + feature_count) * n, 0);
+		if (previous) {
+			std::vector< uint32_t > parent(n);
+			for (uint32_t i = 0; i < n; ++i) {
+				parent[i] = data[i].previous - &(previous->data[0]);
+			}
+			for (uint32_t f = 0; f < first_feature; ++f) {
+				int32_t const *from = previous->column(f);
+				int32_t *to = &features[size_t(f) * n];
+				for (uint32_t i = 0; i < n; ++i) {
+					to[i] = from[parent[i]];
+				}
+			}
+		}
+		for (uint32_t i = 0; i < n; ++i) {
+			PlyData const &d = data[i];
+			features[size_t(first_feature + Letter) * n + i] = d.letter;
+			features[size_t(first_feature + ChildCount) * n + i] = d.child_count;
+			features[size_t(first_feature + IdCount) * n + i] = d.ids.size();
+			features[size_t(first_feature + Terminal) * n + i] = d.terminal;
+			for (uint32_t j = 0; j < d.ids.size(); ++j) {
+				features[size_t(first_feature + FirstId + j) * n + i] = d.ids[j];
+			}
+		}
 	}
 
 	enum : uint32_t {
@@ -418,35 +720,92 @@ public:
 	uint32_t first_feature;
 	uint32_t feature_count;
 
-	int32_t get_feature(uint32_t index, uint32_t feature) {
+	//feature f of every entry of data (features of earlier plys are those of the entry's ancestor there):
+	int32_t const *column(uint32_t feature) const {
 		assert(feature < first_feature + feature_count);
+		return features.data() + size_t(feature) * data.size();
+	}
+
+	int32_t get_feature(uint32_t index, uint32_t feature) const {
 		assert(index < data.size());
-		PlyData &d = data[index];
-		if (feature < first_feature) {
-			assert(previous);
-			return previous->get_feature(d.previous - &(previous->data[0]), feature);
-		} else {
-			if (feature - first_feature == Letter) {
-				return d.letter;
-			} else if (feature - first_feature == ChildCount) {
-				return d.child_count;
-			} else if (feature - first_feature == IdCount) {
-				return d.ids.size();
-			} else if (feature - first_feature == Terminal) {
-				return d.terminal;
-			} else { assert(feature - first_feature >= FirstId);
-				uint32_t i = feature - first_feature - FirstId;
-				if (i < d.ids.size()) {
-					return d.ids[i];
+		return column(feature)[index];
+	}
+
+	//sort 'inds' by the given features, most important first (ties keep their order).
+	// MSD radix sort: each feature only refines the runs the ones before it left tied,
+	// with a counting sort when a run's values span a small range:
+	void order(std::vector< uint32_t > &inds, std::vector< uint32_t > const &first, std::vector< uint32_t > const &then) const {
+		std::vector< std::pair< uint32_t, uint32_t > > runs, next_runs; //[begin, end) of tied entries
+		if (inds.size() > 1) runs.emplace_back(0, inds.size());
+		std::vector< uint32_t > scratch(inds.size());
+		std::vector< uint32_t > counts;
+		std::vector< std::pair< int32_t, uint32_t > > wide;
+		auto refine = [&](uint32_t feature) {
+			int32_t const *values = column(feature);
+			next_runs.clear();
+			for (auto const &run : runs) {
+				uint32_t *begin = &inds[run.first];
+				uint32_t *end = &inds[0] + run.second;
+				const uint32_t size = run.second - run.first;
+				int32_t min = values[*begin], max = min;
+				for (uint32_t *i = begin; i != end; ++i) {
+					min = std::min(min, values[*i]);
+					max = std::max(max, values[*i]);
+				}
+				if (min == max) {
+					next_runs.emplace_back(run);
+					continue;
+				}
+				const uint64_t span = uint64_t(int64_t(max) - int64_t(min)) + 1;
+				if (span <= uint64_t(size) * 4 + 256) {
+					counts.assign(span + 1, 0);
+					for (uint32_t *i = begin; i != end; ++i) {
+						counts[values[*i] - min + 1] += 1;
+					}
+					for (uint32_t v = 0; v < span; ++v) {
+						counts[v + 1] += counts[v];
+					}
+					for (uint32_t *i = begin; i != end; ++i) {
+						scratch[counts[values[*i] - min]++] = *i;
+					}
+					std::copy(scratch.begin(), scratch.begin() + size, begin);
 				} else {
-					return 0;
+					wide.clear();
+					for (uint32_t *i = begin; i != end; ++i) {
+						wide.emplace_back(values[*i], *i);
+					}
+					std::stable_sort(wide.begin(), wide.end(), [](std::pair< int32_t, uint32_t > const &a, std::pair< int32_t, uint32_t > const &b) {
+						return a.first < b.first;
+					});
+					for (uint32_t j = 0; j < size; ++j) {
+						begin[j] = wide[j].second;
+					}
+				}
+				for (uint32_t b = run.first; b < run.second; ) {
+					uint32_t e = b + 1;
+					while (e < run.second && values[inds[e]] == values[inds[b]]) ++e;
+					if (e - b > 1) next_runs.emplace_back(b, e);
+					b = e;
 				}
 			}
+			runs.swap(next_runs);
+		};
+		for (auto f : first) {
+			if (runs.empty()) return;
+			refine(f);
+		}
+		for (auto f : then) {
+			if (runs.empty()) return;
+			refine(f);
 		}
 	}
+
+private:
+	std::vector< int32_t > features; //column-major, so each feature is contiguous
 };
 
-void compress(std::vector< std::string > const &_wordlist, Params const &params) {
+//returns the estimated size (in bytes):
+double compress(std::vector< std::string > const &_wordlist, Params const &params) {
 	std::vector< std::string > wordlist = _wordlist;
 
 	std::sort(wordlist.begin(), wordlist.end());
@@ -575,15 +934,9 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 		return a.size() > b.size(); //longer words first 
 	});*/
 
-	//Build a tree from the words:
-	Node root;
-	for (auto w : wordlist) {
-		root.add_string(w);
-	}
-
-	Unique unique;
-	root.dagify_children(unique);
-	unique.unique('\0', &root);
+	//Build the minimal DAWG of the words (which must be in order for that):
+	std::sort(wordlist.begin(), wordlist.end());
+	Unique unique(wordlist);
 
 	for (auto n : unique.store) {
 		for (auto cn : *n) {
@@ -592,7 +945,7 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 	}
 
 	if (params.verbose) {
-		std::cout << "   Unique from " << root.count() << " to " << unique.store.size() << std::endl;
+		std::cout << "   Unique from " << unique.trie_count << " to " << unique.store.size() << std::endl;
 		/*
 		std::vector< uint32_t > hist;
 		for (auto n : unique.store) {
@@ -653,6 +1006,7 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 	std::vector< std::pair< Context, int32_t > > s_id_deltas;
 	std::vector< std::pair< Context, int32_t > > s_ids;
 
+	double total_bytes = 0.0;
 	{ //everything that gets referenced more than once gets stored as a separate blob:
 
 		//store by (descending) id:
@@ -716,33 +1070,11 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 					to_store.emplace_back(f);
 				}
 
-				std::vector< std::vector< int32_t > > feats(ply.first_feature + ply.feature_count, std::vector< int32_t >(ply.data.size()));
+				std::vector< int32_t const * > feats(ply.first_feature + ply.feature_count);
 				for (uint32_t f = 0; f < feats.size(); ++f) {
-					for (uint32_t d = 0; d < feats[f].size(); ++d) {
-						feats[f][d] = ply.get_feature(d, f);
-					}
+					feats[f] = ply.column(f);
 				}
 
-				//sort re-sorts the indices based on the current feature priority:
-				auto sort = [&stored, &to_store, &inds, &feats]() {
-					assert(to_store.size() + stored.size() == feats.size());
-					std::sort(inds.begin(), inds.end(), [&](uint32_t a, uint32_t b){
-						for (auto const f : stored) {
-							int32_t fa = feats[f][a];
-							int32_t fb = feats[f][b];
-							if (fa != fb) return fa < fb;
-						}
-						for (auto const f : to_store) {
-							int32_t fa = feats[f][a];
-							int32_t fb = feats[f][b];
-							if (fa != fb) return fa < fb;
-						}
-						return false;
-					});
-				};
-
-				static std::mt19937 mt(0xfeedbeef);
-				
 				double ply_bits = 0.0;
 
 				std::cout << " " << ply.data.size() << " nodes x " << ply.feature_count << " features:" << std::endl;
@@ -757,91 +1089,90 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 
 					double best_bits = std::numeric_limits< double >::infinity();
 					uint32_t best_first = -1U;
-					uint32_t first = 0;
-					for (uint32_t iter = 0; iter < 10; ++iter) {
-						//try all sorts of features as "most important":
-						first = first + 1;
-						if (first > stored.size()) first = 0;
-
-						for (uint32_t i = 0; i < stored.size(); ++i) {
-							if (stored[i] == first) {
-								std::swap(stored[i], stored[0]);
-								break;
+					if (to_store[0] - ply.first_feature > Ply::FirstId + 1) {
+						//we glom 'em, so no data here.
+						best_bits = 0.0;
+						best_first = 0;
+					} else if (to_store[0] - ply.first_feature == Ply::FirstId + 1) {
+						//just glom the deltas (order doesn't matter to a histogram):
+						std::vector< int32_t > nodelta;
+						for (auto const &d : ply.data) {
+							for (uint32_t i = 1; i < d.ids.size(); ++i) {
+								nodelta.emplace_back(d.ids[i]);
 							}
 						}
-						//randomize importance of the other ones:
-						for (uint32_t i = 1; i < stored.size(); ++i) {
-							std::swap(stored[i], stored[i + mt() % (stored.size() - i)]);
-						}
-
-						//always sort preserving the selected value:
-						for (uint32_t i = 1; i < to_store.size(); ++i) {
-							std::swap(to_store[i], to_store[i + mt() % (to_store.size() - i)]);
-						}
-						sort();
-
-
-						std::vector< int32_t > data;
-
-						if (to_store[0] - ply.first_feature > Ply::FirstId + 1) {
-							//we glom 'em, so no data here.
-							best_bits = 0.0;
-							best_first = 0;
-							break;
-						} else if (to_store[0] - ply.first_feature == Ply::FirstId + 1) {
-							//just glom the deltas; only need one iter
-							std::vector< int32_t > nodelta;
-							for (auto i : inds) {
-								PlyData &d = ply.data[i];
-								bool first = true;
-								for (auto id : d.ids) {
-									if (first) {
-										first = false;
-									} else {
-										nodelta.emplace_back(id);
-									}
+						best_bits = est_bits_helper(nodelta);
+						best_first = 0;
+					} else {
+						//try all sorts of features as "most important", with the importance of the
+						// others randomized; trials are independent, so each gets its own RNG
+						// stream and they run on the thread pool:
+						const uint32_t Trials = 10;
+						std::vector< double > trial_bits(Trials, 0.0);
+						std::vector< uint32_t > trial_first(Trials, 0);
+						parallel_for(Trials, [&](uint32_t trial, uint32_t) {
+							std::seed_seq seed{0xfeedbeefU, to_store[0], trial};
+							std::mt19937 mt(seed);
+
+							uint32_t first = (trial + 1) % (stored.size() + 1);
+							std::vector< uint32_t > trial_stored = stored;
+							for (uint32_t i = 0; i < trial_stored.size(); ++i) {
+								if (trial_stored[i] == first) {
+									std::swap(trial_stored[i], trial_stored[0]);
+									break;
 								}
 							}
-							best_bits = est_bits_helper(nodelta);
-							best_first = 0;
-							break;
-						} else if (to_store[0] - ply.first_feature == Ply::FirstId) {
-							for (auto i : inds) {
-								PlyData &d = ply.data[i];
-								if (!d.ids.empty()) {
-									data.emplace_back(d.ids[0]);
-								}
+							for (uint32_t i = 1; i < trial_stored.size(); ++i) {
+								std::swap(trial_stored[i], trial_stored[i + mt() % (trial_stored.size() - i)]);
 							}
-						} else {
-							for (auto i : inds) {
-								data.emplace_back(feats[to_store[0]][i]);
+							//always sort preserving the selected value:
+							std::vector< uint32_t > trial_to_store = to_store;
+							for (uint32_t i = 1; i < trial_to_store.size(); ++i) {
+								std::swap(trial_to_store[i], trial_to_store[i + mt() % (trial_to_store.size() - i)]);
+							}
+							std::vector< uint32_t > trial_inds = inds;
+							ply.order(trial_inds, trial_stored, trial_to_store);
+
+							std::vector< int32_t > data;
+							data.reserve(trial_inds.size());
+							if (to_store[0] - ply.first_feature == Ply::FirstId) {
+								for (auto i : trial_inds) {
+									PlyData const &d = ply.data[i];
+									if (!d.ids.empty()) {
+										data.emplace_back(d.ids[0]);
+									}
+								}
+							} else {
+								for (auto i : trial_inds) {
+									data.emplace_back(feats[to_store[0]][i]);
+								}
 							}
-						}
-
-						//trim zeros:
-						while (!data.empty() && data.back() == 0) {
-							data.pop_back();
-						}
-						while (!data.empty() && data[0] == 0) {
-							data.erase(data.begin());
-						}
-
-						double test_bits = 0.0;
 
-						if (data.size() > 1) {
-							for (uint32_t i = 0; i + 1 < data.size(); ++i) {
-								data[i] = data[i+1] - data[i];
+							//trim zeros:
+							while (!data.empty() && data.back() == 0) {
+								data.pop_back();
 							}
-							data.pop_back();
+							data.erase(data.begin(), std::find_if(data.begin(), data.end(), [](int32_t v) { return v != 0; }));
 
-							test_bits += est_bits_helper(data);
-						}
+							double test_bits = 0.0;
+							if (data.size() > 1) {
+								for (uint32_t i = 0; i + 1 < data.size(); ++i) {
+									data[i] = data[i+1] - data[i];
+								}
+								data.pop_back();
 
-						if (test_bits < best_bits) {
-							best_bits = test_bits;
-							best_first = first;
+								test_bits += est_bits_helper(data);
+							}
+							trial_bits[trial] = test_bits;
+							trial_first[trial] = first;
+						});
+						//(earliest wins ties, as when trials ran in order)
+						for (uint32_t trial = 0; trial < Trials; ++trial) {
+							if (trial_bits[trial] < best_bits) {
+								best_bits = trial_bits[trial];
+								best_first = trial_first[trial];
+							}
 						}
-						if (test_bits == 0) break;
 					}
 
 
@@ -889,7 +1220,9 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 						}
 
 						//best (least-squares) predictor of the feature:
-						Eigen::VectorXf x = A.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(b);
+						// (any least-squares x gives the same A * x, so a pivoted QR -- which never
+						//  forms Q -- does as well as the SVD here, at a fraction of the cost)
+						Eigen::VectorXf x = A.colPivHouseholderQr().solve(b);
 
 
 						Eigen::VectorXf score = A * x;
@@ -942,9 +1275,7 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 						while (!data.empty() && data.back() == 0) {
 							data.pop_back();
 						}
-						while (!data.empty() && data[0] == 0) {
-							data.erase(data.begin());
-						}
+						data.erase(data.begin(), std::find_if(data.begin(), data.end(), [](int32_t v) { return v != 0; }));
 
 						double test_bits = 0.0;
 						if (!data.empty()) {
@@ -970,6 +1301,24 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 						}
 
 					}
+					if (params.split == Params::TreeSplit && !stored.empty() && to_store[0] - ply.first_feature <= Ply::FirstId) { //Try a context tree over the stored features:
+						bool first_id = (to_store[0] - ply.first_feature == Ply::FirstId);
+						std::vector< std::vector< int32_t > > columns(stored.size());
+						std::vector< int32_t > values;
+						for (uint32_t i = 0; i < ply.data.size(); ++i) {
+							if (first_id && ply.data[i].ids.empty()) continue;
+							for (uint32_t c = 0; c < stored.size(); ++c) {
+								columns[c].emplace_back(feats[stored[c]][i]);
+							}
+							values.emplace_back(first_id ? int32_t(ply.data[i].ids[0]) : feats[to_store[0]][i]);
+						}
+						ContextTree tree(columns, values);
+						std::cout << "  ctx " << std::ceil(tree.bits / 8.0) << " " << tree.describe();
+						if (tree.bits < best_bits) {
+							std::cout << " [!!]";
+							best_bits = tree.bits;
+						}
+					}
 					std::cout << std::endl;
 					//------------------------------------------
 
@@ -989,7 +1338,7 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 		} //for (seeds)
 
 		std::cout << "Total bytes: " << std::ceil(total_bits / 8.0) << std::endl;
-
+		total_bytes = std::ceil(total_bits / 8.0);
 	}
 
 
@@ -1007,6 +1356,7 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 	}
 */
 
+	return total_bytes;
 }
 
 
@@ -1014,6 +1364,40 @@ void compress(std::vector< std::string > const &_wordlist, Params const &params)
 int main(int argc, char **argv) {
 	srand(time(0));
 
+	bool sweep = (argc == 2 && std::string(argv[1]) == "sweep");
+
+	if (argc > 1 && !sweep) {
+		//write a .pmw (see pmw.hpp) instead of estimating:
+		if (argc > 3) {
+			std::cerr << "Usage:\n\t./compress [<out.pmw> [in.asc]]\n\t./compress sweep\n (With no arguments, estimates sizes for wordlist.asc; 'sweep' estimates every letter map / re-id / reverse combination.)" << std::endl;
+			return 1;
+		}
+		std::string in_file = (argc > 2 ? argv[2] : "wordlist.asc");
+		std::string text;
+		{
+			std::ifstream file(in_file, std::ios::binary);
+			if (!file) {
+				std::cerr << "Failed to open '" << in_file << "'." << std::endl;
+				return 1;
+			}
+			text.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+		}
+		std::vector< uint8_t > pmw;
+		std::string error;
+		if (!PMW::encode(text, pmw, &error)) {
+			std::cerr << "Can't store '" << in_file << "': " << error << "." << std::endl;
+			return 1;
+		}
+		std::ofstream out(argv[1], std::ios::binary);
+		out.write(reinterpret_cast< const char * >(pmw.data()), pmw.size());
+		if (!out) {
+			std::cerr << "Failed to write '" << argv[1] << "'." << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << text.size() << " bytes of '" << in_file << "' as " << pmw.size() << " bytes to '" << argv[1] << "'." << std::endl;
+		return 0;
+	}
+
 	std::vector< std::string > wordlist;
 	{ //load:
 		std::ifstream file("wordlist.asc");
@@ -1026,36 +1410,41 @@ int main(int argc, char **argv) {
 
 	Params params;
 
-#define SINGLE
-#ifdef SINGLE
-	params.verbose = true;
-	params.letter_map = Params::ByFrequency;
-	params.re_id = Params::RefCount;
-	params.reverse = false;
-	params.split = Params::SingleSplit;
-	params.only_root = false;
-	compress(wordlist, params);
-#else
-	params.verbose = false;
-	params.split = Params::SingleSplit;
-
-	for (int letter_map = 0; letter_map < Params::MapCount; ++letter_map)
-	for (int re_id = 0; re_id < Params::IdCount; ++re_id)
-	for (int reverse = 0; reverse < 2; ++reverse)
-	{
-
-		params.letter_map = (Params::LetterMap)letter_map;
-		params.re_id = (Params::ReID)re_id;
-		params.reverse = reverse;
-		uint32_t iters = 1;
-		/*if (params.re_id == Params::Random) {
-			iters = 10;
-		}*/
-		for (uint32_t iter = 0; iter < iters; ++iter) {
-			compress(wordlist, params);
+	if (!sweep) {
+		params.verbose = true;
+		params.letter_map = Params::ByFrequency;
+		params.re_id = Params::RefCount;
+		params.reverse = false;
+		params.split = Params::TreeSplit;
+		params.only_root = false;
+		compress(wordlist, params);
+	} else {
+		params.verbose = false;
+		params.split = Params::TreeSplit;
+
+		std::vector< std::pair< std::string, double > > results;
+		for (int letter_map = 0; letter_map < Params::MapCount; ++letter_map)
+		for (int re_id = 0; re_id < Params::IdCount; ++re_id)
+		for (int reverse = 0; reverse < 2; ++reverse)
+		{
+
+			params.letter_map = (Params::LetterMap)letter_map;
+			params.re_id = (Params::ReID)re_id;
+			params.reverse = reverse;
+			uint32_t iters = 1;
+			/*if (params.re_id == Params::Random) {
+				iters = 10;
+			}*/
+			for (uint32_t iter = 0; iter < iters; ++iter) {
+				std::cout << "==== " << params.describe() << " ====" << std::endl;
+				results.emplace_back(params.describe(), compress(wordlist, params));
+			}
+		}
+		std::cout << "Sweep:" << std::endl;
+		for (auto const &r : results) {
+			std::cout << "  " << r.first << " " << r.second << " bytes" << std::endl;
 		}
 	}
-#endif
 
 
 	return 0;
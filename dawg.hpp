@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cassert>
+
+//Minimal DAWG built incrementally from a word list (Daciuk et al.): words arrive
+// grouped by prefix with siblings in increasing letter order (e.g. sorted; letters
+// compare as unsigned bytes, as in std::string), so only the path of the most
+// recent word is ever open. When the next word leaves that path, the nodes it
+// leaves are finished -- deepest first -- and each is replaced by an equal node
+// already registered, or registered itself. Nodes are compared by (incoming letter,
+// if letter_in_key; terminal; [(letter, child)]) with children already canonical,
+// so the register is a hash table over flat arrays.
+//
+//Registration order is a post-order walk of the trie (children in letter order),
+// which is exactly the id order the old std::set-based dagify produced.
+
+class DAWG {
+public:
+	enum : uint32_t { None = -1U };
+
+	struct Edge {
+		char letter;
+		uint32_t to; //index into states
+	};
+
+	struct State {
+		char src; //letter on the way in ('\0' for the root, or if !letter_in_key)
+		bool terminal;
+		uint32_t id; //registration order, or None if shallower than min_depth
+		uint32_t first_edge;
+		uint32_t edge_count;
+	};
+
+	std::vector< State > states;
+	std::vector< Edge > edges;
+	uint32_t root = None;
+	uint32_t registered = 0;
+	std::vector< uint32_t > trie_nodes; //trie nodes at each depth (i.e., before merging)
+
+	//nodes shallower than min_depth are kept as in the trie (and not given ids):
+	void build(std::vector< std::string > const &words, bool letter_in_key, uint32_t min_depth) {
+		states.clear();
+		edges.clear();
+		table.assign(1024, None);
+		registered = 0;
+		trie_nodes.assign(1, 1);
+		key_letter = letter_in_key;
+		open.clear();
+		pending.clear();
+
+		open.emplace_back(Open{'\0', false, 0});
+		std::string const *prev = nullptr;
+		for (auto const &word : words) {
+			uint32_t common = 0;
+			if (prev) {
+				while (common < prev->size() && common < word.size() && (*prev)[common] == word[common]) ++common;
+			}
+			while (open.size() > common + 1) {
+				finish(min_depth);
+			}
+			for (uint32_t i = common; i < word.size(); ++i) {
+				assert(open.size() == i + 1);
+				assert(pending.size() == open.back().first_pending || uint8_t(pending.back().letter) < uint8_t(word[i]));
+				open.emplace_back(Open{word[i], false, uint32_t(pending.size())});
+				if (trie_nodes.size() <= i + 1) trie_nodes.emplace_back(0);
+				trie_nodes[i + 1] += 1;
+			}
+			open.back().terminal = true;
+			prev = &word;
+		}
+		while (!open.empty()) {
+			finish(min_depth);
+		}
+		assert(pending.empty());
+	}
+
+private:
+	bool key_letter = true;
+
+	struct Open {
+		char src;
+		bool terminal;
+		uint32_t first_pending; //this node's (finished) children start here in pending
+	};
+	std::vector< Open > open; //path of the most recent word, root first
+	std::vector< Edge > pending;
+
+	std::vector< uint32_t > table; //open-addressed register of state indices (power-of-two size)
+
+	//replace-or-register the deepest open node, and hand it to its parent:
+	void finish(uint32_t min_depth) {
+		uint32_t depth = open.size() - 1;
+		Open node = open.back();
+		open.pop_back();
+		char src = (key_letter || depth == 0 ? node.src : '\0');
+		Edge const *kids = pending.data() + node.first_pending;
+		uint32_t kid_count = pending.size() - node.first_pending;
+
+		uint32_t index = None;
+		if (depth >= min_depth) {
+			uint32_t h = hash(src, node.terminal, kids, kid_count);
+			uint32_t slot = h & (table.size() - 1);
+			while (table[slot] != None) {
+				if (same(states[table[slot]], src, node.terminal, kids, kid_count)) {
+					index = table[slot];
+					break;
+				}
+				slot = (slot + 1) & (table.size() - 1);
+			}
+			if (index == None) {
+				index = add(src, node.terminal, kids, kid_count, registered++);
+				table[slot] = index;
+				if (registered * 2 > table.size()) grow();
+			}
+		} else {
+			index = add(src, node.terminal, kids, kid_count, None);
+		}
+
+		pending.resize(node.first_pending);
+		if (open.empty()) {
+			root = index;
+		} else {
+			pending.emplace_back(Edge{node.src, index});
+		}
+	}
+
+	uint32_t add(char src, bool terminal, Edge const *kids, uint32_t kid_count, uint32_t id) {
+		states.emplace_back(State{src, terminal, id, uint32_t(edges.size()), kid_count});
+		edges.insert(edges.end(), kids, kids + kid_count);
+		return states.size() - 1;
+	}
+
+	bool same(State const &s, char src, bool terminal, Edge const *kids, uint32_t kid_count) const {
+		if (s.src != src || s.terminal != terminal || s.edge_count != kid_count) return false;
+		Edge const *e = edges.data() + s.first_edge;
+		for (uint32_t i = 0; i < kid_count; ++i) {
+			if (e[i].letter != kids[i].letter || e[i].to != kids[i].to) return false;
+		}
+		return true;
+	}
+
+	//FNV-1a over the key:
+	static uint32_t hash(char src, bool terminal, Edge const *kids, uint32_t kid_count) {
+		uint32_t h = 2166136261U;
+		auto mix = [&h](uint32_t v) {
+			for (uint32_t b = 0; b < 4; ++b) {
+				h = (h ^ ((v >> (8 * b)) & 0xff)) * 16777619U;
+			}
+		};
+		mix(uint8_t(src) | (terminal ? 0x100 : 0));
+		for (uint32_t i = 0; i < kid_count; ++i) {
+			mix(uint8_t(kids[i].letter));
+			mix(kids[i].to);
+		}
+		return h;
+	}
+
+	void grow() {
+		std::vector< uint32_t > old;
+		old.swap(table);
+		table.assign(old.size() * 2, None);
+		for (auto index : old) {
+			if (index == None) continue;
+			State const &s = states[index];
+			uint32_t slot = hash(s.src, s.terminal, edges.data() + s.first_edge, s.edge_count) & (table.size() - 1);
+			while (table[slot] != None) slot = (slot + 1) & (table.size() - 1);
+			table[slot] = index;
+		}
+	}
+};
@@ -0,0 +1,45 @@
+#include "pmw.hpp"
+#include "stopwatch.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+
+//Rebuild a word list from a .pmw written by compress (see pmw.hpp).
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t./decompress <in.pmw> <out.asc>" << std::endl;
+		return 1;
+	}
+
+	std::vector< uint8_t > pmw;
+	{
+		std::ifstream file(argv[1], std::ios::binary);
+		if (!file) {
+			std::cerr << "Failed to open '" << argv[1] << "'." << std::endl;
+			return 1;
+		}
+		pmw.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+	}
+	stopwatch("read");
+
+	std::string text;
+	if (!PMW::decode(pmw, text)) {
+		std::cerr << "'" << argv[1] << "' isn't a valid .pmw file." << std::endl;
+		return 1;
+	}
+	stopwatch("decode");
+
+	std::ofstream out(argv[2], std::ios::binary);
+	out.write(text.data(), text.size());
+	if (!out) {
+		std::cerr << "Failed to write '" << argv[2] << "'." << std::endl;
+		return 1;
+	}
+	stopwatch("write");
+
+	std::cout << "Rebuilt " << text.size() << " bytes from " << pmw.size() << "." << std::endl;
+
+	return 0;
+}
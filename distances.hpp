@@ -0,0 +1,285 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "graph.hpp"
+
+//Read-only, memory-mapped view of the (maximal x maximal) table written by build-distances.
+// Rows are paged in by the OS as they are touched, so tools that sweep the table
+// don't need to hold all of it in memory at once.
+class Distances {
+public:
+	Distances() = default;
+	Distances(Distances const &) = delete;
+	Distances &operator=(Distances const &) = delete;
+	~Distances() {
+		if (data) munmap(const_cast< uint8_t * >(data), size_t(size) * size);
+	}
+
+	bool map(std::string filename, uint32_t size_) {
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || size_t(st.st_size) != size_t(size_) * size_) {
+			close(fd);
+			return false;
+		}
+		void *mapped = mmap(nullptr, size_t(size_) * size_, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapped == MAP_FAILED) return false;
+		data = reinterpret_cast< uint8_t const * >(mapped);
+		size = size_;
+		return true;
+	}
+
+	uint8_t const *row(uint32_t r) const {
+		return data + size_t(r) * size;
+	}
+	uint8_t operator()(uint32_t r, uint32_t c) const {
+		return data[size_t(r) * size + c];
+	}
+
+	//the longest distance (so, e.g., self-edges can be made to cost more than any step):
+	uint8_t max() const {
+		uint8_t ret = 0;
+		for (uint32_t r = 0; r < size; ++r) {
+			ret = std::max(ret, *std::max_element(row(r), row(r) + size));
+		}
+		return ret;
+	}
+
+	uint32_t size = 0;
+	uint8_t const *data = nullptr;
+};
+
+//The word a portmantout has to start with (the first maximal word spelled
+// "portmanteau..."), as an index into 'maximal'; or -1U if there isn't one:
+inline uint32_t find_start(Graph const &graph, std::vector< uint32_t > const &maximal, std::string *word = nullptr) {
+	for (uint32_t i = 0; i < maximal.size(); ++i) {
+		std::string prefix;
+		uint32_t at = maximal[i];
+		while (graph.parent[at] < graph.nodes) {
+			uint32_t parent = graph.parent[at];
+			for (uint32_t c = graph.child_start[parent]; c < graph.child_start[parent+1]; ++c) {
+				if (graph.child[c] == at) prefix += graph.child_char[c];
+			}
+			at = parent;
+		}
+		std::reverse(prefix.begin(), prefix.end());
+		if (prefix.substr(0, 11) == "portmanteau") {
+			if (word) *word = prefix;
+			return i;
+		}
+	}
+	return -1U;
+}
+
+//distances.table as rows for the assignment solvers (hungarian.hpp, auction.hpp),
+// except self-edges cost 'self' (more than any distance; see max()) and edges into the start
+// word are free -- closing the path back into the start word makes any portmantout
+// into an assignment, so the min assignment is a lower bound.
+//(The table's pointer and size are copied in rather than read through the Distances
+// in every weight(), which made match-home's Hungarian twice as slow as on dense().)
+class BoundRows {
+public:
+	BoundRows(Distances const &distances, uint32_t start_, uint8_t self_) : data(distances.data), count(distances.size), start(start_), self(self_) { }
+	uint32_t size() const { return count; }
+	uint32_t begin(uint32_t r) const { return 0; }
+	uint32_t end(uint32_t r) const { return count; }
+	uint32_t column(uint32_t r, uint32_t e) const { return e; }
+	uint8_t weight(uint32_t r, uint32_t e) const {
+		if (r == e) return self;
+		if (e == start) return 0;
+		return data[size_t(r) * count + e];
+	}
+
+	//all of the weights, row-major (for solvers that do better on plain DenseRows):
+	std::vector< uint8_t > dense() const {
+		std::vector< uint8_t > ret(data, data + size_t(count) * count);
+		for (uint32_t r = 0; r < count; ++r) {
+			ret[size_t(r) * count + start] = 0;
+			ret[size_t(r) * count + r] = self;
+		}
+		return ret;
+	}
+
+	uint8_t const *data;
+	uint32_t count;
+	uint32_t start;
+	uint8_t self;
+};
+
+//The cheapest few successors of every maximal word (as written by build-knn), in
+// compressed sparse rows. Successors are sorted by merge cost, which is
+// distance minus the depth (length) of the successor -- that is, -overlap.
+class Successors {
+public:
+	uint64_t graph_hash = 0; //Graph::hash() of the graph (and so the distances) these came from
+	uint32_t size = 0; //number of maximal words (rows)
+	std::vector< uint32_t > start; //size + 1 entries
+	std::vector< uint32_t > next; //maximal index of each successor
+	std::vector< uint8_t > distance; //distances.table entry for each successor
+
+	uint32_t begin(uint32_t r) const { return start[r]; }
+	uint32_t end(uint32_t r) const { return start[r+1]; }
+
+	//true if row r lists every other word (so running off the end of it means there are no more):
+	bool complete(uint32_t r) const { return end(r) - begin(r) + 1 >= size; }
+
+	//distance from r to c if c is listed as a successor, otherwise 0xff:
+	uint8_t find(uint32_t r, uint32_t c) const {
+		for (uint32_t e = begin(r); e != end(r); ++e) {
+			if (next[e] == c) return distance[e];
+		}
+		return 0xff;
+	}
+
+	//file is [graph hash] [size] [edges] [start...] [next...] [distance...]:
+	void write(std::string filename) const {
+		std::ofstream out(filename);
+		uint32_t edges = next.size();
+		out.write(reinterpret_cast< const char * >(&graph_hash), 8);
+		out.write(reinterpret_cast< const char * >(&size), 4);
+		out.write(reinterpret_cast< const char * >(&edges), 4);
+		out.write(reinterpret_cast< const char * >(&start[0]), 4 * start.size());
+		out.write(reinterpret_cast< const char * >(&next[0]), 4 * next.size());
+		out.write(reinterpret_cast< const char * >(&distance[0]), distance.size());
+	}
+
+	//returns false if the file is missing or wasn't made from this graph / word count:
+	bool read(std::string filename, uint64_t expected_hash, uint32_t expected_size) {
+		std::ifstream in(filename);
+		uint32_t edges = 0;
+		if (!in.read(reinterpret_cast< char * >(&graph_hash), 8)) return false;
+		if (!in.read(reinterpret_cast< char * >(&size), 4)) return false;
+		if (!in.read(reinterpret_cast< char * >(&edges), 4)) return false;
+		if (graph_hash != expected_hash || size != expected_size) return false;
+		start.resize(size + 1);
+		next.resize(edges);
+		distance.resize(edges);
+		if (!in.read(reinterpret_cast< char * >(&start[0]), 4 * start.size())) return false;
+		if (!in.read(reinterpret_cast< char * >(&next[0]), 4 * next.size())) return false;
+		if (!in.read(reinterpret_cast< char * >(&distance[0]), distance.size())) return false;
+		if (start[0] != 0 || start[size] != edges) return false;
+		return true;
+	}
+};
+
+//The letters that take each maximal word to each other one along a shortest path
+// (as written by build-distances with 'bridges:true'), so a path of maximal words
+// can be spelled out without searching. Every node's word is a suffix of the
+// letters spelled to reach it, so a bridge to maximal word c is either the last
+// few letters of c (if it's no longer than c) or some "head" followed by all of c.
+// Each group of words that share a rewind pointer (and so have the same out-edges,
+// and the same bridges) only needs a few distinct heads, so each bridge is one byte:
+// a length below Heads, or Heads + the index of its head in the group's list.
+class Bridges {
+public:
+	enum : uint8_t {
+		Heads = 0x40, //codes below this are suffix lengths
+		Missing = 0xff, //not stored (group had too many heads, or path too long); search instead
+	};
+	uint64_t graph_hash = 0; //Graph::hash() of the graph these came from
+	uint32_t size = 0; //number of maximal words
+	uint32_t groups = 0;
+	std::vector< uint32_t > group; //group of each row
+	std::vector< uint8_t > code; //code[group * size + c] is bridge (group -> c)
+	std::vector< uint32_t > word_start; //size + 1 entries; maximal word c is letters[word_start[c], word_start[c+1])
+	std::vector< char > letters;
+	std::vector< uint32_t > head_start; //groups + 1 entries; group g's heads are heads[head_start[g], head_start[g+1])
+	std::vector< uint32_t > heads; //where each head starts in pool
+	std::vector< char > pool; //interned heads, as [length][letters]
+
+	//letters from maximal word r to maximal word c (none from a word to itself); false if not stored:
+	bool get(uint32_t r, uint32_t c, std::string &out) const {
+		if (r == c) {
+			out.clear();
+			return true;
+		}
+		uint8_t b = code[size_t(group[r]) * size + c];
+		if (b == Missing) return false;
+		char const *word = &letters[0] + word_start[c];
+		char const *word_end = &letters[0] + word_start[c+1];
+		if (b < Heads) {
+			out.assign(word_end - b, word_end);
+		} else {
+			char const *head = &pool[heads[head_start[group[r]] + (b - Heads)]];
+			out.assign(head + 1, head + 1 + uint8_t(head[0]));
+			out.append(word, word_end);
+		}
+		return true;
+	}
+
+	//file is [graph hash] [size] [groups] [group...] [code...] [word_start...] [letters...]
+	//        [head_start...] [heads...] [pool bytes] [pool...]:
+	void write(std::string filename) const {
+		std::ofstream out(filename);
+		uint32_t bytes = pool.size();
+		out.write(reinterpret_cast< const char * >(&graph_hash), 8);
+		out.write(reinterpret_cast< const char * >(&size), 4);
+		out.write(reinterpret_cast< const char * >(&groups), 4);
+		out.write(reinterpret_cast< const char * >(&group[0]), 4 * group.size());
+		out.write(reinterpret_cast< const char * >(&code[0]), code.size());
+		out.write(reinterpret_cast< const char * >(&word_start[0]), 4 * word_start.size());
+		out.write(&letters[0], letters.size());
+		out.write(reinterpret_cast< const char * >(&head_start[0]), 4 * head_start.size());
+		out.write(reinterpret_cast< const char * >(heads.data()), 4 * heads.size());
+		out.write(reinterpret_cast< const char * >(&bytes), 4);
+		out.write(pool.data(), pool.size());
+	}
+
+	//returns false if the file is missing, damaged, or wasn't made from this graph / word count:
+	bool read(std::string filename, uint64_t expected_hash, uint32_t expected_size) {
+		std::ifstream in(filename);
+		uint32_t bytes = 0;
+		if (!in.read(reinterpret_cast< char * >(&graph_hash), 8)) return false;
+		if (!in.read(reinterpret_cast< char * >(&size), 4)) return false;
+		if (!in.read(reinterpret_cast< char * >(&groups), 4)) return false;
+		if (graph_hash != expected_hash || size != expected_size) return false;
+		group.resize(size);
+		code.resize(size_t(groups) * size);
+		word_start.resize(size + 1);
+		head_start.resize(groups + 1);
+		if (!in.read(reinterpret_cast< char * >(&group[0]), 4 * group.size())) return false;
+		if (!in.read(reinterpret_cast< char * >(&code[0]), code.size())) return false;
+		if (!in.read(reinterpret_cast< char * >(&word_start[0]), 4 * word_start.size())) return false;
+		letters.resize(word_start[size]);
+		if (!in.read(&letters[0], letters.size())) return false;
+		if (!in.read(reinterpret_cast< char * >(&head_start[0]), 4 * head_start.size())) return false;
+		heads.resize(head_start[groups]);
+		if (!in.read(reinterpret_cast< char * >(heads.data()), 4 * heads.size())) return false;
+		if (!in.read(reinterpret_cast< char * >(&bytes), 4)) return false;
+		pool.resize(bytes);
+		if (!in.read(pool.data(), pool.size())) return false;
+
+		//everything get() indexes with has to be in range:
+		if (word_start[0] != 0 || head_start[0] != 0) return false;
+		for (uint32_t c = 0; c < size; ++c) {
+			if (word_start[c+1] < word_start[c] || group[c] >= groups) return false;
+		}
+		for (uint32_t g = 0; g < groups; ++g) {
+			if (head_start[g+1] < head_start[g]) return false;
+		}
+		for (auto h : heads) {
+			if (h >= pool.size() || h + 1 + uint8_t(pool[h]) > pool.size()) return false;
+		}
+		for (uint32_t g = 0; g < groups; ++g) {
+			uint8_t const *row = &code[size_t(g) * size];
+			for (uint32_t c = 0; c < size; ++c) {
+				if (row[c] == Missing) continue;
+				if (row[c] < Heads ? row[c] > word_start[c+1] - word_start[c] : uint32_t(row[c] - Heads) >= head_start[g+1] - head_start[g]) return false;
+			}
+		}
+		return true;
+	}
+};
@@ -12,9 +12,9 @@ public:
 		uint32_t bytes = 0;
 		bytes += 12; //nodes, adjacencies, children storage
 		#define DO(X, C) \
+			uint32_t X##_at = bytes; \
 			do { \
 				assert(bytes % sizeof(*(X)) == 0); \
-				(X) = reinterpret_cast< decltype(X) >(NULL) + bytes / sizeof(*(X)); \
 				bytes += sizeof(*(X)) * (C); \
 				while (bytes % 4) ++bytes; \
 			} while(0)
@@ -43,7 +43,7 @@ public:
 
 		#define DO(X) \
 			do { \
-				X += reinterpret_cast< decltype(X) >(storage.get()) - reinterpret_cast< decltype(X) >(NULL); \
+				X = reinterpret_cast< decltype(X) >(reinterpret_cast< char * >(storage.get()) + X##_at); \
 			} while(0)
 		DO(depth);
 		DO(maximal);
@@ -88,6 +88,17 @@ public:
 		out.write(reinterpret_cast< const char * >(storage.get()), 4 * storage_size);
 	}
 
+	//FNV-1a hash of everything in the graph (e.g., to tell whether tables computed from it are stale):
+	uint64_t hash() const {
+		assert(storage);
+		uint64_t h = 14695981039346656037ULL;
+		uint8_t const *bytes = reinterpret_cast< uint8_t const * >(storage.get());
+		for (uint32_t i = 0; i < 4 * storage_size; ++i) {
+			h = (h ^ bytes[i]) * 1099511628211ULL;
+		}
+		return h;
+	}
+
 	bool read(std::string filename) {
 		std::ifstream in(filename);
 		if (!in.read(reinterpret_cast< char * >(&nodes), 4)) return false;
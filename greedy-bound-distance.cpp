@@ -8,6 +8,7 @@
 
 #include "graph.hpp"
 #include "stopwatch.hpp"
+#include "greedy.hpp"
 
 struct {
 	void describe() {
@@ -58,10 +59,10 @@ int main(int argc, char **argv) {
 	const uint32_t size = maximal.size();
 
 
-	std::unique_ptr< uint8_t[] > distances(new uint8_t[maximal.size() * maximal.size()]);
+	std::unique_ptr< uint8_t[] > distances(new uint8_t[size_t(size) * size]);
 
 	std::ifstream in("distances.table");
-	if (!in.read(reinterpret_cast< char * >(distances.get()), maximal.size() * maximal.size())) {
+	if (!in.read(reinterpret_cast< char * >(distances.get()), size_t(size) * size)) {
 		std::cerr << "failed to read distance table." << std::endl;
 		return false;
 	}
@@ -69,58 +70,39 @@ int main(int argc, char **argv) {
 	stopwatch("read distances");
 
 
-	std::set< uint8_t > dis;
+	uint8_t max_dis = 0;
 	{
-		uint8_t max_dis = 0;
 		uint8_t *start = distances.get();
-		uint8_t *end = distances.get() + maximal.size() * maximal.size();
+		uint8_t *end = distances.get() + size_t(size) * size;
 		for (uint8_t *d = start; d != end; ++d) {
 			max_dis = std::max(max_dis, *d);
 		}
 		std::cout << "Max distance is " << int(max_dis) << std::endl;
 		stopwatch("max");
 
-		for (uint32_t i = 0; i < maximal.size(); ++i) {
-			distances[i * maximal.size() + i] = max_dis + 1;
+		for (uint32_t i = 0; i < size; ++i) {
+			distances[size_t(i) * size + i] = max_dis + 1;
 		}
 		std::cout << "Self-edges discouraged." << std::endl;
 		stopwatch("diag");
 
-		for (uint8_t d = 1; d <= max_dis + 1; ++d) {
-			dis.insert(d);
-		}
 		std::cout << "Using lazy hack." << std::endl;
-		/*for (uint8_t *d = start; d != end; ++d) {
-			dis.insert(*d);
-		}
-		std::cout << "Only " << dis.size() << " distances appear." << std::endl;
-		stopwatch("insert");
-		*/
 	}
 
+	GreedyAssignment greedy(size, distances.get());
+	greedy.take_all = true;
+	greedy.skip_diagonal = true;
+	greedy.count();
+	stopwatch("count distances");
+
 	//------------------------------------------
 
-	std::vector< bool > r_assigned(size, false), c_assigned(size, false);
-	uint32_t total = 0;
-	for (auto d : dis) {
-		uint32_t assignments = 0;
-		for (uint32_t r = 0; r < size; ++r) {
-			if (r_assigned[r]) continue;
-			for (uint32_t c = 0; c < size; ++c) {
-				if (c_assigned[c]) continue;
-				if (r == c) continue;
-				assert(distances[r * size + c] >= d);
-				if (distances[r * size + c] == d) {
-					r_assigned[r] = true;
-					c_assigned[c] = true;
-					total += distances[r * size + c];
-					++assignments;
-				}
-				
-			}
-		}
+	uint64_t total = 0;
+	for (uint32_t d = 1; d <= uint32_t(max_dis) + 1; ++d) {
+		uint32_t assignments = greedy.assign(d, total);
 		std::cout << "After " << assignments << " assignments at distance '" << (int)d << "', total is " << total << std::endl;
 	}
+	stopwatch("greedy");
 
 	return 0;
 	
@@ -8,6 +8,8 @@
 
 #include "graph.hpp"
 #include "stopwatch.hpp"
+#include "parallel.hpp"
+#include "greedy.hpp"
 
 struct {
 	void describe() {
@@ -83,14 +85,24 @@ int main(int argc, char **argv) {
 		}
 		stopwatch("words");
 	}
-	std::unique_ptr< uint8_t[] > overlaps(new uint8_t[size*size]);
+	std::unique_ptr< uint8_t[] > overlaps(new uint8_t[size_t(size) * size]);
 	stopwatch("alloc");
 
+	//overlaps.table starts with a header saying which graph (and how many words) it was computed for:
+	const uint64_t graph_hash = graph.hash();
 	bool compute_overlaps;
 
 	{
 		std::ifstream in("overlaps.table");
-		if (in.read(reinterpret_cast< char * >(overlaps.get()), size * size)) {
+		uint64_t file_hash = 0;
+		uint32_t file_size = 0;
+		if (!in.read(reinterpret_cast< char * >(&file_hash), 8) || !in.read(reinterpret_cast< char * >(&file_size), 4)) {
+			std::cerr << "Failed to read overlaps table header, will compute" << std::endl;
+			compute_overlaps = true;
+		} else if (file_hash != graph_hash || file_size != size) {
+			std::cerr << "Overlaps table is stale (computed for a different wordlist.graph), will recompute" << std::endl;
+			compute_overlaps = true;
+		} else if (in.read(reinterpret_cast< char * >(overlaps.get()), size_t(size) * size)) {
 			std::cerr << "Read overlaps from table." << std::endl;
 			compute_overlaps = false;
 		} else {
@@ -101,98 +113,66 @@ int main(int argc, char **argv) {
 	}
 
 	if (compute_overlaps) {
-		for (uint32_t r = 0; r < size; ++r) {
-			std::vector< bool > word(graph.nodes, false);
-			//std::unordered_set< uint32_t > word; //nodes in the word
-			{
-				uint32_t at = maximal[r];
-				while (at != 0) {
-					assert(at < graph.nodes);
-					word[at] = true; //.insert(at);
-					at = graph.parent[at];
-				}
-				word[0] = true; //word.insert(at);
+		//each thread marks the nodes of its current row's word in its own bitset:
+		const uint32_t threads = thread_count();
+		std::vector< std::vector< uint64_t > > in_word(threads, std::vector< uint64_t >((graph.nodes + 63) / 64, 0));
+		std::atomic< uint32_t > finished(0);
+		parallel_for(size, [&](uint32_t r, uint32_t thread) {
+			auto &word = in_word[thread];
+			auto mark = [&](uint32_t n, bool value) {
+				if (value) word[n / 64] |= (1ULL << (n % 64));
+				else word[n / 64] &= ~(1ULL << (n % 64));
+			};
+			for (uint32_t at = maximal[r]; at != 0; at = graph.parent[at]) {
+				mark(at, true);
 			}
+			mark(0, true);
+
+			uint8_t *row = overlaps.get() + size_t(r) * size;
 			for (uint32_t c = 0; c < size; ++c) {
-				//uint32_t a, b;
-				//{
-				//prefix way:
-					uint32_t over = 0;
-					uint32_t at = maximal[c];
-					while (!word[at]) {
-						at = graph.rewind[at];
-					}
-					while (at != 0) {
-						at = graph.parent[at];
-						++over;
-					}
-					//a = over;
-				//}
-				/*{
-					//slow way:
-					uint32_t over = std::min(words[r].size(), words[c].size());
-					while (over > 0 && words[c].substr(words[c].size()-over, over) != words[r].substr(0, over)) --over;
-					b = over;
-					a = b;
-				}*/
-				/*if (a != b) {
-					std::cout << words[c] << " to " << words[r] << " " << a << " vs " << b << std::endl;
-				}*/
-				overlaps[r * size + c] = over;
+				//longest suffix of c that's a prefix of r:
+				uint32_t at = maximal[c];
+				while (!(word[at / 64] & (1ULL << (at % 64)))) {
+					at = graph.rewind[at];
+				}
+				row[c] = graph.depth[at];
 			}
-			if ((r+1) % 1000 == 0) {
-				std::cout << r + 1 << " of " << size << std::endl;
-				stopwatch("1k overlaps");
+
+			for (uint32_t at = maximal[r]; at != 0; at = graph.parent[at]) {
+				mark(at, false);
 			}
-		}
+			uint32_t done = ++finished;
+			if (done % 1000 == 0) {
+				std::cout << (std::to_string(done) + " of " + std::to_string(size) + "\n") << std::flush;
+			}
+		});
 		stopwatch("fin");
 		std::ofstream out("overlaps.table");
-		out.write(reinterpret_cast< char * >(overlaps.get()), size * size);
+		out.write(reinterpret_cast< const char * >(&graph_hash), 8);
+		out.write(reinterpret_cast< const char * >(&size), 4);
+		out.write(reinterpret_cast< char * >(overlaps.get()), size_t(size) * size);
 		stopwatch("write");
 	}
 
-	std::vector< bool > sel(256, false);
-	{
-		for (uint32_t i = 0; i < size; ++i) {
-			overlaps[i * size + i] = 0;
-		}
-		stopwatch("diag");
-		std::cout << "Self-edges discouraged." << std::endl;
-
-		uint8_t *start = overlaps.get();
-		uint8_t *end = overlaps.get() + size * size;
-
-		for (uint8_t *o = start; o != end; ++o) {
-			sel[*o] = true;
-		}
-		stopwatch("Selected distances.");
-
+	for (uint32_t i = 0; i < size; ++i) {
+		overlaps[size_t(i) * size + i] = 0;
 	}
+	stopwatch("diag");
+	std::cout << "Self-edges discouraged." << std::endl;
 
-	//------------------------------------------
+	GreedyAssignment greedy(size, overlaps.get());
+	greedy.count();
+	stopwatch("count overlaps");
 
-	std::vector< bool > r_assigned(size, false), c_assigned(size, false);
+	//------------------------------------------
 
-	uint32_t total = 0;
+	uint64_t total = 0;
 	for (uint32_t o = 0xff; o != 0; --o) {
-		if (!sel[o]) continue;
-		uint32_t assignments = 0;
-		for (uint32_t r = 0; r < size; ++r) {
-			if (r_assigned[r]) continue;
-			for (uint32_t c = 0; c < size; ++c) {
-				if (c_assigned[c]) continue;
-				assert(overlaps[r * size + c] <= o);
-				if (overlaps[r * size + c] == o) {
-					++assignments;
-					total += overlaps[r * size + c];
-					c_assigned[c] = true;
-					r_assigned[r] = true;
-					break;
-				}
-			}
-		}
+		if (!greedy.present(o)) continue;
+		uint32_t assignments = greedy.assign(o, total);
 		std::cout << "After " << assignments << " assignments at overlap '" << (int)o << "', total is " << total << " (bound: " << total_words_length - total << ")" << std::endl;
 	}
+	stopwatch("greedy");
 	return 0;
 	
 }
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+
+#include "parallel.hpp"
+
+//Greedy assignment over a size x size table of small values, as done by greedy-bound
+// (largest overlap first) and greedy-bound-distance (smallest distance first):
+// for each value in turn, every still-unassigned row (in order) takes the first
+// still-unassigned column (in order) holding that value -- or, with take_all,
+// every such column.
+//
+//Instead of sweeping the whole table once per value, one parallel pass counts
+// each row's values; after that, a value only visits the unassigned rows that
+// hold it, and only looks at columns that were unassigned when the value started.
+// Candidate columns for those rows are gathered in parallel (up to Prefetch per
+// row), and the sequential part just checks them against what earlier rows took,
+// scanning on past them only if it runs out. Results are identical to the sweeps.
+//
+//That skips rows without the value and columns already gone, but each visited row
+// still scans its open columns for the value, so the worst case is the sweeps':
+// O(size^2) per value, O(values * size^2) in all (e.g. when most rows hold every
+// value, and only late in the row). Per-row buckets of columns by value would avoid
+// the rescans, but would take four times the table's memory.
+
+class GreedyAssignment {
+public:
+	GreedyAssignment(uint32_t size_, uint8_t const *table_) : size(size_), table(table_) { }
+
+	uint32_t size;
+	uint8_t const *table;
+
+	bool take_all = false; //rows take every matching column, not just the first
+	bool skip_diagonal = false; //never assign r to r
+	uint32_t threads = thread_count();
+
+	std::vector< bool > r_assigned, c_assigned;
+
+	//counts[r * 256 + v] = number of columns c in row r with table[r][c] == v:
+	std::vector< uint32_t > counts;
+
+	//is the value anywhere in the table?
+	bool present(uint8_t v) const { return present_values[v]; }
+
+	void count() {
+		counts.assign(size_t(size) * 256, 0);
+		const uint32_t Block = 64;
+		parallel_for((size + Block - 1) / Block, [&](uint32_t block, uint32_t) {
+			for (uint32_t r = block * Block; r < size && r < (block + 1) * Block; ++r) {
+				uint32_t *row_counts = &counts[size_t(r) * 256];
+				uint8_t const *row = table + size_t(r) * size;
+				for (uint32_t c = 0; c < size; ++c) {
+					if (skip_diagonal && c == r) continue;
+					++row_counts[row[c]];
+				}
+			}
+		}, threads);
+		present_values.assign(256, false);
+		for (uint32_t r = 0; r < size; ++r) {
+			for (uint32_t v = 0; v < 256; ++v) {
+				if (counts[size_t(r) * 256 + v]) present_values[v] = true;
+			}
+		}
+		r_assigned.assign(size, false);
+		c_assigned.assign(size, false);
+		open_columns.clear();
+		for (uint32_t c = 0; c < size; ++c) {
+			open_columns.emplace_back(c);
+		}
+	}
+
+	//do all the assignments for one value; returns how many were made (and adds to 'total'):
+	uint32_t assign(uint8_t v, uint64_t &total) {
+		assert(counts.size() == size_t(size) * 256);
+
+		//columns taken by earlier values are gone for good:
+		open_columns.erase(std::remove_if(open_columns.begin(), open_columns.end(), [&](uint32_t c) {
+			return bool(c_assigned[c]);
+		}), open_columns.end());
+
+		rows.clear();
+		for (uint32_t r = 0; r < size; ++r) {
+			if (!r_assigned[r] && counts[size_t(r) * 256 + v]) rows.emplace_back(r);
+		}
+
+		//gather the first few candidate columns for every row in parallel:
+		candidates.resize(size_t(rows.size()) * Prefetch);
+		candidate_count.resize(rows.size());
+		resume.resize(rows.size());
+		const uint32_t Block = 16;
+		parallel_for((rows.size() + Block - 1) / Block, [&](uint32_t block, uint32_t) {
+			for (uint32_t i = block * Block; i < rows.size() && i < (block + 1) * Block; ++i) {
+				uint32_t r = rows[i];
+				uint8_t const *row = table + size_t(r) * size;
+				uint32_t *out = &candidates[size_t(i) * Prefetch];
+				uint32_t found = 0;
+				uint32_t o = 0;
+				for (; o < open_columns.size() && found < Prefetch; ++o) {
+					uint32_t c = open_columns[o];
+					if (row[c] == v && !(skip_diagonal && c == r)) out[found++] = c;
+				}
+				candidate_count[i] = found;
+				resume[i] = o;
+			}
+		}, threads);
+
+		//then hand out columns in row order:
+		uint32_t assignments = 0;
+		for (uint32_t i = 0; i < rows.size(); ++i) {
+			uint32_t r = rows[i];
+			uint32_t const *in = &candidates[size_t(i) * Prefetch];
+			bool took = false;
+			auto consider = [&](uint32_t c) {
+				if (c_assigned[c]) return;
+				c_assigned[c] = true;
+				total += v;
+				++assignments;
+				took = true;
+			};
+			for (uint32_t j = 0; j < candidate_count[i] && (take_all || !took); ++j) {
+				consider(in[j]);
+			}
+			if (candidate_count[i] == Prefetch) {
+				uint8_t const *row = table + size_t(r) * size;
+				for (uint32_t o = resume[i]; o < open_columns.size() && (take_all || !took); ++o) {
+					uint32_t c = open_columns[o];
+					if (row[c] == v && !(skip_diagonal && c == r)) consider(c);
+				}
+			}
+			if (took) r_assigned[r] = true;
+		}
+		return assignments;
+	}
+
+private:
+	enum : uint32_t { Prefetch = 16 };
+	std::vector< bool > present_values;
+	std::vector< uint32_t > open_columns;
+	std::vector< uint32_t > rows;
+	std::vector< uint32_t > candidates;
+	std::vector< uint32_t > candidate_count;
+	std::vector< uint32_t > resume;
+};
@@ -0,0 +1,331 @@
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+#include "graph.hpp"
+#include "stopwatch.hpp"
+#include "parallel.hpp"
+#include "distances.hpp"
+#include "arborescence.hpp"
+
+//Held-Karp style Lagrangian bound for the asymmetric instance in distances.table:
+// a portmantout is a tour start -> ... -> start (closing back into start is free),
+// which is a spanning arborescence rooted at start plus one arc into start, with
+// every out-degree == 1. Relaxing the out-degree constraints with penalties pi:
+//   L(pi) = min arborescence under (distance(i,j) + pi[i]) + min_i pi[i] - sum_i pi[i]
+// is a lower bound for any pi; subgradient ascent on pi pushes it up.
+//
+//Arborescences are computed over sparse candidate arcs (each word's cheapest
+// successors), which by itself only bounds the *sparse* instance. So each round
+// starts by checking the arborescence's duals against every arc of the full
+// (mmap'd) table: the worst offenders become candidates and it is re-solved, and
+// whatever arcs still undercut the duals by comes off the bound, which makes it
+// certified for the full instance. Then a few subgradient steps run over the
+// candidates; if they led somewhere worse, the next round goes back with smaller steps.
+
+struct {
+	uint32_t threads = thread_count();
+	uint32_t k = 8; //cheapest out-arcs per word to start with
+	uint32_t add = 8; //most arcs added into a word per round
+	uint32_t rounds = 40; //full-table pricing / subgradient rounds
+	uint32_t passes = 4; //most pricing passes per round
+	uint32_t iterations = 10; //subgradient steps per round
+	double upper = 0.0; //length of a known portmantout (letters), for step sizes; 0 == guess
+	std::string duals = ""; //match-auction duals-*.dump to start from
+	void describe() {
+		std::cout << "Options:\n";
+		std::cout << "\tThreads: " << threads << "\n";
+		std::cout << "\tInitial candidates per word: " << k << "\n";
+		std::cout << "\tCandidates added per word per round: " << add << "\n";
+		std::cout << "\tRounds: " << rounds << " of up to " << passes << " pricing passes and " << iterations << " iterations\n";
+		std::cout << "\tUpper bound: " << (upper > 0.0 ? std::to_string(upper) : "guess") << "\n";
+		std::cout << "\tStarting duals: " << (duals.empty() ? "none" : duals) << "\n";
+	}
+} options;
+
+int main(int argc, char **argv) {
+
+	for (int a = 1; a < argc; ++a) {
+		std::string arg = argv[a];
+		std::string tag;
+		std::string value;
+		auto pos = arg.find(':');
+		tag = arg.substr(0, pos+1);
+		value = arg.substr(pos+1);
+		if (tag == "threads:") {
+			options.threads = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "k:") {
+			options.k = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "add:") {
+			options.add = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "rounds:") {
+			options.rounds = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "passes:") {
+			options.passes = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "iterations:") {
+			options.iterations = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "upper:") {
+			options.upper = std::atof(value.c_str());
+		} else if (tag == "duals:") {
+			options.duals = value;
+		} else {
+			std::cerr << "Unknown tag '" << tag << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	options.describe();
+
+	stopwatch("start");
+	Graph graph;
+	if (!graph.read("wordlist.graph")) {
+		std::cerr << "Failed to read graph." << std::endl;
+		exit(1);
+	}
+	stopwatch("read graph");
+
+	std::vector< uint32_t > maximal;
+
+	for (auto m = graph.maximal; m != graph.maximal + graph.nodes; ++m) {
+		if (*m) {
+			maximal.emplace_back(m - graph.maximal);
+		}
+	}
+	std::cout << "Have " << maximal.size() << " maximal nodes." << std::endl;
+	const uint32_t size = maximal.size();
+
+	//the portmantout has to start with this word:
+	std::string start_word;
+	const uint32_t start = find_start(graph, maximal, &start_word);
+	if (start == -1U) {
+		std::cerr << "No word starting with 'portmanteau' to start from." << std::endl;
+		return 1;
+	}
+	const uint32_t start_len = start_word.size();
+	std::cout << "Starting with: " << start_word << std::endl;
+
+	Distances distances;
+	if (!distances.map("distances.table", size)) {
+		std::cerr << "failed to map distance table." << std::endl;
+		return 1;
+	}
+
+	stopwatch("map distances");
+
+	//------------------------------------------
+
+	std::vector< double > pi(size, 0.0);
+
+	if (options.duals != "") {
+		//match-auction's column prices p (in units of 1 / (size + 1)) give row duals
+		// u[r] = min_c (weight(r,c) + p[c]); pi = -u starts at least as high as that bound:
+		std::vector< int64_t > price(size);
+		std::ifstream in(options.duals);
+		if (!in.read(reinterpret_cast< char * >(&price[0]), sizeof(int64_t) * size)) {
+			std::cerr << "failed to read duals from '" << options.duals << "'." << std::endl;
+			return 1;
+		}
+		const int64_t scale = int64_t(size) + 1;
+		BoundRows rows(distances, start, 0xff);
+		parallel_for(size, [&](uint32_t r, uint32_t) {
+			int64_t min = std::numeric_limits< int64_t >::max();
+			for (uint32_t c = 0; c < size; ++c) {
+				if (c == r) continue;
+				min = std::min(min, int64_t(rows.weight(r, c)) * scale + price[c]);
+			}
+			pi[r] = -double(min) / double(scale);
+		}, options.threads);
+		stopwatch("read duals");
+	}
+
+	//candidate arcs: each word's k cheapest successors, plus the (r -> r+1) cycle so
+	// that everything is reachable from start:
+	std::vector< Arborescence::Arc > arcs;
+	{
+		std::vector< std::vector< uint32_t > > out(size);
+		parallel_for(size, [&](uint32_t r, uint32_t) {
+			uint8_t const *row = distances.row(r);
+			std::vector< std::pair< uint8_t, uint32_t > > cheap;
+			for (uint32_t c = 0; c < size; ++c) {
+				if (c == r || c == start) continue;
+				cheap.emplace_back(row[c], c);
+			}
+			uint32_t k = std::min< uint32_t >(options.k, cheap.size());
+			std::nth_element(cheap.begin(), cheap.begin() + k, cheap.end());
+			uint32_t next = (r + 1) % size;
+			bool have_next = (next == start);
+			for (uint32_t i = 0; i < k; ++i) {
+				out[r].emplace_back(cheap[i].second);
+				if (cheap[i].second == next) have_next = true;
+			}
+			if (!have_next) out[r].emplace_back(next);
+		}, options.threads);
+		for (uint32_t r = 0; r < size; ++r) {
+			for (auto c : out[r]) {
+				arcs.push_back(Arborescence::Arc{r, c, double(distances(r, c))});
+			}
+		}
+	}
+	std::cout << "Starting with " << arcs.size() << " candidate arcs." << std::endl;
+	stopwatch("candidates");
+
+	Arborescence arborescence;
+	std::vector< Arborescence::Arc > weighted;
+
+	//L(pi), computing the arborescence (and duals) as a side effect:
+	auto evaluate = [&](std::vector< double > const &pi) -> double {
+		weighted = arcs;
+		for (auto &a : weighted) {
+			a.weight += pi[a.from];
+		}
+		bool ok = arborescence.solve(size, start, weighted);
+		assert(ok);
+		double min_pi = std::numeric_limits< double >::infinity();
+		double sum_pi = 0.0;
+		for (uint32_t i = 0; i < size; ++i) {
+			sum_pi += pi[i];
+			if (i != start) min_pi = std::min(min_pi, pi[i]);
+		}
+		return arborescence.cost + min_pi - sum_pi;
+	};
+
+	//check the current arborescence's duals against every arc of the full table; returns the
+	// total by which they are undercut (lowering each column's own dual by its worst
+	// undercut keeps the duals feasible for every arc -- singleton duals may go negative
+	// since in-degree is exactly one) and adds the worst few arcs into each column:
+	struct Under {
+		double by;
+		uint32_t from;
+	};
+	const uint32_t add = options.add;
+	std::vector< std::vector< Under > > thread_under(options.threads);
+	std::vector< std::vector< uint32_t > > thread_marks(options.threads);
+	std::vector< uint32_t > thread_stamp(options.threads, 0);
+	std::vector< double > prefix;
+	std::vector< Under > merged;
+	auto price = [&](std::vector< double > const &pi, uint32_t &added) -> double {
+		arborescence.dual_prefix(prefix);
+		for (auto &marks : thread_marks) marks.clear();
+		parallel_for(size, [&](uint32_t r, uint32_t thread) {
+			auto &marks = thread_marks[thread];
+			auto &under = thread_under[thread];
+			if (marks.empty()) {
+				marks.assign(arborescence.dual.size(), 0);
+				under.assign(size_t(size) * add, Under{0.0, -1U});
+			}
+			uint32_t stamp = ++thread_stamp[thread];
+			arborescence.mark_ancestors(r, marks, stamp);
+			uint8_t const *row = distances.row(r);
+			for (uint32_t c = 0; c < size; ++c) {
+				if (c == r || c == start) continue;
+				Under *list = &under[size_t(c) * add];
+				double w = row[c] + pi[r];
+				if (w >= prefix[c] - list[add-1].by) continue; //can't make the list
+				double by = arborescence.enters(c, marks, stamp, prefix) - w;
+				if (by <= list[add-1].by) continue;
+				uint32_t i = add - 1;
+				while (i > 0 && list[i-1].by < by) {
+					list[i] = list[i-1];
+					--i;
+				}
+				list[i] = Under{by, r};
+			}
+		}, options.threads);
+
+		double total = 0.0;
+		added = 0;
+		for (uint32_t c = 0; c < size; ++c) {
+			merged.clear();
+			for (uint32_t t = 0; t < options.threads; ++t) {
+				if (thread_under[t].empty()) continue;
+				Under const *list = &thread_under[t][size_t(c) * add];
+				for (uint32_t i = 0; i < add && list[i].from != -1U; ++i) {
+					merged.emplace_back(list[i]);
+				}
+			}
+			std::sort(merged.begin(), merged.end(), [](Under const &a, Under const &b) { return a.by > b.by; });
+			if (merged.empty() || merged[0].by <= 1e-9) continue;
+			total += merged[0].by;
+			for (uint32_t i = 0; i < merged.size() && i < add; ++i) {
+				arcs.push_back(Arborescence::Arc{merged[i].from, c, double(distances(merged[i].from, c))});
+				++added;
+			}
+		}
+		for (auto &under : thread_under) {
+			std::fill(under.begin(), under.end(), Under{0.0, -1U});
+		}
+		return total;
+	};
+
+	double certified = -std::numeric_limits< double >::infinity();
+	std::vector< double > certified_pi = pi;
+	double lambda = 1.0;
+
+	for (uint32_t round = 1; round <= options.rounds; ++round) {
+		//-- price the current penalties against the full table until the candidates suffice --
+		double value = 0.0;
+		double under = 0.0;
+		uint32_t added = 0;
+		uint32_t total_added = 0;
+		for (uint32_t pass = 0; pass < options.passes; ++pass) {
+			value = evaluate(pi);
+			under = price(pi, added);
+			total_added += added;
+			if (added == 0) break;
+		}
+		double round_certified = value - under;
+		std::cout << "Round " << round << ": " << total_added << " arcs added (" << arcs.size() << " candidates); certified "
+			<< round_certified << " (" << start_len + round_certified << " letters)";
+		if (round_certified > certified) {
+			certified = round_certified;
+			certified_pi = pi;
+		} else {
+			//the steps over the candidates went somewhere worse; go back with smaller steps:
+			pi = certified_pi;
+			lambda *= 0.5;
+			std::cout << ", step scale now " << lambda;
+		}
+		std::cout << "." << std::endl;
+		if (under <= 1e-9 && total_added == 0 && round > 1 && lambda < 1e-3) break;
+
+		//-- subgradient ascent over the candidate arcs --
+		double best = -std::numeric_limits< double >::infinity();
+		std::vector< double > best_pi = pi;
+		for (uint32_t iter = 0; iter < options.iterations; ++iter) {
+			double value = evaluate(pi);
+			if (value > best) {
+				best = value;
+				best_pi = pi;
+			}
+
+			//subgradient: out-degree (the closing arc leaves from the smallest penalty) minus one:
+			std::vector< int32_t > g(size, -1);
+			for (uint32_t j = 0; j < size; ++j) {
+				if (arborescence.in_arc[j] != Arborescence::None) g[weighted[arborescence.in_arc[j]].from] += 1;
+			}
+			uint32_t closer = (start == 0 ? 1 : 0);
+			for (uint32_t i = 0; i < size; ++i) {
+				if (i != start && pi[i] < pi[closer]) closer = i;
+			}
+			g[closer] += 1;
+			double norm = 0.0;
+			for (auto x : g) norm += double(x) * double(x);
+			if (norm == 0.0) {
+				std::cout << "  (subgradient is zero: the arborescence is a tour)" << std::endl;
+				break;
+			}
+			double target = (options.upper > 0.0 ? options.upper - start_len : best + 0.01 * std::abs(best) + 1.0);
+			double step = lambda * std::max(target - value, 1.0) / norm;
+			for (uint32_t i = 0; i < size; ++i) {
+				pi[i] += step * g[i];
+			}
+		}
+		pi = best_pi;
+		stopwatch("round");
+	}
+
+	std::cout << "Certified lower bound: " << start_len + std::ceil(certified - 1e-6) << " letters"
+		<< " (Lagrangian value " << start_len + certified << ")." << std::endl;
+
+	return 0;
+}
@@ -1,104 +1,261 @@
 #pragma once
 
-#include <string.h>
+#include <vector>
+#include <limits>
+#include <iostream>
+#include <cstdint>
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
 
-#include "stopwatch.hpp"
+//Min-cost perfect assignment of rows to columns (primal-dual / hungarian):
+// augmenting paths are only ever taken along tight edges, and when those run
+// out, a Dijkstra over reduced costs says how far to shift the potentials.
+//Weights are small (uint8_t) non-negative integers, so the Dijkstra uses a
+// bucket queue instead of a heap.
+//Scratch space is O(size) on top of whatever the rows adaptor holds.
 
-void min_assignment(uint32_t size, uint8_t const *weights) {
-	std::unique_ptr< uint8_t[] > row_potential(new uint8_t[size]);
-	std::unique_ptr< uint8_t[] > column_potential(new uint8_t[size]);
+//Solvers read weights through a 'rows' adaptor that provides:
+//  uint32_t size() -- number of rows (== number of columns)
+//  uint32_t begin(r), end(r) -- range of edge indices for row r
+//  uint32_t column(r, e), uint8_t weight(r, e) -- edge e of row r
 
-	std::unique_ptr< uint8_t[] > residual(new uint8_t[size * size]);
+//all size x size weights, row-major:
+class DenseRows {
+public:
+	DenseRows(uint32_t size_, uint8_t const *weights_) : count(size_), weights(weights_) { }
+	uint32_t size() const { return count; }
+	uint32_t begin(uint32_t r) const { return 0; }
+	uint32_t end(uint32_t r) const { return count; }
+	uint32_t column(uint32_t r, uint32_t e) const { return e; }
+	uint8_t weight(uint32_t r, uint32_t e) const { return weights[size_t(r) * count + e]; }
 
-	//initialize potentials with a sweep:
-	for (uint32_t c = 0; c < size; ++c) {
-		column_potential[c] = 0xff;
+	uint32_t count;
+	uint8_t const *weights;
+};
+
+//only some edges, stored row-by-row:
+class SparseRows {
+public:
+	SparseRows() : start(1, 0) { }
+	uint32_t size() const { return start.size() - 1; }
+	uint32_t begin(uint32_t r) const { return start[r]; }
+	uint32_t end(uint32_t r) const { return start[r+1]; }
+	uint32_t column(uint32_t r, uint32_t e) const { return columns[e]; }
+	uint8_t weight(uint32_t r, uint32_t e) const { return weights[e]; }
+
+	//build by calling add() for each edge of a row, then finish_row():
+	void add(uint32_t c, uint8_t w) {
+		columns.emplace_back(c);
+		weights.emplace_back(w);
 	}
-	for (uint32_t r = 0; r < size; ++r) {
-		uint8_t min = 0xff;
-		for (uint32_t c = 0; c < size; ++c) {
-			min = std::min(min, weights[r * size + c]);
-		}
-		row_potential[r] = min;
-		for (uint32_t c = 0; c < size; ++c) {
-			assert(weights[r * size + c] >= min);
-			uint8_t res = weights[r * size + c] - min;
-			residual[r * size + c] = res;
-			column_potential[c] = std::min(column_potential[c], res);
-		}
+	void finish_row() {
+		start.emplace_back(columns.size());
 	}
-	for (uint32_t r = 0; r < size; ++r) {
-		for (uint32_t c = 0; c < size; ++c) {
-			assert(residual[r * size + c] >= column_potential[c]);
-			residual[r * size + c] -= column_potential[c];
-		}
+
+	std::vector< uint32_t > start;
+	std::vector< uint32_t > columns;
+	std::vector< uint8_t > weights;
+};
+
+class Assignment {
+public:
+	enum : uint32_t { None = -1U };
+
+	std::vector< uint32_t > row_to_column;
+	std::vector< uint32_t > column_to_row;
+
+	//potentials satisfy row_potential[r] + column_potential[c] <= weight(r,c) for every edge:
+	std::vector< int32_t > row_potential;
+	std::vector< int32_t > column_potential;
+
+	uint64_t cost = 0;
+
+	//print progress every this many phases (0 == quiet):
+	uint32_t report_every = 0;
+
+	//sum of potentials -- a lower bound on the cost of any assignment at every point
+	// during solve() (and equal to 'cost' once solved):
+	int64_t dual() const {
+		int64_t sum = 0;
+		for (auto p : row_potential) sum += p;
+		for (auto p : column_potential) sum += p;
+		return sum;
 	}
-	auto check_potential = [&]() -> bool {
-		uint64_t tight = 0;
-		uint64_t error = 0;
+
+	//returns false if there is no perfect assignment using the given edges:
+	template< typename Rows >
+	bool solve(Rows const &rows) {
+		const uint32_t size = rows.size();
+		const int32_t Infinity = std::numeric_limits< int32_t >::max();
+
+		row_to_column.assign(size, None);
+		column_to_row.assign(size, None);
+		cost = 0;
+
+		//initial potentials from row minimums, then column minimums of what's left:
+		row_potential.assign(size, 0);
+		column_potential.assign(size, Infinity);
 		for (uint32_t r = 0; r < size; ++r) {
-			for (uint32_t c = 0; c < size; ++c) {
-				uint32_t sum = uint32_t(row_potential[r]) + uint32_t(column_potential[c]);
-				uint32_t weight = weights[r * size + c];
-				if (sum == weight) ++tight;
-				if (sum > weight) ++error;
+			if (rows.begin(r) == rows.end(r)) return false;
+			uint8_t min = 0xff;
+			for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+				min = std::min(min, rows.weight(r, e));
 			}
+			row_potential[r] = min;
 		}
-		std::cout << "Have " << tight << " tight edges (" << 100.0 * tight / double(size * size) << "%) and " << error << " edges that are errors." << std::endl;
-		return error == 0;
-	};
-	auto potential_sum = [&]() -> uint32_t {
-		uint32_t sum = 0;
-		for (uint32_t i = 0; i < size; ++i) {
-			sum += row_potential[i];
-			sum += column_potential[i];
+		for (uint32_t r = 0; r < size; ++r) {
+			for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+				int32_t &v = column_potential[rows.column(r, e)];
+				v = std::min(v, int32_t(rows.weight(r, e)) - row_potential[r]);
+			}
+		}
+		for (auto v : column_potential) {
+			if (v == Infinity) return false;
 		}
-		return sum;
-	};
 
-	std::cout << "After initialization, potential sum is " << potential_sum() << std::endl;
-	if (!check_potential()) exit(1);
+		//Each phase: augment along as many vertex-disjoint tight paths as possible,
+		// then run one Dijkstra from all free rows at once and shift potentials
+		// so that the shortest augmenting paths become tight.
+		uint32_t matched = 0;
+		uint32_t round = 0;
+		std::vector< uint32_t > row_round(size, 0), column_round(size, 0);
+		std::vector< uint32_t > cursor(size); //next edge to look at for each row this round
+		std::vector< uint32_t > path_rows, path_columns;
 
-	stopwatch("init");
+		std::vector< int32_t > dist(size, Infinity);
+		std::vector< bool > done(size, false);
+		std::vector< uint32_t > touched; //columns with dist set
+		std::vector< uint32_t > finished; //matched columns popped before the free one
+		std::vector< std::vector< uint32_t > > buckets; //columns by tentative distance (with stale entries)
 
-	{ //find a maximum matching over only tight edges:
-		std::vector< std::vector< uint16_t > > rc(size);
-		const uint16_t NoIndex = 0xffff;
-		std::vector< uint16_t > cr(size, NoIndex);
-		//rc edges are not in the matching, cr edges are in the matching
-		for (uint32_t r = 0; r < size; ++r) {
-			for (uint32_t c = 0; c < size; ++c) {
-				if (row_potential[r] + column_potential[c] == weights[r * size + c]) {
-					rc[r].emplace_back(c);
+		for (uint32_t phase = 1; ; ++phase) {
+			//-- augment over tight edges (Kuhn's algorithm with per-round visited marks and row cursors) --
+			++round;
+			for (uint32_t s = 0; s < size; ++s) {
+				if (row_to_column[s] != None) continue;
+				auto enter = [&](uint32_t r) {
+					assert(row_round[r] != round);
+					row_round[r] = round;
+					cursor[r] = rows.begin(r);
+					path_rows.emplace_back(r);
+				};
+				enter(s);
+				while (!path_rows.empty()) {
+					uint32_t r = path_rows.back();
+					uint32_t found = None;
+					while (cursor[r] != rows.end(r)) {
+						uint32_t e = cursor[r]++;
+						uint32_t c = rows.column(r, e);
+						if (int32_t(rows.weight(r, e)) != row_potential[r] + column_potential[c]) continue;
+						if (column_round[c] == round) continue;
+						column_round[c] = round;
+						found = c;
+						break;
+					}
+					if (found == None) {
+						path_rows.pop_back();
+						if (!path_columns.empty()) path_columns.pop_back();
+					} else if (column_to_row[found] == None) {
+						path_columns.emplace_back(found);
+						assert(path_columns.size() == path_rows.size());
+						for (uint32_t i = 0; i < path_rows.size(); ++i) {
+							row_to_column[path_rows[i]] = path_columns[i];
+							column_to_row[path_columns[i]] = path_rows[i];
+						}
+						++matched;
+						break;
+					} else {
+						path_columns.emplace_back(found);
+						enter(column_to_row[found]);
+					}
 				}
+				path_rows.clear();
+				path_columns.clear();
 			}
-		}
-		stopwatch("edges");
-		std::vector< bool > r_matched(size, false), c_matched(size, false);
-		for (uint32_t c = 0; c < size; ++c) {
-			if (cr[c] != NoIndex) {
-				c_matched[c] = true;
-				r_matched[rc[c]] = true;
+
+			if (report_every && (phase == 1 || phase % report_every == 0 || matched == size)) {
+				std::cout << "  phase " << phase << ": " << matched << " of " << size << " matched; dual is " << dual() << "." << std::endl;
+			}
+			if (matched == size) break;
+
+			//-- multi-source Dijkstra over reduced costs, stopping at the first free column --
+			auto relax = [&](uint32_t r, int32_t base) {
+				for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+					uint32_t c = rows.column(r, e);
+					int32_t reduced = int32_t(rows.weight(r, e)) - row_potential[r] - column_potential[c];
+					assert(reduced >= 0);
+					int32_t d = base + reduced;
+					if (d < dist[c] && !done[c]) {
+						if (dist[c] == Infinity) touched.emplace_back(c);
+						dist[c] = d;
+						if (uint32_t(d) >= buckets.size()) buckets.resize(d + 1);
+						buckets[d].emplace_back(c);
+					}
+				}
+			};
+
+			for (uint32_t s = 0; s < size; ++s) {
+				if (row_to_column[s] == None) relax(s, 0);
+			}
+			int32_t end_dist = -1;
+			for (uint32_t b = 0; b < buckets.size() && end_dist < 0; ++b) {
+				//n.b. relaxing along tight edges appends to this bucket while it is being walked:
+				for (uint32_t i = 0; i < buckets[b].size(); ++i) {
+					uint32_t c = buckets[b][i];
+					if (done[c] || dist[c] != int32_t(b)) continue;
+					done[c] = true;
+					if (column_to_row[c] == None) {
+						end_dist = b;
+						break;
+					}
+					finished.emplace_back(c);
+					relax(column_to_row[c], b);
+				}
+			}
+			for (auto &bucket : buckets) {
+				bucket.clear();
 			}
+
+			if (end_dist < 0) return false;
+
+			//shift potentials so the shortest paths are tight and everything else stays feasible:
+			for (uint32_t s = 0; s < size; ++s) {
+				if (row_to_column[s] == None) row_potential[s] += end_dist;
+			}
+			for (auto c : finished) {
+				int32_t delta = end_dist - dist[c];
+				column_potential[c] -= delta;
+				row_potential[column_to_row[c]] += delta;
+			}
+
+			for (auto c : touched) {
+				dist[c] = Infinity;
+				done[c] = false;
+			}
+			touched.clear();
+			finished.clear();
 		}
-		std::vector< uint32_t > r_from(size, NoIndex);
-		std::vector< uint32_t > c_from(size, NoIndex);
-		std::vector< uint32_t > r_to_expand;
+
 		for (uint32_t r = 0; r < size; ++r) {
-			if (r_matched[r]) continue;
-			r_from[r] = r;
-			r_to_expand.emplace_back(r);
-		}
-		while (!r_to_expand.empty()) {
-			std::vector< uint32_t > next_r_to_expand;
-			for (auto r : r_to_expand) {
-				for (auto c : rc[r]) {
-					if (
-					//... etc ...
+			for (uint32_t e = rows.begin(r); e != rows.end(r); ++e) {
+				if (rows.column(r, e) == row_to_column[r]) {
+					assert(int32_t(rows.weight(r, e)) == row_potential[r] + column_potential[row_to_column[r]]);
+					cost += rows.weight(r, e);
+					break;
 				}
 			}
 		}
-	}
+		assert(int64_t(cost) == dual());
 
+		return true;
+	}
+};
 
+//convenience wrapper for a full size x size weight table:
+inline Assignment min_assignment(uint32_t size, uint8_t const *weights) {
+	Assignment assignment;
+	bool solved = assignment.solve(DenseRows(size, weights));
+	assert(solved);
+	return assignment;
 }
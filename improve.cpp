@@ -7,9 +7,50 @@
 
 #include "graph.hpp"
 #include "stopwatch.hpp"
+#include "parallel.hpp"
+#include "distances.hpp"
+#include "local-search.hpp"
+#include "anneal.hpp"
 
 struct {
+	std::string mode = "local"; //"lk", "anneal"
+	std::string resume = ""; //start from this improved-*.dump instead of a portmantout on stdin
+	uint32_t threads = thread_count();
+	uint32_t k = 10; //neighbor list length
+	uint32_t segment = 3; //longest Or-opt segment
+	//"lk" mode:
+	uint32_t depth = 5; //longest chain of moves
+	uint32_t trials = 1000; //kicks per thread
+	uint32_t kick = 30; //longest kicked segment
+	uint32_t seed = 0x12345678;
+	//"anneal" mode:
+	uint32_t replicas = thread_count();
+	double hot = 0.4; //temperatures (in letters) of the hottest and coldest replicas
+	double cold = 0.1;
+	uint32_t steps = 100000; //proposals per replica between exchanges
+	double seconds = 60.0; //how long to run
+	double checkpoint = 300.0; //seconds between writing the best path so far
 	void describe() {
+		std::cout << "Options:\n";
+		std::cout << "\tMode: " << mode << "\n";
+		std::cout << "\tResume: " << (resume.empty() ? "no (portmantout on stdin)" : resume) << "\n";
+		std::cout << "\tThreads: " << threads << "\n";
+		std::cout << "\tNeighbors: " << k << "\n";
+		std::cout << "\tOr-opt segment: " << segment << "\n";
+		if (mode == "lk") {
+			std::cout << "\tChain depth: " << depth << "\n";
+			std::cout << "\tTrials: " << trials << " per thread\n";
+			std::cout << "\tKick segment: " << kick << "\n";
+		}
+		if (mode == "anneal") {
+			std::cout << "\tReplicas: " << replicas << "\n";
+			std::cout << "\tTemperatures: " << hot << " down to " << cold << "\n";
+			std::cout << "\tSteps between exchanges: " << steps << "\n";
+			std::cout << "\tRun for: " << seconds << "s, checkpoint every " << checkpoint << "s\n";
+		}
+		if (mode != "local") {
+			std::cout << "\tSeed: " << seed << "\n";
+		}
 	}
 } options;
 
@@ -22,12 +63,47 @@ int main(int argc, char **argv) {
 		auto pos = arg.find(':');
 		tag = arg.substr(0, pos+1);
 		value = arg.substr(pos+1);
-		{
+		if (tag == "mode:") {
+			options.mode = value;
+		} else if (tag == "threads:") {
+			options.threads = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "k:") {
+			options.k = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "segment:") {
+			options.segment = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "depth:") {
+			options.depth = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "trials:") {
+			options.trials = std::max(0, std::atoi(value.c_str()));
+		} else if (tag == "kick:") {
+			options.kick = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "seed:") {
+			options.seed = std::atoi(value.c_str());
+		} else if (tag == "resume:") {
+			options.resume = value;
+		} else if (tag == "replicas:") {
+			options.replicas = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "hot:") {
+			options.hot = std::atof(value.c_str());
+		} else if (tag == "cold:") {
+			options.cold = std::atof(value.c_str());
+		} else if (tag == "steps:") {
+			options.steps = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "seconds:") {
+			options.seconds = std::atof(value.c_str());
+		} else if (tag == "checkpoint:") {
+			options.checkpoint = std::atof(value.c_str());
+		} else {
 			std::cerr << "Unknown tag '" << tag << "'" << std::endl;
 			return 1;
 		}
 	}
 
+	if (options.mode != "local" && options.mode != "lk" && options.mode != "anneal") {
+		std::cerr << "Unknown mode '" << options.mode << "'" << std::endl;
+		return 1;
+	}
+
 	options.describe();
 
 	stopwatch("start");
@@ -50,34 +126,50 @@ int main(int argc, char **argv) {
 	std::cout << "Have " << maximal.size() << " maximal nodes." << std::endl;
 
 
-	std::unique_ptr< uint8_t[] > distances(new uint8_t[maximal.size() * maximal.size()]);
-
-	std::ifstream in("distances.table");
-	if (!in.read(reinterpret_cast< char * >(distances.get()), maximal.size() * maximal.size())) {
-		std::cerr << "failed to read distance table." << std::endl;
-		return false;
+	Distances distances;
+	if (!distances.map("distances.table", maximal.size())) {
+		std::cerr << "failed to map distance table." << std::endl;
+		return 1;
 	}
 
-	stopwatch("read distances");
+	stopwatch("map distances");
 
 	//------------------------------------------
 	
-	std::string portmantout;
-	if (!std::getline(std::cin, portmantout) || portmantout.size() == 0) {
-		std::cerr << "Please pass a portmantout on stdin." << std::endl;
-		return 1;
-	}
-
-	std::cout << "Attempting to improve portmantout of " << portmantout.size() << " letters." << std::endl;
+	std::vector< uint32_t > path;
+	uint32_t start_len = 0;
 
-	stopwatch("read word");
+	if (options.resume != "") {
+		//a dump (of graph nodes) written by an earlier run:
+		std::ifstream in(options.resume, std::ios::binary);
+		uint32_t node;
+		while (in.read(reinterpret_cast< char * >(&node), 4)) {
+			if (node >= graph.nodes || maximal_index[node] >= maximal.size()) {
+				std::cerr << "'" << options.resume << "' doesn't look like a path of maximal words." << std::endl;
+				return 1;
+			}
+			path.emplace_back(maximal_index[node]);
+		}
+		if (path.empty()) {
+			std::cerr << "Failed to read path from '" << options.resume << "'." << std::endl;
+			return 1;
+		}
+		//(the portmantout starts with the start word, so everything before it is the word itself)
+		start_len = graph.depth[maximal[path[0]]];
+		std::cout << "Resuming from path of " << path.size() << " maximals (of " << maximal.size() << "), "
+			<< start_len + LocalSearch::length(distances, path) << " letters." << std::endl;
+		stopwatch("read path");
+	} else {
+		std::string portmantout;
+		if (!std::getline(std::cin, portmantout) || portmantout.size() == 0) {
+			std::cerr << "Please pass a portmantout on stdin." << std::endl;
+			return 1;
+		}
 
-	//------------------------------------------
+		std::cout << "Attempting to improve portmantout of " << portmantout.size() << " letters." << std::endl;
 
-	std::vector< uint32_t > path;
-	uint32_t start_len = 0;
+		stopwatch("read word");
 
-	{
 		uint32_t at = 0;
 		uint32_t letter = 0;
 		for (auto c : portmantout) {
@@ -106,51 +198,15 @@ int main(int argc, char **argv) {
 			}
 			++letter;
 		}
-	}
-	stopwatch("compute path");
-
-	std::cout << "Path has " << path.size() << " maximals (of " << maximal.size() << ")" << std::endl;
-
-	{
-		uint32_t len = start_len;
-		for (uint32_t i = 0; i + 1 < path.size(); ++i) {
-			len += distances[path[i] * maximal.size() + path[i+1]];
-		}
-		std::cout << "Expected length " << len << " vs real length " << portmantout.size() << std::endl;
-	}
-
-	bool done = false;
-	while (!done) {
-		done = true;
-		{ //See if there are any removable words:
-			std::vector< uint8_t > counts(maximal.size());
-			for (auto p : path) {
-				counts[p] += 1;
-			}
-			for (uint32_t i = 1; i + 1 < path.size(); ++i) {
-				assert(counts[path[i]] >= 1);
-				if (counts[path[i]] == 1) continue;
-				uint32_t start = i;
-				uint32_t end = i;
-				while (end + 1 < path.size()) {
-					assert(counts[path[end]] > 1);
-					counts[path[end]] -= 1;
-					end += 1;
-					assert(counts[path[end]] >= 1);
-					if (counts[path[end]] == 1) break;
-				}
-
-			}
-		}
+		stopwatch("compute path");
 
+		std::cout << "Path has " << path.size() << " maximals (of " << maximal.size() << ")" << std::endl;
 
+		std::cout << "Expected length " << start_len + LocalSearch::length(distances, path) << " vs real length " << portmantout.size() << std::endl;
 	}
 
-	{
-		uint32_t len = start_len;
-		for (uint32_t i = 0; i + 1 < path.size(); ++i) {
-			len += distances[path[i] * maximal.size() + path[i+1]];
-		}
+	auto write_dump = [&](std::vector< uint32_t > const &path) {
+		uint32_t len = start_len + LocalSearch::length(distances, path);
 		std::vector< uint32_t > dump;
 		for (auto p : path) {
 			assert(p < maximal.size());
@@ -160,7 +216,130 @@ int main(int argc, char **argv) {
 		std::cout << "Writing to '" << filename << "'" << std::endl;
 		std::ofstream out(filename);
 		out.write(reinterpret_cast< const char * >(&dump[0]), 4 * dump.size());
+	};
+
+	NeighborLists neighbors;
+	LocalSearch search(distances, neighbors, path);
+	search.threads = options.threads;
+	search.segment = options.segment;
+	if (options.mode == "lk") search.depth = options.depth;
+
+	{
+		uint32_t saved = search.remove_redundant();
+		std::cout << "Removed redundant words: " << path.size() << " maximals left, " << saved << " letters saved." << std::endl;
+		stopwatch("remove redundant");
+	}
+
+	neighbors.build(distances, options.k, path[0], options.threads);
+	stopwatch("neighbors");
+
+	{
+		auto before = std::chrono::steady_clock::now();
+		uint32_t moves = 0;
+		uint32_t gained = search.optimize(&moves);
+		auto after = std::chrono::steady_clock::now();
+		std::cout << "Local search: " << moves << " moves, " << gained << " letters saved, took "
+			<< std::chrono::duration< double >(after - before).count() << "s." << std::endl;
+		stopwatch("local search");
 	}
 
+	if (options.mode == "lk" && path.size() > 4) {
+		//iterated Lin-Kernighan: each thread repeatedly kicks its own copy of the path
+		// (a random segment swap -- the asymmetric double-bridge) and re-optimizes
+		// around the kick, keeping the result unless it got longer; best thread wins:
+		auto before = std::chrono::steady_clock::now();
+		std::vector< std::vector< uint32_t > > results(options.threads, path);
+		std::vector< uint32_t > accepted(options.threads, 0);
+		parallel_for(options.threads, [&](uint32_t thread, uint32_t) {
+			std::mt19937 mt(options.seed + thread);
+			std::vector< uint32_t > &current = results[thread];
+			std::vector< uint32_t > saved;
+			LocalSearch local(distances, neighbors, current);
+			local.threads = 1;
+			local.segment = options.segment;
+			local.depth = options.depth;
+			uint32_t len = LocalSearch::length(distances, current);
+			const uint32_t n = current.size();
+			for (uint32_t trial = 0; trial < options.trials; ++trial) {
+				saved = current;
+				LocalSearch::Move kick;
+				kick.a = mt() % (n - 3);
+				kick.b = kick.a + 1 + mt() % std::min(options.kick, n - 3 - kick.a);
+				kick.c = kick.b + 1 + mt() % std::min(options.kick, n - 1 - kick.b);
+				std::rotate(current.begin() + kick.a + 1, current.begin() + kick.b + 1, current.begin() + kick.c + 1);
+				std::vector< uint32_t > awake = LocalSearch::touched(kick);
+				local.optimize(nullptr, &awake);
+				uint32_t after = LocalSearch::length(distances, current);
+				if (after <= len) {
+					if (after < len) accepted[thread] += 1;
+					len = after;
+				} else {
+					current = saved;
+				}
+			}
+		}, options.threads);
+		uint32_t best = 0;
+		for (uint32_t t = 0; t < options.threads; ++t) {
+			uint32_t len = LocalSearch::length(distances, results[t]);
+			std::cout << "  thread " << t << ": " << start_len + len << " letters after " << accepted[t] << " improving kicks." << std::endl;
+			if (len < LocalSearch::length(distances, results[best])) best = t;
+		}
+		uint32_t before_len = LocalSearch::length(distances, path);
+		path = results[best];
+		auto after = std::chrono::steady_clock::now();
+		std::cout << "Iterated LK: " << before_len - LocalSearch::length(distances, path) << " letters saved, took "
+			<< std::chrono::duration< double >(after - before).count() << "s." << std::endl;
+		stopwatch("iterated lk");
+	}
+
+	if (options.mode == "anneal" && path.size() > 4) {
+		Tempering tempering(distances, neighbors);
+		tempering.threads = options.threads;
+		tempering.segment = options.segment;
+		tempering.start(path, options.replicas, options.hot, options.cold, options.seed);
+
+		auto begin = std::chrono::steady_clock::now();
+		auto last_report = begin;
+		auto last_checkpoint = begin;
+		bool unwritten = false;
+		uint32_t batches = 0;
+		while (1) {
+			if (tempering.batch(options.steps)) unwritten = true;
+			batches += 1;
+			auto now = std::chrono::steady_clock::now();
+			double elapsed = std::chrono::duration< double >(now - begin).count();
+			if (std::chrono::duration< double >(now - last_report).count() >= 10.0) {
+				std::cout << "  " << elapsed << "s: best " << start_len + tempering.best_length << " letters; replicas at";
+				for (auto const &replica : tempering.replicas) {
+					std::cout << " " << start_len + replica.length << " (T " << replica.temperature << ", "
+						<< int32_t(100.0 * replica.accepted / std::max< uint64_t >(1, replica.tried)) << "% acc)";
+				}
+				std::cout << std::endl;
+				last_report = now;
+			}
+			bool finished = (elapsed >= options.seconds);
+			if (unwritten && (finished || std::chrono::duration< double >(now - last_checkpoint).count() >= options.checkpoint)) {
+				//(an overnight run can be picked up again with resume:)
+				write_dump(tempering.best);
+				last_checkpoint = now;
+				unwritten = false;
+			}
+			if (finished) break;
+		}
+		uint32_t exchanged = 0;
+		for (auto const &replica : tempering.replicas) exchanged += replica.exchanged;
+		std::cout << "Annealing: " << batches << " batches, " << exchanged << " exchanges, best "
+			<< start_len + tempering.best_length << " letters." << std::endl;
+		path = tempering.best;
+		stopwatch("anneal");
+
+		//polish:
+		uint32_t gained = search.optimize();
+		std::cout << "Local search after annealing saved " << gained << " letters." << std::endl;
+	}
+
+	write_dump(path);
+
+	return 0;
 
 }
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <tuple>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+#include "distances.hpp"
+#include "parallel.hpp"
+
+//Local search over a path of maximal indices (as decoded by improve). The path
+// costs the sum of distances between consecutive words; path[0] (the start word)
+// never moves, and stepping off the end of the path is free.
+//
+//Every move here is a "segment swap": cut after positions a < b < c and swap the
+// segments (a, b] and (b, c], which is asymmetric 3-opt without reversal; with a
+// short segment it is Or-opt (relocating a few words). So applying a move is a
+// std::rotate, and its gain only needs six table lookups.
+//
+//Moves are found from neighbor lists (each word's cheapest successors): a move
+// is only tried if one of its new edges leaves a word x for a neighbor cheaper
+// than x's current successor. Words whose neighborhoods have nothing to offer
+// sleep (don't-look bits) until a move touches them, and awake words are handled
+// largest-gain-first from a priority queue.
+
+//the k cheapest successors of every word, cheapest first:
+class NeighborLists {
+public:
+	uint32_t k = 0;
+	std::vector< uint32_t > next; //next[w * k + i] is w's i'th cheapest successor
+
+	uint32_t const *begin(uint32_t w) const { return &next[size_t(w) * k]; }
+	uint32_t const *end(uint32_t w) const { return &next[size_t(w) * k] + k; }
+
+	//(never lists 'exclude', which is the start word -- nothing goes back to it)
+	void build(Distances const &distances, uint32_t k_, uint32_t exclude, uint32_t threads = thread_count()) {
+		const uint32_t size = distances.size;
+		k = std::min(k_, size - 1);
+		next.assign(size_t(size) * k, 0);
+		parallel_for(size, [&](uint32_t r, uint32_t) {
+			uint8_t const *row = distances.row(r);
+			std::vector< std::pair< uint8_t, uint32_t > > cheap;
+			cheap.reserve(size);
+			for (uint32_t c = 0; c < size; ++c) {
+				if (c == r || c == exclude) continue;
+				cheap.emplace_back(row[c], c);
+			}
+			uint32_t count = std::min< uint32_t >(k, cheap.size());
+			std::partial_sort(cheap.begin(), cheap.begin() + count, cheap.end());
+			for (uint32_t i = 0; i < k; ++i) {
+				//(rows shorter than k -- only with tiny lists -- repeat their last entry)
+				next[size_t(r) * k + i] = cheap[std::min(i, count - 1)].second;
+			}
+		}, threads);
+	}
+};
+
+class LocalSearch {
+public:
+	LocalSearch(Distances const &distances_, NeighborLists const &neighbors_, std::vector< uint32_t > &path_)
+		: distances(distances_), neighbors(neighbors_), path(path_) { }
+
+	Distances const &distances;
+	NeighborLists const &neighbors;
+	std::vector< uint32_t > &path;
+
+	uint32_t threads = thread_count();
+	uint32_t segment = 3; //longest segment that Or-opt moves are tried for
+	uint32_t depth = 1; //longest chain of moves tried when no single move helps (see deepen())
+
+	static uint32_t length(Distances const &distances, std::vector< uint32_t > const &path) {
+		uint32_t len = 0;
+		for (uint32_t i = 0; i + 1 < path.size(); ++i) {
+			len += distances(path[i], path[i+1]);
+		}
+		return len;
+	}
+
+	//drop words that appear again elsewhere in the path, largest savings first.
+	// (distances are shortest paths, so dropping a word never costs anything.)
+	// returns the total saved:
+	uint32_t remove_redundant() {
+		const uint32_t n = path.size();
+		if (n < 2) return 0;
+		std::vector< uint32_t > count(distances.size, 0);
+		for (auto p : path) count[p] += 1;
+
+		std::vector< uint32_t > prev(n), next(n);
+		for (uint32_t i = 0; i < n; ++i) {
+			prev[i] = i - 1;
+			next[i] = i + 1;
+		}
+		std::vector< bool > removed(n, false);
+		std::vector< uint32_t > version(n, 0);
+		auto saving = [&](uint32_t i) -> int32_t {
+			int32_t s = distances(path[prev[i]], path[i]);
+			if (next[i] < n) s += int32_t(distances(path[i], path[next[i]])) - int32_t(distances(path[prev[i]], path[next[i]]));
+			return s;
+		};
+		std::priority_queue< std::tuple< int32_t, uint32_t, uint32_t > > queue; //(saving, version, position)
+		for (uint32_t i = 1; i < n; ++i) {
+			if (count[path[i]] > 1) queue.emplace(saving(i), version[i], i);
+		}
+
+		uint32_t saved = 0;
+		while (!queue.empty()) {
+			int32_t s;
+			uint32_t v, i;
+			std::tie(s, v, i) = queue.top();
+			queue.pop();
+			if (removed[i] || v != version[i] || count[path[i]] == 1) continue;
+			assert(s >= 0);
+			saved += s;
+			removed[i] = true;
+			count[path[i]] -= 1;
+			next[prev[i]] = next[i];
+			if (next[i] < n) prev[next[i]] = prev[i];
+			for (uint32_t j : {prev[i], next[i]}) {
+				if (j == 0 || j >= n || count[path[j]] == 1) continue;
+				version[j] += 1;
+				queue.emplace(saving(j), version[j], j);
+			}
+		}
+
+		std::vector< uint32_t > kept;
+		for (uint32_t i = 0; i < n; ++i) {
+			if (!removed[i]) kept.emplace_back(path[i]);
+		}
+		path = std::move(kept);
+		return saved;
+	}
+
+	struct Move {
+		int32_t gain = 0;
+		uint32_t a = 0, b = 0, c = 0;
+	};
+
+	//best segment swap with a new edge out of the word at position t, if it gains more
+	// than 'floor'; with 'avoid_tabu', moves that would break an edge out of a tabu
+	// word (see deepen()) are skipped:
+	Move best_move(uint32_t t, int32_t floor = 0, bool avoid_tabu = false) const {
+		const uint32_t n = path.size();
+		Move best;
+		best.gain = floor;
+		if (t + 1 >= n) return best; //the last word has no edge to give up
+		auto consider = [&](uint32_t a, uint32_t b, uint32_t c) {
+			if (!(a < b && b < c && c < n)) return;
+			if (avoid_tabu && (is_tabu(path[a]) || is_tabu(path[b]) || is_tabu(path[c]))) return;
+			int32_t g = edge(a) + edge(b) + edge(c) - cost(a, b+1) - cost(c, a+1) - cost(b, c+1);
+			if (g > best.gain) {
+				best.gain = g;
+				best.a = a;
+				best.b = b;
+				best.c = c;
+			}
+		};
+		const uint32_t x = path[t];
+		const int32_t out = edge(t);
+		for (uint32_t const *y = neighbors.begin(x); y != neighbors.end(x); ++y) {
+			if (distances(x, *y) >= out) break;
+			const uint32_t q = pos[*y];
+			if (q == -1U || q == 0) continue;
+			if (q > t + 1) {
+				//new edge a -> b+1 (a = t, b = q-1), try c's:
+				uint32_t a = t, b = q - 1;
+				for (uint32_t c = q; c < q + segment; ++c) consider(a, b, c);
+				consider(a, b, n - 1);
+				for (uint32_t const *z = neighbors.begin(path[b]); z != neighbors.end(path[b]); ++z) {
+					if (pos[*z] != -1U && pos[*z] > q) consider(a, b, pos[*z] - 1);
+				}
+				//new edge b -> c+1 (b = t, c = q-1), try a's:
+				b = t;
+				uint32_t c = q - 1;
+				for (uint32_t a = (t > segment ? t - segment : 0); a < t; ++a) consider(a, b, c);
+				for (uint32_t const *z = neighbors.begin(path[c]); z != neighbors.end(path[c]); ++z) {
+					if (pos[*z] != -1U && pos[*z] >= 1 && pos[*z] <= t) consider(pos[*z] - 1, b, c);
+				}
+			} else if (q < t) {
+				//new edge c -> a+1 (c = t, a = q-1), try b's:
+				uint32_t a = q - 1, c = t;
+				for (uint32_t b = (t > segment ? t - segment : 0); b < t; ++b) consider(a, b, c);
+				for (uint32_t b = q; b < q + segment; ++b) consider(a, b, c);
+				for (uint32_t const *z = neighbors.begin(path[a]); z != neighbors.end(path[a]); ++z) {
+					if (pos[*z] != -1U && pos[*z] > q && pos[*z] <= t) consider(a, pos[*z] - 1, c);
+				}
+			}
+		}
+		return best;
+	}
+
+	void apply(Move const &move) {
+		std::rotate(path.begin() + move.a + 1, path.begin() + move.b + 1, path.begin() + move.c + 1);
+		for (uint32_t i = move.a + 1; i <= move.c; ++i) {
+			pos[path[i]] = i;
+		}
+	}
+	void undo(Move const &move) {
+		std::rotate(path.begin() + move.a + 1, path.begin() + move.a + 1 + (move.c - move.b), path.begin() + move.c + 1);
+		for (uint32_t i = move.a + 1; i <= move.c; ++i) {
+			pos[path[i]] = i;
+		}
+	}
+
+	//positions holding the tails of a move's new edges (and their successors) once it's applied:
+	static std::vector< uint32_t > touched(Move const &move) {
+		uint32_t mid = move.a + (move.c - move.b);
+		return std::vector< uint32_t >{move.a, move.a + 1, mid, mid + 1, move.c, move.c + 1};
+	}
+
+	//Lin-Kernighan style variable-depth step from the word at position t, for when no
+	// single move gains anything: apply the best move out of t even if it loses, then
+	// keep going from the worst edge it left behind, never breaking an edge made
+	// earlier in the chain, for up to 'depth' moves while the running gain can still
+	// be recovered; keep the best prefix of the chain and undo the rest.
+	// Returns the gain, with the kept moves in 'chain':
+	int32_t deepen(uint32_t t, std::vector< Move > &chain) {
+		chain.clear();
+		if (depth < 2) return 0;
+		++tabu_stamp;
+		int32_t total = 0;
+		int32_t best = 0;
+		uint32_t best_length = 0;
+		while (chain.size() < depth) {
+			Move move = best_move(t, std::numeric_limits< int32_t >::min(), true);
+			if (move.gain == std::numeric_limits< int32_t >::min()) break;
+			tabu[path[move.a]] = tabu[path[move.b]] = tabu[path[move.c]] = tabu_stamp;
+			apply(move);
+			chain.emplace_back(move);
+			total += move.gain;
+			if (total > best) {
+				best = total;
+				best_length = chain.size();
+			}
+			//continue from the most expensive edge the move left that may still be broken:
+			uint32_t next = -1U;
+			int32_t worst = 0;
+			for (uint32_t u : touched(move)) {
+				if (u + 1 < path.size() && !is_tabu(path[u]) && edge(u) > worst) {
+					worst = edge(u);
+					next = u;
+				}
+			}
+			//(a move can't gain more than the three edges it breaks)
+			if (next == -1U || total + 3 * worst <= best) break;
+			t = next;
+		}
+		while (chain.size() > best_length) {
+			undo(chain.back());
+			chain.pop_back();
+		}
+		return best;
+	}
+
+	//run moves until no word's neighborhood has an improving one; returns the total gain.
+	// With 'awake', only those positions start awake (e.g. after a kick):
+	uint32_t optimize(uint32_t *moves_out = nullptr, std::vector< uint32_t > const *awake = nullptr) {
+		const uint32_t n = path.size();
+		assert(neighbors.k > 0);
+		pos.assign(distances.size, -1U);
+		for (uint32_t i = 0; i < n; ++i) {
+			assert(pos[path[i]] == -1U && "remove_redundant() first");
+			pos[path[i]] = i;
+		}
+		tabu.assign(distances.size, 0);
+		tabu_stamp = 0;
+
+		std::vector< uint32_t > version(distances.size, 0);
+		std::priority_queue< std::tuple< int32_t, uint32_t, uint32_t > > queue; //(gain, version, word)
+		if (awake) {
+			for (uint32_t t : *awake) {
+				if (t < n) queue.emplace(std::max(0, best_move(t).gain), version[path[t]], path[t]);
+			}
+		} else {
+			//everyone starts awake; first gains are found in parallel:
+			std::vector< int32_t > first(n, 0);
+			const uint32_t Block = 256;
+			parallel_for((n + Block - 1) / Block, [&](uint32_t block, uint32_t) {
+				for (uint32_t t = block * Block; t < n && t < (block + 1) * Block; ++t) {
+					first[t] = best_move(t).gain;
+				}
+			}, threads);
+			for (uint32_t t = 0; t < n; ++t) {
+				if (first[t] > 0 || depth > 1) queue.emplace(first[t], version[path[t]], path[t]);
+			}
+		}
+
+		auto wake = [&](uint32_t t) {
+			if (t >= n) return;
+			uint32_t w = path[t];
+			version[w] += 1;
+			int32_t g = best_move(t).gain;
+			if (g > 0 || depth > 1) queue.emplace(g, version[w], w);
+		};
+
+		uint32_t gained = 0;
+		uint32_t moves = 0;
+		std::vector< Move > chain;
+		while (!queue.empty()) {
+			uint32_t v, w;
+			std::tie(std::ignore, v, w) = queue.top();
+			queue.pop();
+			if (v != version[w]) continue;
+			version[w] += 1;
+			//(positions may have shifted since this was queued, so look again)
+			Move move = best_move(pos[w]);
+			if (move.gain > 0) {
+				apply(move);
+				chain.assign(1, move);
+			} else if (deepen(pos[w], chain) <= 0) {
+				continue; //back to sleep
+			}
+			for (auto const &m : chain) {
+				gained += m.gain;
+				moves += 1;
+			}
+			for (auto const &m : chain) {
+				for (uint32_t t : touched(m)) wake(t);
+			}
+		}
+		if (moves_out) *moves_out = moves;
+		return gained;
+	}
+
+private:
+	std::vector< uint32_t > pos; //position of each word in path (-1U if absent)
+	std::vector< uint32_t > tabu; //== tabu_stamp for words whose out-edge the current chain made
+	uint32_t tabu_stamp = 0;
+
+	bool is_tabu(uint32_t w) const { return tabu[w] == tabu_stamp; }
+
+	//cost of going from position i to position j (nothing past the end):
+	int32_t cost(uint32_t i, uint32_t j) const {
+		return (j < path.size() ? int32_t(distances(path[i], path[j])) : 0);
+	}
+	int32_t edge(uint32_t i) const {
+		return cost(i, i+1);
+	}
+};
@@ -0,0 +1,121 @@
+#include <limits>
+#include <algorithm>
+#include <map>
+#include <chrono>
+#include <random>
+
+#include "graph.hpp"
+#include "stopwatch.hpp"
+#include "distances.hpp"
+#include "auction.hpp"
+
+struct {
+	uint32_t threads = thread_count();
+	uint32_t alpha = 4; //epsilon scaling factor
+	std::string bidding = ""; //"jacobi" (parallel rounds) or "gauss-seidel" (one row at a time); default: jacobi if threads > 1
+	void describe() {
+		std::cout << "Options:\n";
+		std::cout << "\tThreads: " << threads << "\n";
+		std::cout << "\tEpsilon scaling: " << alpha << "\n";
+		std::cout << "\tBidding: " << bidding << "\n";
+	}
+} options;
+
+int main(int argc, char **argv) {
+
+	for (int a = 1; a < argc; ++a) {
+		std::string arg = argv[a];
+		std::string tag;
+		std::string value;
+		auto pos = arg.find(':');
+		tag = arg.substr(0, pos+1);
+		value = arg.substr(pos+1);
+		if (tag == "threads:") {
+			options.threads = std::max(1, std::atoi(value.c_str()));
+		} else if (tag == "alpha:") {
+			options.alpha = std::max(2, std::atoi(value.c_str()));
+		} else if (tag == "bidding:") {
+			options.bidding = value;
+		} else {
+			std::cerr << "Unknown tag '" << tag << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	if (options.bidding == "") {
+		options.bidding = (options.threads > 1 ? "jacobi" : "gauss-seidel");
+	}
+	if (options.bidding != "jacobi" && options.bidding != "gauss-seidel") {
+		std::cerr << "Unknown bidding '" << options.bidding << "'" << std::endl;
+		return 1;
+	}
+
+	options.describe();
+
+	stopwatch("start");
+	Graph graph;
+	if (!graph.read("wordlist.graph")) {
+		std::cerr << "Failed to read graph." << std::endl;
+		exit(1);
+	}
+	stopwatch("read graph");
+
+	std::vector< uint32_t > maximal;
+
+	for (auto m = graph.maximal; m != graph.maximal + graph.nodes; ++m) {
+		if (*m) {
+			maximal.emplace_back(m - graph.maximal);
+		}
+	}
+	std::cout << "Have " << maximal.size() << " maximal nodes." << std::endl;
+
+	//the portmantout has to start with this word:
+	std::string start_word;
+	const uint32_t start = find_start(graph, maximal, &start_word);
+	if (start == -1U) {
+		std::cerr << "No word starting with 'portmanteau' to start from." << std::endl;
+		return 1;
+	}
+	const uint32_t start_len = start_word.size();
+	std::cout << "Starting with: " << start_word << std::endl;
+
+	Distances distances;
+	if (!distances.map("distances.table", maximal.size())) {
+		std::cerr << "failed to map distance table." << std::endl;
+		return 1;
+	}
+
+	stopwatch("map distances");
+
+	uint8_t max_dis = distances.max();
+	std::cout << "Max distance is " << int(max_dis) << std::endl;
+	assert(max_dis < 0xff);
+
+	stopwatch("max");
+
+	//------------------------------------------
+
+	BoundRows rows(distances, start, max_dis + 1);
+
+	Auction auction;
+	auction.threads = options.threads;
+	auction.jacobi = (options.bidding == "jacobi");
+	auction.verbose = true;
+	auction.solve(rows, options.alpha);
+
+	stopwatch("auction");
+
+	int64_t bound = auction.bound(rows);
+	std::cout << "Total cost is: " << auction.cost << ", dual bound is: " << bound
+		<< " corresponding to a bound of " << start_len + bound << " letters." << std::endl;
+
+	{ //dual certificate: bound == ceil((sum_r min_c (scale * weight(r,c) + price[c]) - sum_c price[c]) / scale)
+		std::string filename = "duals-" + std::to_string(start_len + bound) + ".dump";
+		std::cout << "Writing column prices (scale " << auction.scale << ") to '" << filename << "'" << std::endl;
+		std::ofstream out(filename);
+		out.write(reinterpret_cast< const char * >(&auction.price[0]), sizeof(int64_t) * auction.price.size());
+	}
+
+	return 0;
+
+}
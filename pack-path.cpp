@@ -0,0 +1,94 @@
+#include "path-code.hpp"
+#include "stopwatch.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+
+//Pack a path dump (graph node indices, as written by search-match or improve) into
+// a .pmp, or unpack one (see path-code.hpp). Uses wordlist.graph, and
+// successors.table if there is one (packing; it's used if that comes out smaller)
+// or the .pmp needs it (unpacking).
+
+int main(int argc, char **argv) {
+	bool unpack = (argc == 4 && std::string(argv[1]) == "-d");
+	if (argc != 3 && !unpack) {
+		std::cerr << "Usage:\n\t./pack-path <in.dump> <out.pmp>\n\t./pack-path -d <in.pmp> <out.dump>" << std::endl;
+		return 1;
+	}
+	std::string in_name = argv[argc-2];
+	std::string out_name = argv[argc-1];
+
+	std::vector< uint8_t > in;
+	{
+		std::ifstream file(in_name, std::ios::binary);
+		if (!file) {
+			std::cerr << "Failed to open '" << in_name << "'." << std::endl;
+			return 1;
+		}
+		in.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+	}
+	stopwatch("read");
+
+	Graph graph;
+	if (!graph.read("wordlist.graph")) {
+		std::cerr << "Failed to read graph." << std::endl;
+		return 1;
+	}
+	uint32_t maximals = 0;
+	for (uint32_t n = 0; n < graph.nodes; ++n) {
+		if (graph.maximal[n]) ++maximals;
+	}
+	stopwatch("read graph");
+
+	Successors successors;
+	bool have_successors = false;
+	if (!unpack || PathCode::needs_successors(in)) {
+		have_successors = successors.read("successors.table", graph.hash(), maximals);
+		std::cout << (have_successors ? "Using successors.table." : "No (current) successors.table.") << std::endl;
+		stopwatch("read successors");
+	}
+
+	std::vector< uint8_t > out;
+	std::string error;
+	if (unpack) {
+		std::vector< uint32_t > path;
+		if (!PathCode::decode(graph, have_successors ? &successors : nullptr, in, path, &error)) {
+			std::cerr << "Failed to unpack '" << in_name << "': " << error << "." << std::endl;
+			return 1;
+		}
+		out.resize(4 * path.size());
+		if (!path.empty()) std::memcpy(out.data(), path.data(), out.size());
+		stopwatch("unpack");
+	} else {
+		if (in.size() % 4) {
+			std::cerr << "Expected multiple of four bytes path." << std::endl;
+			return 1;
+		}
+		std::vector< uint32_t > path(in.size() / 4);
+		if (!path.empty()) std::memcpy(path.data(), in.data(), in.size());
+		if (!PathCode::encode(graph, nullptr, path, out, &error)) {
+			std::cerr << "Failed to pack '" << in_name << "': " << error << "." << std::endl;
+			return 1;
+		}
+		//(successor ranks only pay off when the path mostly takes the cheapest steps, so keep whichever is smaller)
+		std::vector< uint8_t > ranked;
+		if (have_successors && PathCode::encode(graph, &successors, path, ranked) && ranked.size() < out.size()) {
+			out.swap(ranked);
+		}
+		std::cout << (PathCode::needs_successors(out) ? "Coded with" : "Coded without") << " successor ranks." << std::endl;
+		stopwatch("pack");
+		std::cout << "Path of " << path.size() << " steps: " << in.size() << " -> " << out.size() << " bytes ("
+			<< 8.0 * out.size() / std::max< size_t >(1, path.size()) << " bits per step)." << std::endl;
+	}
+
+	std::ofstream file(out_name, std::ios::binary);
+	file.write(reinterpret_cast< const char * >(out.data()), out.size());
+	if (!file) {
+		std::cerr << "Failed to write '" << out_name << "'." << std::endl;
+		return 1;
+	}
+	stopwatch("write");
+
+	return 0;
+}
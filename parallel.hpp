@@ -0,0 +1,41 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+//number of worker threads to use (always at least one):
+inline uint32_t thread_count() {
+	uint32_t count = std::thread::hardware_concurrency();
+	return std::max< uint32_t >(1, count);
+}
+
+//call fn(item, thread) for every item in [0, count) using a pool of worker threads.
+// items are handed out in order from a shared counter, so fn should do a decent
+// chunk of work per call; 'thread' is in [0, threads) and can index per-thread scratch.
+inline void parallel_for(uint32_t count, std::function< void(uint32_t, uint32_t) > const &fn, uint32_t threads = thread_count()) {
+	threads = std::max< uint32_t >(1, std::min(threads, count));
+	std::atomic< uint32_t > next(0);
+	auto work = [&](uint32_t thread) {
+		while (1) {
+			uint32_t item = next++;
+			if (item >= count) break;
+			fn(item, thread);
+		}
+	};
+	if (threads == 1) {
+		work(0);
+		return;
+	}
+	std::vector< std::thread > pool;
+	pool.reserve(threads);
+	for (uint32_t t = 0; t < threads; ++t) {
+		pool.emplace_back(work, t);
+	}
+	for (auto &t : pool) {
+		t.join();
+	}
+}
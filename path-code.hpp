@@ -0,0 +1,365 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "Coder.hpp"
+#include "graph.hpp"
+#include "distances.hpp"
+
+//.pmp: a path of maximal words (a path-*.dump / improved-*.dump: graph node
+// indices, four bytes each) range coded against the graph it came from.
+//
+//Good paths mostly step from a word to one of its cheapest successors, and never
+// revisit a word, so each step is coded as:
+// - its rank among the previous word's listed successors (successors.table, from
+//   build-knn) that aren't on the path yet, with an adaptive model; or, when it
+//   isn't listed (or there's no table), an escape and then
+// - its overlap with the previous word: how many rewinds from the previous word's
+//   node to the first node whose subtree holds it, counting only nodes with words
+//   not on the path yet (adaptive model per number of such nodes), then which of
+//   that subtree's words not on the path yet it is (uniform).
+// The first word is just its maximal index (uniform), as is any word the path
+// revisits (after an escape from the overlap levels).
+//
+//Node indices are in preorder (see trie.hpp), so the maximal words under a node
+// are a contiguous run of maximal indices.
+//
+//Layout (integers in native byte order, like the other tables here):
+//  "PMP1" graph_hash:u64 successors_hash:u64 path_hash:u64 steps:u32 payload:u32 [range-coded payload]
+// successors_hash is 0 if no successors were used; both it and path_hash are FNV-1a
+// (see PathCode::hash()).
+
+class PathCode {
+public:
+	//returns false (and says why) if 'path' can't be stored against 'graph':
+	static bool encode(Graph const &graph, Successors const *successors, std::vector< uint32_t > const &path, std::vector< uint8_t > &out, std::string *error = nullptr) {
+		auto fail = [&](const char *why) {
+			if (error) *error = why;
+			return false;
+		};
+		Index index;
+		if (!index.build(graph)) return fail("graph nodes aren't in preorder");
+		if (successors && successors->size != index.maximal.size()) return fail("successors table doesn't match graph");
+		const uint32_t k = rank_limit(successors);
+
+		Coder coder;
+		AdaptiveModel rank_model(0, k);
+		std::vector< AdaptiveModel > level_models(LevelContexts, AdaptiveModel(0, Anywhere));
+		std::vector< bool > used(index.maximal.size(), false);
+		Unused unused(index.maximal.size());
+		uint32_t prev = -1U;
+		for (auto node : path) {
+			if (node >= graph.nodes || index.maximal_index[node] == -1U) return fail("path has a node that isn't a maximal word");
+			uint32_t c = index.maximal_index[node];
+			if (prev == -1U) {
+				write_uniform(coder, c, index.maximal.size());
+			} else {
+				bool ranked = false;
+				if (successors) {
+					uint32_t rank = 0;
+					for (uint32_t e = successors->begin(prev); e != successors->end(prev); ++e) {
+						uint32_t n = successors->next[e];
+						if (used[n]) continue;
+						if (n == c) {
+							ranked = true;
+							break;
+						}
+						++rank;
+					}
+					coder.write(int32_t(ranked ? rank : k), rank_model);
+				}
+				if (!ranked && used[c]) {
+					coder.write(int32_t(Anywhere), level_models[level_context(graph, index, unused, prev)]);
+					write_uniform(coder, c, index.maximal.size());
+				} else if (!ranked) {
+					uint32_t level = 0;
+					uint32_t from = graph.rewind[index.maximal[prev]];
+					while (true) {
+						if (unused.count(index.first[from], index.first[index.end[from]]) != 0) {
+							if (index.holds(from, c)) break;
+							++level;
+						}
+						assert(from != 0);
+						from = graph.rewind[from];
+					}
+					uint32_t before = unused.count(0, index.first[from]);
+					coder.write(int32_t(level), level_models[level_context(graph, index, unused, prev)]);
+					write_uniform(coder, unused.count(0, c) - before, unused.count(index.first[from], index.first[index.end[from]]));
+				}
+			}
+			if (!used[c]) unused.remove(c);
+			used[c] = true;
+			prev = c;
+		}
+		coder.finish();
+
+		out.assign({'P', 'M', 'P', '1'});
+		put(out, graph.hash());
+		put(out, successors ? hash(*successors) : uint64_t(0));
+		put(out, hash(path));
+		put(out, uint32_t(path.size()));
+		put(out, uint32_t(coder.output.size()));
+		out.insert(out.end(), coder.output.begin(), coder.output.end());
+
+		//make sure it comes back:
+		std::vector< uint32_t > check;
+		if (!decode(graph, successors, out, check) || check != path) return fail("path did not survive a round trip");
+		return true;
+	}
+
+	//does 'in' need a successors table to decode?
+	static bool needs_successors(std::vector< uint8_t > const &in) {
+		uint64_t successors_hash = 0;
+		if (in.size() < 20 || std::memcmp(in.data(), "PMP1", 4) != 0) return false;
+		std::memcpy(&successors_hash, in.data() + 12, 8);
+		return successors_hash != 0;
+	}
+
+	//returns false (and says why) if 'in' isn't a (complete, undamaged) .pmp for this graph (and successors):
+	static bool decode(Graph const &graph, Successors const *successors, std::vector< uint8_t > const &in, std::vector< uint32_t > &path, std::string *error = nullptr) {
+		auto fail = [&](const char *why) {
+			if (error) *error = why;
+			return false;
+		};
+		size_t at = 0;
+		auto get = [&](void *dst, size_t size) {
+			if (at + size > in.size()) return false;
+			std::memcpy(dst, in.data() + at, size);
+			at += size;
+			return true;
+		};
+		char magic[4];
+		uint64_t graph_hash, successors_hash, path_hash;
+		uint32_t steps, payload_size;
+		if (!get(magic, 4) || std::memcmp(magic, "PMP1", 4) != 0) return fail("not a .pmp");
+		if (!get(&graph_hash, 8) || !get(&successors_hash, 8) || !get(&path_hash, 8)) return fail("truncated header");
+		if (!get(&steps, 4) || !get(&payload_size, 4)) return fail("truncated header");
+		if (at + payload_size != in.size()) return fail("truncated payload");
+		if (graph_hash != graph.hash()) return fail("made from a different graph");
+		if (successors_hash == 0) {
+			successors = nullptr;
+		} else if (!successors || hash(*successors) != successors_hash) {
+			return fail("made with a different (or missing) successors table");
+		}
+		Index index;
+		if (!index.build(graph)) return fail("graph nodes aren't in preorder");
+		if (successors && successors->size != index.maximal.size()) return fail("successors table doesn't match graph");
+		const uint32_t k = rank_limit(successors);
+
+		std::vector< uint8_t > payload(in.begin() + at, in.end());
+		Decoder decoder(payload);
+		AdaptiveModel rank_model(0, k);
+		std::vector< AdaptiveModel > level_models(LevelContexts, AdaptiveModel(0, Anywhere));
+		std::vector< bool > used(index.maximal.size(), false);
+		Unused unused(index.maximal.size());
+		path.clear();
+		path.reserve(steps);
+		uint32_t prev = -1U;
+		for (uint32_t step = 0; step < steps; ++step) {
+			uint32_t c = -1U;
+			if (prev == -1U) {
+				c = read_uniform(decoder, index.maximal.size());
+			} else {
+				if (successors) {
+					uint32_t rank = decoder.read(rank_model);
+					if (rank != k) {
+						for (uint32_t e = successors->begin(prev); e != successors->end(prev); ++e) {
+							uint32_t n = successors->next[e];
+							if (used[n]) continue;
+							if (rank == 0) {
+								c = n;
+								break;
+							}
+							--rank;
+						}
+						if (c == -1U) return fail("successor rank out of range");
+					}
+				}
+				uint32_t level = (c == -1U ? decoder.read(level_models[level_context(graph, index, unused, prev)]) : 0);
+				if (c == -1U && level == Anywhere) {
+					c = read_uniform(decoder, index.maximal.size());
+				} else if (c == -1U) {
+					uint32_t from = graph.rewind[index.maximal[prev]];
+					uint32_t count = 0;
+					for (uint32_t l = 0; true; ) {
+						count = unused.count(index.first[from], index.first[index.end[from]]);
+						if (count != 0) {
+							if (l == level) break;
+							++l;
+						}
+						if (from == 0) return fail("rewound past the root");
+						from = graph.rewind[from];
+					}
+					uint32_t offset = read_uniform(decoder, count);
+					if (offset >= count) return fail("maximal word out of range");
+					c = unused.select(unused.count(0, index.first[from]) + offset);
+				}
+			}
+			if (c >= index.maximal.size()) return fail("maximal index out of range");
+			path.emplace_back(index.maximal[c]);
+			if (!used[c]) unused.remove(c);
+			used[c] = true;
+			prev = c;
+		}
+		if (hash(path) != path_hash) return fail("path doesn't match its hash");
+		return true;
+	}
+
+	//FNV-1a over the successor lists:
+	static uint64_t hash(Successors const &successors) {
+		uint64_t h = 14695981039346656037ULL;
+		mix(h, successors.size);
+		for (auto s : successors.start) mix(h, s);
+		for (auto n : successors.next) mix(h, n);
+		return (h == 0 ? 1 : h); //(0 means "none")
+	}
+
+	//FNV-1a over the path's nodes:
+	static uint64_t hash(std::vector< uint32_t > const &path) {
+		uint64_t h = 14695981039346656037ULL;
+		for (auto n : path) mix(h, n);
+		return h;
+	}
+
+private:
+	enum : uint32_t {
+		Anywhere = 256, //level escape: past any rewind (depths are below 256)
+		LevelContexts = 6, //levels are coded in the context of how many there are to pick from (up to this)
+	};
+
+	//which maximal words aren't on the path yet, as a Fenwick tree of ones, so that
+	// counting them in a range and finding the k'th are O(log words):
+	struct Unused {
+		std::vector< uint32_t > tree; //1-based
+		uint32_t span = 1; //smallest power of two >= size
+
+		Unused(uint32_t size) : tree(size + 1, 0) {
+			while (span < size) span *= 2;
+			for (uint32_t i = 1; i <= size; ++i) {
+				tree[i] += 1;
+				uint32_t parent = i + (i & (~i + 1));
+				if (parent <= size) tree[parent] += tree[i];
+			}
+		}
+		//in [0, end):
+		uint32_t prefix(uint32_t end) const {
+			uint32_t ret = 0;
+			for (uint32_t t = end; t != 0; t -= t & (~t + 1)) {
+				ret += tree[t];
+			}
+			return ret;
+		}
+		uint32_t count(uint32_t begin, uint32_t end) const {
+			return prefix(end) - prefix(begin);
+		}
+		void remove(uint32_t i) {
+			for (uint32_t t = i + 1; t < tree.size(); t += t & (~t + 1)) {
+				tree[t] -= 1;
+			}
+		}
+		//the k'th (from zero) unused word:
+		uint32_t select(uint32_t k) const {
+			uint32_t i = 0;
+			for (uint32_t step = span; step != 0; step >>= 1) {
+				if (i + step < tree.size() && tree[i + step] <= k) {
+					i += step;
+					k -= tree[i];
+				}
+			}
+			return i;
+		}
+	};
+
+	//maximal words in node order, and the run of them under each node:
+	struct Index {
+		std::vector< uint32_t > maximal; //node of each maximal word
+		std::vector< uint32_t > maximal_index; //per node (-1U if not maximal)
+		std::vector< uint32_t > first; //per node (and one past the end): maximal words before it
+		std::vector< uint32_t > end; //per node: one past its subtree
+
+		bool holds(uint32_t n, uint32_t c) const {
+			return first[n] <= c && c < first[end[n]];
+		}
+
+		//false if the graph's nodes aren't in preorder:
+		bool build(Graph const &graph) {
+			const uint32_t n = graph.nodes;
+			maximal.clear();
+			maximal_index.assign(n, -1U);
+			first.assign(n + 1, 0);
+			for (uint32_t i = 0; i < n; ++i) {
+				first[i] = maximal.size();
+				if (graph.maximal[i]) {
+					maximal_index[i] = maximal.size();
+					maximal.emplace_back(i);
+				}
+			}
+			first[n] = maximal.size();
+			end.assign(n, 0);
+			for (uint32_t i = n; i-- > 0; ) {
+				uint32_t next = i + 1;
+				for (uint32_t c = graph.child_start[i]; c < graph.child_start[i+1]; ++c) {
+					if (graph.child[c] != next) return false;
+					next = end[graph.child[c]];
+				}
+				end[i] = next;
+			}
+			return n == 0 || end[0] == n;
+		}
+	};
+
+	//how many levels there are to pick from after 'prev' (nodes on its rewind chain with unused words under them), as a context:
+	static uint32_t level_context(Graph const &graph, Index const &index, Unused const &unused, uint32_t prev) {
+		uint32_t levels = 0;
+		for (uint32_t from = graph.rewind[index.maximal[prev]]; ; from = graph.rewind[from]) {
+			if (unused.count(index.first[from], index.first[index.end[from]]) != 0) ++levels;
+			if (from == 0) break;
+		}
+		return std::min< uint32_t >(std::max< uint32_t >(levels, 1), LevelContexts) - 1;
+	}
+
+	//ranks are [0, k), with k as the escape:
+	static uint32_t rank_limit(Successors const *successors) {
+		uint32_t k = 1;
+		if (successors) {
+			for (uint32_t r = 0; r < successors->size; ++r) {
+				k = std::max(k, successors->end(r) - successors->begin(r));
+			}
+		}
+		return k;
+	}
+
+	static void mix(uint64_t &h, uint32_t v) {
+		for (uint32_t b = 0; b < 4; ++b) {
+			h = (h ^ ((v >> (8 * b)) & 0xff)) * 1099511628211ULL;
+		}
+	}
+
+	//a value in [0, total), for any total up to 2^32:
+	static void write_uniform(Coder &coder, uint32_t v, uint32_t total) {
+		assert(v < total);
+		if (total <= 0x10000) {
+			coder.encode(v, 1, total);
+		} else {
+			coder.encode(v >> 16, 1, ((total - 1) >> 16) + 1);
+			coder.encode(v & 0xffff, 1, 0x10000);
+		}
+	}
+	static uint32_t read_uniform(Decoder &decoder, uint32_t total) {
+		if (total <= 0x10000) return decoder.read_uniform(total);
+		uint32_t high = decoder.read_uniform(((total - 1) >> 16) + 1);
+		return (high << 16) | decoder.read_uniform(0x10000);
+	}
+
+	template< typename T >
+	static void put(std::vector< uint8_t > &out, T val) {
+		uint8_t bytes[sizeof(T)];
+		std::memcpy(bytes, &val, sizeof(T));
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+};
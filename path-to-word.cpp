@@ -1,27 +1,287 @@
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include "graph.hpp"
 #include "stopwatch.hpp"
+#include "parallel.hpp"
+#include "distances.hpp"
+#include "path-code.hpp"
+#include "succinct.hpp"
+
+#include <cstring>
+#include <iterator>
+
+//edges of the graph turned around, for searching backward from the target:
+struct Reverse {
+	std::vector< uint32_t > start; //nodes + 1 entries
+	std::vector< uint32_t > from;
+	std::vector< char > from_char;
+	Reverse(Graph const &graph) : start(graph.nodes + 1, 0), from(graph.adj_start[graph.nodes]), from_char(graph.adj_start[graph.nodes]) {
+		for (uint32_t a = 0; a < graph.adj_start[graph.nodes]; ++a) {
+			start[graph.adj[a] + 1] += 1;
+		}
+		for (uint32_t n = 0; n < graph.nodes; ++n) {
+			start[n+1] += start[n];
+		}
+		std::vector< uint32_t > fill(start.begin(), start.end() - 1);
+		for (uint32_t i = 0; i < graph.nodes; ++i) {
+			for (uint32_t a = graph.adj_start[i]; a < graph.adj_start[i+1]; ++a) {
+				uint32_t f = fill[graph.adj[a]]++;
+				from[f] = i;
+				from_char[f] = graph.adj_char[a];
+			}
+		}
+	}
+};
+
+//per-thread bidirectional BFS scratch; 'seen' is generation-stamped so it never needs clearing:
+struct BFS {
+	BFS(uint32_t nodes) : forward(nodes), backward(nodes) { }
+	//(kept together, since they're always touched together)
+	struct Visit {
+		uint32_t seen = 0;
+		uint32_t link; //forward: previous node; backward: next node (valid where seen == generation)
+		char link_char; //character on the edge to/from 'link'
+		uint8_t distance; //from the source (forward) or to the target (backward)
+	};
+	std::vector< Visit > forward, backward;
+	uint32_t generation = 0;
+	std::vector< uint32_t > forward_ply, backward_ply, next_ply;
+	uint64_t touched = 0; //nodes visited, over all traces
+
+	//characters along a shortest path from 'at' to 'next', found by growing whichever
+	// side has the smaller frontier a whole level at a time until they meet:
+	std::string trace(Graph const &graph, Reverse const &reverse, uint32_t at, uint32_t next) {
+		if (at == next) return "";
+		++generation;
+		forward[at].seen = generation;
+		forward[at].link = at;
+		forward[at].distance = 0;
+		backward[next].seen = generation;
+		backward[next].link = next;
+		backward[next].distance = 0;
+		forward_ply.assign(1, at);
+		backward_ply.assign(1, next);
+		touched += 2;
+
+		uint32_t meet = -1U;
+		uint32_t best = -1U;
+		uint8_t forward_dis = 0, backward_dis = 0;
+		while (meet == -1U) {
+			assert(!forward_ply.empty() && !backward_ply.empty());
+			next_ply.clear();
+			if (forward_ply.size() <= backward_ply.size()) {
+				forward_dis += 1;
+				for (auto i : forward_ply) {
+					for (uint32_t a = graph.adj_start[i]; a < graph.adj_start[i+1]; ++a) {
+						uint32_t n = graph.adj[a];
+						Visit &v = forward[n];
+						if (v.seen == generation) continue;
+						v.seen = generation;
+						v.link = i;
+						v.link_char = graph.adj_char[a];
+						v.distance = forward_dis;
+						next_ply.emplace_back(n);
+						if (backward[n].seen == generation && forward_dis + backward[n].distance < best) {
+							best = forward_dis + backward[n].distance;
+							meet = n;
+						}
+					}
+				}
+				touched += next_ply.size();
+				std::swap(forward_ply, next_ply);
+			} else {
+				backward_dis += 1;
+				for (auto i : backward_ply) {
+					for (uint32_t a = reverse.start[i]; a < reverse.start[i+1]; ++a) {
+						uint32_t n = reverse.from[a];
+						Visit &v = backward[n];
+						if (v.seen == generation) continue;
+						v.seen = generation;
+						v.link = i;
+						v.link_char = reverse.from_char[a];
+						v.distance = backward_dis;
+						next_ply.emplace_back(n);
+						if (forward[n].seen == generation && forward[n].distance + backward_dis < best) {
+							best = forward[n].distance + backward_dis;
+							meet = n;
+						}
+					}
+				}
+				touched += next_ply.size();
+				std::swap(backward_ply, next_ply);
+			}
+		}
+
+		std::string chars;
+		for (uint32_t pt = meet; pt != at; pt = forward[pt].link) {
+			chars += forward[pt].link_char;
+		}
+		std::reverse(chars.begin(), chars.end());
+		for (uint32_t pt = meet; pt != next; pt = backward[pt].link) {
+			chars += backward[pt].link_char;
+		}
+		assert(chars.size() == best);
+		return chars;
+	}
+};
+
+//the same search on the succinct graph, whose reverse edges come from its parent
+// links and its inverted rewinds: v is reached by a letter from its parent p, or from
+// any word with p along its rewind chain (the words in p's subtree of rewinds):
+struct SuccinctBFS {
+	SuccinctBFS(uint32_t nodes) : forward(nodes), backward(nodes) { }
+	struct Visit {
+		uint32_t seen = 0;
+		uint32_t expanded = 0; //backward: rewound subtree already listed (at this generation)
+		uint32_t link;
+		char link_char;
+		uint8_t distance;
+	};
+	std::vector< Visit > forward, backward;
+	uint32_t generation = 0;
+	std::vector< uint32_t > forward_ply, backward_ply, next_ply;
+	uint64_t touched = 0;
+
+	std::string trace(SuccinctGraph const &graph, uint32_t at, uint32_t next) {
+		if (at == next) return "";
+		if (at == 0) return graph.prefix(next); //(only the root's children lead out of the root)
+		++generation;
+		forward[at].seen = generation;
+		forward[at].link = at;
+		forward[at].distance = 0;
+		backward[next].seen = generation;
+		backward[next].link = next;
+		backward[next].distance = 0;
+		forward_ply.assign(1, at);
+		backward_ply.assign(1, next);
+		touched += 2;
+
+		uint32_t meet = -1U;
+		uint32_t best = -1U;
+		uint8_t forward_dis = 0, backward_dis = 0;
+		while (meet == -1U) {
+			assert(!forward_ply.empty() && !backward_ply.empty());
+			next_ply.clear();
+			if (forward_ply.size() <= backward_ply.size()) {
+				forward_dis += 1;
+				for (auto i : forward_ply) {
+					graph.steps(i, [&](char c, uint32_t n) {
+						Visit &v = forward[n];
+						if (v.seen == generation) return;
+						v.seen = generation;
+						v.link = i;
+						v.link_char = c;
+						v.distance = forward_dis;
+						next_ply.emplace_back(n);
+						if (backward[n].seen == generation && forward_dis + backward[n].distance < best) {
+							best = forward_dis + backward[n].distance;
+							meet = n;
+						}
+					});
+				}
+				touched += next_ply.size();
+				std::swap(forward_ply, next_ply);
+			} else {
+				backward_dis += 1;
+				auto reach = [&](uint32_t i, uint32_t n) {
+					Visit &v = backward[n];
+					if (v.seen == generation) return;
+					v.seen = generation;
+					v.link = i;
+					v.link_char = graph.letter(i);
+					v.distance = backward_dis;
+					next_ply.emplace_back(n);
+					if (forward[n].seen == generation && forward[n].distance + backward_dis < best) {
+						best = forward[n].distance + backward_dis;
+						meet = n;
+					}
+				};
+				for (auto i : backward_ply) {
+					uint32_t p = graph.parent(i);
+					if (p == 0) continue; //(only reached from the root)
+					reach(i, p);
+					graph.rewound(p, [&](uint32_t r) -> bool {
+						if (backward[r].expanded == generation) return false;
+						backward[r].expanded = generation;
+						if (graph.terminal(r)) reach(i, r);
+						return true;
+					});
+				}
+				touched += next_ply.size();
+				std::swap(backward_ply, next_ply);
+			}
+		}
+
+		std::string chars;
+		for (uint32_t pt = meet; pt != at; pt = forward[pt].link) {
+			chars += forward[pt].link_char;
+		}
+		std::reverse(chars.begin(), chars.end());
+		for (uint32_t pt = meet; pt != next; pt = backward[pt].link) {
+			chars += backward[pt].link_char;
+		}
+		assert(chars.size() == best);
+		return chars;
+	}
+};
 
 int main(int argc, char **argv) {
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./path-to-word <path>" << std::endl;
+	std::string layout = "graph";
+	if (argc == 3) {
+		std::string arg = argv[2];
+		layout = (arg.substr(0, 7) == "layout:" ? arg.substr(7) : "");
+	}
+	if (!(argc == 2 || argc == 3) || (layout != "graph" && layout != "succinct")) {
+		std::cerr << "Usage:\n\t./path-to-word <path> [layout:graph|succinct]" << std::endl;
+		std::cerr << "('layout:succinct' traces on the succinct graph built from the word list (see succinct.hpp)\n rather than holding wordlist.graph, which is only read to unpack a .pmp. It searches every\n step, walking the trie through select(), so expect ~5x the graph layout's search time (and\n far more than a lookup in bridges.table); ties between shortest steps can also come out differently)" << std::endl;
 		return 1;
 	}
 
 	stopwatch("start");
-	std::vector< uint32_t > path;
 
+	//a raw dump (four bytes per node) or a .pmp (see path-code.hpp):
+	std::vector< uint8_t > bytes;
 	{
-		std::ifstream in(argv[1]);
-		in.seekg(0, std::ios_base::end);
-		if (in.tellg() % 4) {
+		std::ifstream in(argv[1], std::ios::binary);
+		if (!in) {
+			std::cout << "Failed to read path." << std::endl;
+			return 1;
+		}
+		bytes.assign(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+	}
+	bool packed = (bytes.size() >= 4 && std::memcmp(bytes.data(), "PMP1", 4) == 0);
+	std::vector< uint32_t > path;
+	if (!packed) {
+		if (bytes.size() % 4) {
 			std::cout << "Expected multiple of four bytes path." << std::endl;
 		}
-		path.resize(in.tellg() / 4);
-		in.seekg(0);
-		if (!in.read(reinterpret_cast< char * >(&path[0]), path.size() * 4)) {
-			std::cout << "Failed to read path." << std::endl;
+		path.resize(bytes.size() / 4);
+		if (!path.empty()) std::memcpy(&path[0], bytes.data(), path.size() * 4);
+	}
+
+	Graph graph;
+	if (layout == "graph" || packed) {
+		if (!graph.read("wordlist.graph")) {
+			std::cerr << "Failed to read graph." << std::endl;
+			exit(1);
+		}
+		stopwatch("read graph");
+	}
+	if (packed) {
+		Successors successors;
+		bool have_successors = false;
+		if (PathCode::needs_successors(bytes)) {
+			uint32_t maximals = 0;
+			for (uint32_t n = 0; n < graph.nodes; ++n) {
+				if (graph.maximal[n]) ++maximals;
+			}
+			have_successors = successors.read("successors.table", graph.hash(), maximals);
+		}
+		std::string error;
+		if (!PathCode::decode(graph, have_successors ? &successors : nullptr, bytes, path, &error)) {
+			std::cout << "Failed to unpack path: " << error << "." << std::endl;
 			return 1;
 		}
 	}
@@ -31,77 +291,93 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
+	SuccinctGraph succinct;
+	if (layout == "succinct") {
+		graph = Graph(); //(only needed for unpacking)
+		Trie trie;
+		if (!trie.load("wordlist")) {
+			std::cerr << "Failed to load word list." << std::endl;
+			return 1;
+		}
+		succinct.build(trie);
+		succinct.index_rewound();
+		std::cout << "Succinct graph of " << succinct.nodes << " nodes in " << succinct.bytes() << " bytes." << std::endl;
+		stopwatch("build succinct graph");
+	}
+	const uint32_t nodes = (layout == "succinct" ? succinct.nodes : graph.nodes);
+	for (auto n : path) {
+		if (n >= nodes) {
+			std::cout << "Path has a node past the end of the graph." << std::endl;
+			return 1;
+		}
+	}
+
 	stopwatch("read path");
 
-	Graph graph;
-	if (!graph.read("wordlist.graph")) {
-		std::cerr << "Failed to read graph." << std::endl;
-		exit(1);
-	}
-	stopwatch("read graph");
+	std::vector< std::string > steps(path.size());
+	std::atomic< uint32_t > finished(0);
+	const uint32_t threads = thread_count();
+	uint64_t touched = 0;
+	auto progress = [&]() {
+		uint32_t count = ++finished;
+		if (count % 10000 == 0) {
+			std::cout << "( " << count << " / " << path.size() << " ) steps traced." << std::endl;
+		}
+	};
 
-	std::string so_far;
+	if (layout == "succinct") {
+		//(bridges.table is indexed by wordlist.graph's maximal words, so isn't used here)
+		path = succinct.from_preorder(path);
+		std::vector< std::unique_ptr< SuccinctBFS > > scratch(threads);
+		parallel_for(path.size(), [&](uint32_t i, uint32_t thread) {
+			uint32_t at = (i == 0 ? 0 : path[i-1]);
+			if (!scratch[thread]) scratch[thread].reset(new SuccinctBFS(succinct.nodes));
+			steps[i] = scratch[thread]->trace(succinct, at, path[i]);
+			progress();
+		}, threads);
+		for (auto const &bfs : scratch) {
+			if (bfs) touched += bfs->touched;
+		}
+	} else {
+		//if build-distances left bridges between maximal words, most steps are just lookups:
+		std::vector< uint32_t > maximal_index(graph.nodes, -1U);
+		uint32_t maximals = 0;
+		for (uint32_t n = 0; n < graph.nodes; ++n) {
+			if (graph.maximal[n]) maximal_index[n] = maximals++;
+		}
+		Bridges bridges;
+		bool have_bridges = bridges.read("bridges.table", graph.hash(), maximals);
+		std::cout << (have_bridges ? "Using bridges.table." : "No (current) bridges.table; searching every step.") << std::endl;
+		stopwatch("read bridges");
 
-	uint32_t at = 0;
-	for (auto const &next : path) {
-		std::vector< uint32_t > from(graph.nodes, -1U);
-		std::vector< uint32_t > ply;
-		ply.emplace_back(at);
-		from[at] = at;
-		bool done = false;
-		while (!ply.empty()) {
-			std::vector< uint32_t > next_ply;
-			for (auto i : ply) {
-				for (uint32_t a = graph.adj_start[i]; a < graph.adj_start[i+1]; ++a) {
-					uint32_t n = graph.adj[a];
-					if (from[n] == -1U) {
-						from[n] = i;
-						next_ply.emplace_back(n);
-						if (n == next) {
-							done = true;
-							break;
-						}
-					}
-				}
-				if (done) break;
-			}
-			ply = std::move(next_ply);
-			if (done) break;
-		}
-
-		{
-			std::string chars;
-
-			uint32_t pt = next;
-			assert(pt < from.size());
-			while (from[pt] != pt) {
-				uint32_t f = from[pt];
-				assert(f < graph.nodes);
-				bool found = false;
-				for (uint32_t a = graph.adj_start[f]; a < graph.adj_start[f+1]; ++a) {
-					if (graph.adj[a] == pt) {
-						found = true;
-						chars += graph.adj_char[a];
-						break;
-					}
-				}
-				assert(found);
+		Reverse reverse(graph);
+		stopwatch("reverse edges");
 
-				pt = f;
+		//every step is independent (a BFS from the previous word to the next), so they run
+		// on the thread pool, each thread with its own BFS scratch:
+		std::vector< std::unique_ptr< BFS > > scratch(threads);
+		parallel_for(path.size(), [&](uint32_t i, uint32_t thread) {
+			uint32_t at = (i == 0 ? 0 : path[i-1]);
+			bool looked_up = have_bridges && maximal_index[at] != -1U && maximal_index[path[i]] != -1U
+				&& bridges.get(maximal_index[at], maximal_index[path[i]], steps[i]);
+			if (!looked_up) {
+				if (!scratch[thread]) scratch[thread].reset(new BFS(graph.nodes));
+				steps[i] = scratch[thread]->trace(graph, reverse, at, path[i]);
 			}
-			assert(pt == at);
-
-			std::reverse(chars.begin(), chars.end());
-			so_far += chars;
+			progress();
+		}, threads);
+		for (auto const &bfs : scratch) {
+			if (bfs) touched += bfs->touched;
 		}
+	}
 
-		if ((&next - &path[0] + 1) % 1000 == 0) {
-			stopwatch("step * 1000");
-			std::cout << "( " << (&next - &path[0] + 1) << " / " << path.size() << " ) -> At " << so_far.size() << " characters." << std::endl;
-		}
+	size_t total = 0;
+	for (auto const &step : steps) total += step.size();
+	std::string so_far;
+	so_far.reserve(total);
+	for (auto const &step : steps) so_far += step;
 
-		at = next;
-	}
+	std::cout << "Visited " << double(touched) / path.size() << " nodes per step (of " << nodes << ")." << std::endl;
 
 	stopwatch("trace");
 
@@ -0,0 +1,672 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <functional>
+
+#include "Coder.hpp"
+#include "dawg.hpp"
+
+//.pmw: a word list (one word per line, as in wordlist.asc) stored as its minimal
+// DAWG, entropy coded (rANS); PMW::decode() rebuilds the text byte-for-byte.
+//
+//This is compress's best configuration made concrete:
+// - letters are numbered by frequency (most common first);
+// - the DAWG is written out as a tree in preorder from the root, each node right
+//   after the edge into it, except that a shared node (more than one parent) is
+//   written out only at its first reference, which gives it the next id; later
+//   references are just that id (so the most used tend to get the smallest, and a
+//   reader has all of a shared node by the time it sees its id again);
+// - node and edge values are coded with static models split on a single context
+//   (the letter into the node, or the previous sibling's letter); shared ids with
+//   one model for their small values / bit lengths, and raw low bits. The models'
+//   frequencies lead the payload. (Static rather than adaptive so decoding is a
+//   table lookup per value, with rANS, rather than a walk over the frequencies.)
+//
+//The DAWG spells out the words in sorted order; the few words the text has out of
+// order are recorded as moves (whatever isn't on a longest increasing run).
+//
+//Layout (integers in native byte order, like the other tables here):
+//  "PMW2" words:u32 bytes:u32 hash:u64 flags:u8 alphabet:u8 letters[alphabet]
+//  shared:u32 states:u32 edges:u32 moves:u32 payload:u32 [rANS-coded payload]
+// hash is (wordwise) FNV-1a of the text; flags bit 0 says the text ends with a newline.
+
+class PMW {
+public:
+	//returns false (and says why) if 'text' can't be stored (e.g., repeated words):
+	static bool encode(std::string const &text, std::vector< uint8_t > &out, std::string *error = nullptr) {
+		auto fail = [&](const char *why) {
+			if (error) *error = why;
+			return false;
+		};
+
+		std::vector< std::string > words;
+		for (size_t begin = 0; begin < text.size(); ) {
+			size_t end = text.find('\n', begin);
+			if (end == std::string::npos) end = text.size();
+			words.emplace_back(text, begin, end - begin);
+			begin = end + 1;
+		}
+		bool final_newline = (!text.empty() && text.back() == '\n');
+
+		std::vector< std::string > sorted = words;
+		std::sort(sorted.begin(), sorted.end());
+		if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) return fail("repeated words can't be stored");
+
+		DAWG dawg;
+		dawg.build(sorted, false, 0);
+
+		//letters by frequency:
+		std::vector< uint32_t > counts(256, 0);
+		for (auto const &w : sorted) {
+			for (auto c : w) counts[uint8_t(c)] += 1;
+		}
+		std::vector< uint8_t > alphabet;
+		for (uint32_t c = 0; c < 256; ++c) {
+			if (counts[c]) alphabet.emplace_back(c);
+		}
+		std::stable_sort(alphabet.begin(), alphabet.end(), [&counts](uint8_t a, uint8_t b) {
+			return counts[a] > counts[b];
+		});
+		if (alphabet.size() > 255) return fail("too many distinct letters");
+		std::vector< uint32_t > letter_index(256, 0);
+		for (uint32_t i = 0; i < alphabet.size(); ++i) {
+			letter_index[alphabet[i]] = i;
+		}
+
+		//shared nodes (more than one parent); they get ids as they are first reached,
+		// in write_node()'s preorder:
+		std::vector< uint32_t > refs(dawg.states.size(), 0);
+		for (auto const &e : dawg.edges) {
+			refs[e.to] += 1;
+		}
+		uint32_t shared_count = 0;
+		for (uint32_t s = 0; s < dawg.states.size(); ++s) {
+			if (refs[s] >= 2) shared_count += 1;
+		}
+		std::vector< uint32_t > shared_id(dawg.states.size(), -1U);
+
+		//file order as sorted indices; everything off a longest increasing run gets moved:
+		std::vector< std::pair< uint32_t, uint32_t > > moves; //(position in text, sorted index)
+		{
+			std::vector< uint32_t > order(words.size());
+			for (uint32_t i = 0; i < words.size(); ++i) {
+				order[i] = std::lower_bound(sorted.begin(), sorted.end(), words[i]) - sorted.begin();
+			}
+			std::vector< uint32_t > tails; //tails[l] = position ending the best run of length l+1
+			std::vector< uint32_t > before(order.size(), -1U);
+			for (uint32_t i = 0; i < order.size(); ++i) {
+				auto t = std::lower_bound(tails.begin(), tails.end(), order[i], [&order](uint32_t pos, uint32_t val) {
+					return order[pos] < val;
+				});
+				if (t != tails.begin()) before[i] = *(t - 1);
+				if (t == tails.end()) tails.emplace_back(i);
+				else *t = i;
+			}
+			std::vector< bool > kept(order.size(), false);
+			for (uint32_t i = (tails.empty() ? -1U : tails.back()); i != -1U; i = before[i]) {
+				kept[i] = true;
+			}
+			for (uint32_t i = 0; i < order.size(); ++i) {
+				if (!kept[i]) moves.emplace_back(i, order[i]);
+			}
+		}
+
+		//everything goes through 'value' (a model and a value) or 'raw' (some bits);
+		// the first pass just counts, to set the static models:
+		Models models(alphabet.size());
+		std::vector< std::vector< uint32_t > > counts_by_model(models.all.size());
+		for (uint32_t m = 0; m < models.all.size(); ++m) {
+			counts_by_model[m].assign(models.all[m].size(), 0);
+		}
+		AnsCoder coder;
+		bool counting = true;
+		auto value = [&](uint32_t m, uint32_t v) {
+			if (counting) counts_by_model[m][v] += 1;
+			else coder.write(v, models.all[m]);
+		};
+		auto raw = [&](uint32_t v, uint32_t bits) {
+			if (counting) return;
+			write_bits(coder, v, bits);
+		};
+		uint32_t next_id = 0;
+		std::function< void(uint32_t, uint32_t) > write_node = [&](uint32_t s, uint32_t context) {
+			DAWG::State const &state = dawg.states[s];
+			value(models.node(context), state.edge_count * 2 + (state.terminal ? 1 : 0));
+			uint32_t prev = alphabet.size();
+			for (uint32_t e = state.first_edge; e < state.first_edge + state.edge_count; ++e) {
+				DAWG::Edge const &edge = dawg.edges[e];
+				uint32_t letter = letter_index[uint8_t(edge.letter)];
+				uint32_t m = models.edge(prev);
+				prev = letter;
+				if (refs[edge.to] < 2) {
+					value(m, letter * 3 + Models::Inline);
+					write_node(edge.to, letter);
+				} else if (shared_id[edge.to] == -1U) {
+					shared_id[edge.to] = next_id++;
+					value(m, letter * 3 + Models::First);
+					write_node(edge.to, letter);
+				} else {
+					value(m, letter * 3 + Models::Again);
+					uint32_t low_bits;
+					uint32_t head = Models::id_head(shared_id[edge.to], &low_bits);
+					value(models.id(), head);
+					raw(shared_id[edge.to] + 1, low_bits);
+				}
+			}
+		};
+		for (uint32_t pass = 0; pass < 2; ++pass) {
+			counting = (pass == 0);
+			if (!counting) {
+				//set the models, and send them along: which are used, then each one's
+				// frequencies (but the last, which is whatever is left) as bit lengths,
+				// coded with a model of their own that goes first, then the bits after
+				// the leading one:
+				std::vector< std::vector< uint32_t > > freqs_by_model(models.all.size());
+				std::vector< uint32_t > length_counts(StaticModel::Bits + 2, 0);
+				for (uint32_t m = 0; m < models.all.size(); ++m) {
+					bool any = false;
+					for (auto c : counts_by_model[m]) any = any || (c != 0);
+					if (!any) continue;
+					freqs_by_model[m] = StaticModel::quantize(counts_by_model[m]);
+					models.all[m].set(freqs_by_model[m]);
+					for (uint32_t v = 0; v + 1 < freqs_by_model[m].size(); ++v) {
+						length_counts[bit_length(freqs_by_model[m][v])] += 1;
+					}
+				}
+				//(there's always the root's node value, so always some lengths)
+				StaticModel lengths(length_counts.size());
+				lengths.set(StaticModel::quantize(length_counts));
+				for (uint32_t b = 0; b + 1 < lengths.size(); ++b) {
+					write_bits(coder, lengths.freq(b), StaticModel::Bits + 1);
+				}
+				for (uint32_t m = 0; m < models.all.size(); ++m) {
+					coder.write_bits(freqs_by_model[m].empty() ? 0 : 1, 1);
+					for (uint32_t v = 0; v + 1 < freqs_by_model[m].size(); ++v) {
+						uint32_t f = freqs_by_model[m][v];
+						uint32_t b = bit_length(f);
+						coder.write(b, lengths);
+						if (b > 1) write_bits(coder, f & ((1U << (b - 1)) - 1), b - 1);
+					}
+				}
+			}
+			next_id = 0;
+			std::fill(shared_id.begin(), shared_id.end(), -1U);
+			write_node(dawg.root, alphabet.size());
+		}
+		for (auto const &m : moves) {
+			write_bits(coder, m.first, 32);
+			write_bits(coder, m.second, 32);
+		}
+		coder.finish();
+
+		out.clear();
+		static const uint8_t Magic[4] = {'P', 'M', 'W', '2'};
+		out.assign(Magic, Magic + 4);
+		put(out, uint32_t(words.size()));
+		put(out, uint32_t(text.size()));
+		put(out, hash(text));
+		out.emplace_back(final_newline ? 1 : 0);
+		out.emplace_back(alphabet.size());
+		out.insert(out.end(), alphabet.begin(), alphabet.end());
+		put(out, uint32_t(shared_count));
+		put(out, uint32_t(dawg.states.size()));
+		put(out, uint32_t(dawg.edges.size()));
+		put(out, uint32_t(moves.size()));
+		put(out, uint32_t(coder.output.size()));
+		out.insert(out.end(), coder.output.begin(), coder.output.end());
+
+		//make sure it comes back:
+		std::string check;
+		if (!decode(out, check) || check != text) return fail("text did not survive a round trip");
+		return true;
+	}
+
+	//everything in a .pmw short of the text itself:
+	struct Contents {
+		uint32_t word_count = 0;
+		uint32_t byte_count = 0;
+		uint64_t text_hash = 0;
+		uint8_t flags = 0;
+		//states [0, dawg.registered) are the shared nodes by id, then dawg.root, then
+		// inline nodes in preorder; 'src' isn't stored, and 'id' is None for inline nodes:
+		DAWG dawg;
+		std::vector< std::pair< uint32_t, uint32_t > > moves; //(position in text, index in sorted order)
+	};
+
+	//just the DAWG (and what's needed to check the text against); for loaders that
+	// want the word list's structure rather than its text (e.g. trie.hpp):
+	static bool decode_dawg(std::vector< uint8_t > const &in, Contents &contents) {
+		struct Build {
+			DAWG &dawg;
+			void begin(Contents const &, uint32_t shared_count, uint32_t state_count, uint32_t edge_count) {
+				dawg.states.assign(state_count, DAWG::State{'\0', false, DAWG::None, 0, 0});
+				for (uint32_t s = 0; s < shared_count; ++s) {
+					dawg.states[s].id = s;
+				}
+				dawg.edges.assign(edge_count, DAWG::Edge{'\0', 0});
+				dawg.registered = shared_count;
+				dawg.root = shared_count;
+			}
+			bool node(uint32_t s, uint32_t, bool terminal, uint32_t first_edge, uint32_t edge_count) {
+				dawg.states[s].terminal = terminal;
+				dawg.states[s].first_edge = first_edge;
+				dawg.states[s].edge_count = edge_count;
+				return true;
+			}
+			bool edge(uint32_t e, uint32_t, uint8_t letter, uint32_t to) {
+				dawg.edges[e].letter = char(letter);
+				dawg.edges[e].to = to;
+				return true;
+			}
+			bool end(uint32_t) { return true; }
+		} build{contents.dawg};
+		return decode_nodes(in, contents, build);
+	}
+
+	//returns false if 'in' isn't a (complete, undamaged) .pmw:
+	static bool decode(std::vector< uint8_t > const &in, std::string &text) {
+		//spell out the words in sorted order, straight into 'text', as the nodes are
+		// decoded. A shared node's words are spelled under its first reference (which is
+		// where it's stored); each later reference copies them (less the prefix they had)
+		// behind its own prefix, so the work follows the DAWG rather than the whole trie:
+		struct Spell {
+			std::string &text;
+			uint32_t shared_count = 0;
+			uint32_t word_count = 0;
+			char *base = nullptr, *out = nullptr;
+			char const *out_end = nullptr;
+			uint32_t words = 0;
+			std::vector< uint32_t > starts; //where each word starts in 'text'
+			std::vector< char > word = std::vector< char >(32 + 16); //letters along the walk (and slack)
+			//shared node s's words are [first_word[s], end_word[s]), ending at end[s] in
+			// 'text', and begin with the first first_depth[s] letters of the walk:
+			enum : uint32_t { Unspelled = -1U };
+			std::vector< uint32_t > first_word, end_word, first_depth, end_at;
+			Spell(std::string &text_) : text(text_) { }
+
+			//(a final newline, which might go, and 16 bytes of slack; see copy())
+			void begin(Contents const &contents, uint32_t shared_count_, uint32_t, uint32_t) {
+				word_count = contents.word_count;
+				starts.assign(word_count + 1, 0);
+				text.assign(size_t(contents.byte_count) + 1 + 16, '\0');
+				base = out = &text[0];
+				out_end = base + contents.byte_count + 1;
+				shared_count = shared_count_;
+				first_word.assign(shared_count, 0);
+				end_word.assign(shared_count, Unspelled);
+				first_depth.assign(shared_count, 0);
+				end_at.assign(shared_count, 0);
+			}
+			//(words are short, so they're copied 16 bytes at a time, a word usually being one copy)
+			static void copy(char *to, char const *from, uint32_t length) {
+				for (uint32_t i = 0; i < length; i += 16) {
+					std::memmove(to + i, from + i, 16);
+				}
+			}
+			bool node(uint32_t s, uint32_t depth, bool terminal, uint32_t, uint32_t) {
+				if (s < shared_count) {
+					first_word[s] = words;
+					first_depth[s] = depth;
+				}
+				if (!terminal) return true;
+				if (words == word_count || out + depth + 1 > out_end) return false;
+				starts[words++] = out - base;
+				copy(out, word.data(), depth);
+				out[depth] = '\n';
+				out += depth + 1;
+				return true;
+			}
+			bool edge(uint32_t, uint32_t depth, uint8_t letter, uint32_t to) {
+				if (depth > uint32_t(out_end - base)) return false;
+				if (word.size() < depth + 16) word.resize(depth + 32);
+				word[depth - 1] = char(letter);
+				if (to >= shared_count || end_word[to] == Unspelled) return true; //(its node comes next)
+				//(all in locals, since the stores through 'out' could otherwise be to any
+				// of them, as far as the compiler knows)
+				uint32_t count = end_word[to] - first_word[to];
+				uint32_t const *from_starts = starts.data() + first_word[to];
+				uint32_t skip = first_depth[to], last_end = end_at[to];
+				char const *prefix = word.data();
+				char *at = out;
+				int64_t size = int64_t(last_end) - from_starts[0] + int64_t(count) * (int64_t(depth) - skip);
+				if (count > word_count - words || size > out_end - at) return false;
+				uint32_t *to_starts = starts.data() + words;
+				for (uint32_t i = 0; i < count; ++i) {
+					uint32_t from = from_starts[i] + skip;
+					uint32_t length = (i + 1 < count ? from_starts[i + 1] : last_end) - from;
+					to_starts[i] = at - base;
+					copy(at, prefix, depth);
+					copy(at + depth, base + from, length);
+					at += depth + length;
+				}
+				out = at;
+				words += count;
+				return true;
+			}
+			bool end(uint32_t s) {
+				if (s < shared_count) {
+					end_word[s] = words;
+					end_at[s] = out - base;
+				}
+				return true;
+			}
+		} spell(text);
+		Contents contents;
+		if (!decode_nodes(in, contents, spell) || spell.words != contents.word_count) return false;
+		std::vector< uint32_t > &starts = spell.starts;
+		starts.back() = spell.out - spell.base;
+		const uint32_t byte_count = contents.byte_count;
+		//(every word was spelled with a newline, so there's one too many unless the text ends with one)
+		if (starts.back() != uint64_t(byte_count) + ((contents.flags & 1) || contents.word_count == 0 ? 0 : 1)) return false;
+
+		if (!contents.moves.empty() && !unmove(contents.moves, starts, text)) return false;
+		text.resize(byte_count);
+		return hash(text) == contents.text_hash;
+	}
+
+	//the header's text hash: FNV-1a, but over 8-byte words (then the bytes left over),
+	// since this runs over the whole text (loaders use it to tell if a .pmw is current):
+	static uint64_t hash(char const *text, size_t size) {
+		uint64_t h = 14695981039346656037ULL;
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			uint64_t word;
+			std::memcpy(&word, text + i, 8);
+			h = (h ^ word) * 1099511628211ULL;
+		}
+		for (; i < size; ++i) {
+			h = (h ^ uint8_t(text[i])) * 1099511628211ULL;
+		}
+		return h;
+	}
+	static uint64_t hash(std::string const &text) {
+		return hash(text.data(), text.size());
+	}
+
+private:
+	//reads the header into 'contents' (all but the DAWG) and tells 'visit' what the
+	// payload holds, in the order it's decoded (stopping if 'visit' returns false):
+	// - begin(contents, shared count, state count, edge count), once the header checks out;
+	// - node(s, depth, terminal, first edge, edge count) for each node, numbered as in
+	//   Contents::dawg, with its edges to come (in order) at [first edge, + count);
+	// - edge(e, depth, letter, to) for each edge, depth being that of 'to'; if 'to' is
+	//   new (inline, or a shared node's first reference) its node() comes next;
+	// - end(s) once all of node s's edges (and what's below them) have been.
+	//The nodes come in preorder from the root, so every shared node is done (has had
+	// its end()) before any later reference to it, and there are no cycles.
+	template< typename Visitor >
+	static bool decode_nodes(std::vector< uint8_t > const &in, Contents &contents, Visitor &visit) {
+		size_t at = 0;
+		auto get = [&](void *dst, size_t size) {
+			if (at + size > in.size()) return false;
+			std::memcpy(dst, in.data() + at, size);
+			at += size;
+			return true;
+		};
+		char magic[4];
+		uint32_t shared_count, state_count, edge_count, move_count, payload_size;
+		uint8_t alphabet_size;
+		if (!get(magic, 4) || std::memcmp(magic, "PMW2", 4) != 0) return false;
+		if (!get(&contents.word_count, 4) || !get(&contents.byte_count, 4) || !get(&contents.text_hash, 8)) return false;
+		if (!get(&contents.flags, 1) || !get(&alphabet_size, 1)) return false;
+		std::vector< uint8_t > alphabet(alphabet_size);
+		if (!get(alphabet.data(), alphabet_size)) return false;
+		if (!get(&shared_count, 4) || !get(&state_count, 4) || !get(&edge_count, 4)) return false;
+		if (!get(&move_count, 4) || !get(&payload_size, 4)) return false;
+		if (at + payload_size != in.size()) return false;
+		//(every edge is a letter of the text, and every state but the root ends an edge)
+		if (edge_count > contents.byte_count || state_count > edge_count + 1 || shared_count >= state_count) return false;
+		if (move_count > contents.word_count) return false;
+
+		visit.begin(contents, shared_count, state_count, edge_count);
+
+		Models models(alphabet_size);
+		AnsDecoder decoder(in.data() + at, in.data() + in.size());
+		{ //the static models:
+			//(the last frequency of each is whatever is left)
+			auto read_freqs = [&](std::vector< uint32_t > &freqs, StaticModel const *lengths) {
+				uint32_t left = StaticModel::Total;
+				for (uint32_t v = 0; v + 1 < freqs.size(); ++v) {
+					if (lengths) {
+						uint32_t b = decoder.read(*lengths);
+						freqs[v] = (b == 0 ? 0 : (1U << (b - 1)) | read_bits(decoder, b - 1));
+					} else {
+						freqs[v] = read_bits(decoder, StaticModel::Bits + 1);
+					}
+					if (freqs[v] > left) return false;
+					left -= freqs[v];
+				}
+				freqs.back() = left;
+				return true;
+			};
+			StaticModel lengths(StaticModel::Bits + 2);
+			std::vector< uint32_t > freqs(lengths.size());
+			if (!read_freqs(freqs, nullptr)) return false;
+			lengths.set(freqs);
+			for (auto &model : models.all) {
+				if (!decoder.read_bits(1)) continue;
+				freqs.assign(model.size(), 0);
+				if (!read_freqs(freqs, &lengths)) return false;
+				model.set(freqs);
+			}
+		}
+		//the nodes in preorder (with a stack, rather than recursing as encode() does):
+		struct Open {
+			uint32_t next_edge, end_edge;
+			uint32_t prev; //letter of the previous sibling
+			uint32_t node;
+		};
+		std::vector< Open > stack;
+		std::vector< bool > done(shared_count, false); //(an id may only be used again once done)
+		StaticModel const *all = models.all.data();
+		uint32_t defined = 0, used_states = shared_count + 1, used_edges = 0;
+		//(the node to read next, if any, its depth and the letter into it; reading nodes
+		// in the loop rather than a helper keeps the decoder's state in registers)
+		uint32_t s = shared_count, depth = 0, context = alphabet_size;
+		while (true) {
+			if (s != -1U) {
+				uint32_t node = decoder.read(all[models.node(context)]);
+				uint32_t count = node / 2;
+				if (count > edge_count - used_edges) return false;
+				if (!visit.node(s, depth, (node & 1) != 0, used_edges, count)) return false;
+				stack.emplace_back(Open{used_edges, used_edges + count, alphabet_size, s});
+				used_edges += count;
+				s = -1U;
+			}
+			if (stack.empty()) break;
+			Open &top = stack.back();
+			if (top.next_edge == top.end_edge) {
+				uint32_t node = top.node;
+				stack.pop_back();
+				if (node < shared_count) done[node] = true;
+				if (!visit.end(node)) return false;
+				continue;
+			}
+			uint32_t e = top.next_edge++;
+			depth = stack.size();
+			uint32_t value = decoder.read(all[models.edge(top.prev)]);
+			uint32_t letter = value / 3, kind = value % 3;
+			if (letter >= alphabet_size) return false;
+			top.prev = letter;
+			uint32_t to;
+			if (kind == Models::Again) {
+				uint32_t low_bits;
+				uint64_t id = Models::id_from_head(decoder.read(all[models.id()]), &low_bits);
+				//(reading no bits is a no-op, and cheaper than a branch on whether there are any)
+				uint32_t low = (low_bits <= 16 ? decoder.read_bits(low_bits) : read_bits(decoder, low_bits));
+				id = (((id + 1) << low_bits) | low) - 1;
+				if (id >= defined || !done[id]) return false;
+				to = uint32_t(id);
+			} else {
+				if (kind == Models::First ? defined == shared_count : used_states == state_count) return false;
+				to = (kind == Models::First ? defined++ : used_states++);
+				s = to;
+				context = letter;
+			}
+			if (!visit.edge(e, depth, alphabet[letter], to)) return false;
+		}
+		if (defined != shared_count || used_states != state_count || used_edges != edge_count) return false;
+		contents.moves.resize(move_count);
+		for (auto &m : contents.moves) {
+			m.first = read_bits(decoder, 32);
+			m.second = read_bits(decoder, 32);
+		}
+		return true;
+	}
+
+	//the static models, split by context ('A' is the alphabet size, which also stands for "none"):
+	struct Models {
+		enum : uint32_t {
+			High = 5, //bits of an id kept in its head
+			Small = (1 << High) - 1, //ids below this are their own heads
+			Heads = Small + (32 - High) * (1 << High),
+		};
+		//how the node an edge leads to is stored: written out right there (Inline, or
+		// First for a shared node, which gets the next id), or just its id (Again):
+		enum Kind : uint32_t { Inline, First, Again };
+		Models(uint32_t A_) : A(A_) {
+			for (uint32_t i = 0; i <= A; ++i) {
+				all.emplace_back(2 * A + 2);
+			}
+			for (uint32_t i = 0; i <= A; ++i) {
+				all.emplace_back(3 * std::max(1U, A));
+			}
+			all.emplace_back(Heads);
+		}
+		uint32_t A;
+		std::vector< StaticModel > all;
+		uint32_t node(uint32_t context) const { return context; } //2 * children + terminal, by letter into the node
+		uint32_t edge(uint32_t context) const { return A + 1 + context; } //3 * letter + Kind, by previous sibling's letter
+		uint32_t id() const { return 2 * A + 2; } //shared id's head
+
+		//a shared id's head is the id itself if it is small, otherwise the bit length
+		// of id + 1 with the High bits after its leading one; the rest go raw:
+		static uint32_t id_head(uint32_t id, uint32_t *low_bits) {
+			*low_bits = 0;
+			if (id < Small) return id;
+			uint64_t v = uint64_t(id) + 1;
+			uint32_t b = 0;
+			while ((v >> (b + 1)) != 0) ++b;
+			*low_bits = b - High;
+			return Small + (b - High) * (1 << High) + (uint32_t(v >> *low_bits) & ((1 << High) - 1));
+		}
+		//(the id, less its low bits, which still need to be shifted in after id + 1)
+		static uint32_t id_from_head(uint32_t head, uint32_t *low_bits) {
+			*low_bits = 0;
+			if (head < Small) return head;
+			uint32_t b = High + (head - Small) / (1 << High);
+			*low_bits = b - High;
+			return ((1U << High) | ((head - Small) % (1 << High))) - 1;
+		}
+	};
+
+	static uint32_t bit_length(uint32_t v) {
+		uint32_t b = 0;
+		while ((v >> b) != 0) ++b;
+		return b;
+	}
+
+	//put the moved words back where they were, in 'text' (the words spelled in sorted
+	// order, at 'starts'). The words that stayed in order move in runs: the runs moving
+	// left first, left to right, then those moving right, right to left, so none lands
+	// on one that hasn't moved yet. The moved words go by way of a buffer of their own:
+	static bool unmove(std::vector< std::pair< uint32_t, uint32_t > > const &moves, std::vector< uint32_t > const &starts, std::string &text) {
+		const uint32_t word_count = starts.size() - 1;
+		std::vector< uint32_t > moved;
+		moved.reserve(moves.size());
+		for (uint32_t i = 0; i < moves.size(); ++i) {
+			if (moves[i].first >= word_count || moves[i].second >= word_count) return false;
+			if (i > 0 && moves[i].first <= moves[i - 1].first) return false;
+			moved.emplace_back(moves[i].second);
+		}
+		std::sort(moved.begin(), moved.end());
+		if (std::adjacent_find(moved.begin(), moved.end()) != moved.end()) return false;
+
+		//the text in its final order, as pieces of the sorted text (runs of words that
+		// stayed in order, or single moved words):
+		struct Piece {
+			uint32_t from, to, size; //(bytes)
+			bool moved;
+		};
+		std::vector< Piece > pieces;
+		uint32_t at = 0;
+		auto piece = [&](uint32_t begin, uint32_t end, bool moved_) {
+			uint32_t size = starts[end] - starts[begin];
+			pieces.emplace_back(Piece{starts[begin], at, size, moved_});
+			at += size;
+		};
+		uint32_t next_sorted = 0;
+		auto skip = moved.begin();
+		//(the next 'count' words that stayed in sorted order)
+		auto take = [&](uint32_t count) {
+			while (count > 0) {
+				while (skip != moved.end() && *skip == next_sorted) {
+					++next_sorted;
+					++skip;
+				}
+				uint32_t run_end = std::min(next_sorted + count, skip == moved.end() ? word_count : *skip);
+				if (run_end <= next_sorted) return false;
+				piece(next_sorted, run_end, false);
+				count -= run_end - next_sorted;
+				next_sorted = run_end;
+			}
+			return true;
+		};
+		uint32_t position = 0;
+		for (auto const &m : moves) {
+			if (!take(m.first - position)) return false;
+			piece(m.second, m.second + 1, true);
+			position = m.first + 1;
+		}
+		if (!take(word_count - position)) return false;
+
+		std::string aside;
+		for (auto const &p : pieces) {
+			if (p.moved) aside.append(text, p.from, p.size);
+		}
+		char *base = &text[0];
+		for (auto const &p : pieces) {
+			if (!p.moved && p.to <= p.from) std::memmove(base + p.to, base + p.from, p.size);
+		}
+		for (auto p = pieces.rbegin(); p != pieces.rend(); ++p) {
+			if (!p->moved && p->to > p->from) std::memmove(base + p->to, base + p->from, p->size);
+		}
+		size_t next = 0;
+		for (auto const &p : pieces) {
+			if (!p.moved) continue;
+			std::memcpy(base + p.to, aside.data() + next, p.size);
+			next += p.size;
+		}
+		return true;
+	}
+
+	//(up to 32 bits, in chunks of at most 16)
+	static void write_bits(AnsCoder &coder, uint32_t v, uint32_t bits) {
+		while (bits > 0) {
+			uint32_t chunk = std::min(bits, 16U);
+			bits -= chunk;
+			coder.write_bits(v >> bits, chunk);
+		}
+	}
+	static uint32_t read_bits(AnsDecoder &decoder, uint32_t bits) {
+		uint32_t v = 0;
+		while (bits > 0) {
+			uint32_t chunk = std::min(bits, 16U);
+			bits -= chunk;
+			v = (v << chunk) | decoder.read_bits(chunk);
+		}
+		return v;
+	}
+
+	template< typename T >
+	static void put(std::vector< uint8_t > &out, T val) {
+		uint8_t bytes[sizeof(T)];
+		std::memcpy(bytes, &val, sizeof(T));
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+};
@@ -11,162 +11,60 @@
 #include <algorithm>
 #include <chrono>
 #include "stopwatch.hpp"
-
-
-class Node : public std::map< char, Node * > {
-public:
-	Node *rewind = nullptr;
-	uint32_t index = -1U;
-	bool terminal = false;
-	bool maximal = false; //terminal that isn't a substring
-
-	uint32_t depth = 0;
-
-	//------ DEBUG ------
-	Node *parent = nullptr;
-	std::string prefix() const {
-		if (!parent) return "";
-		for (auto cn : *parent) {
-			if (cn.second == this) return parent->prefix() + cn.first;
-		}
-		assert(0 && "parent pointer should be correct, y'know.");
-	}
-};
+#include "trie.hpp"
 
 
 void build_tree() {
-	Node root;
-	Node *start = nullptr;
-
-	//initial tree:
-	std::ifstream wordlist("wordlist.asc");
-	std::string word;
-	while (std::getline(wordlist, word)) {
-		Node *at = &root;
-		for (auto c : word) {
-			auto f = at->insert(std::make_pair(c, nullptr)).first;
-			if (f->second == NULL) {
-				f->second = new Node();
-				f->second->parent = at;
-				f->second->depth = f->second->parent->depth + 1;
-			}
-			at = f->second;
-		}
-		assert(at);
-		assert(at->terminal == false);
-		at->terminal = true;
-		if (word == "portmanteau") {
-			start = at;
-		}
-	}
-	assert(start);
-
-	//set rewind pointers:
-	{
-		std::vector< Node * > layer;
-		layer.push_back(&root);
-		while (!layer.empty()) {
-			std::vector< Node * > next_layer;
-			for (auto n : layer) {
-				//update rewind pointers for children based on current rewind pointer.
-				for (auto cn : *n) {
-					next_layer.emplace_back(cn.second);
-
-					//rewind:
-					Node *r = n->rewind;
-					while (r != nullptr) {
-						assert(r != nullptr);
-						auto f = r->find(cn.first);
-						if (f != r->end()) {
-							//great, can extend this rewind:
-							r = f->second;
-							break;
-						} else {
-							//have to rewind further:
-							r = r->rewind;
-						}
-					}
-					assert(n == &root || r != nullptr); //for everything but the root, rewind should always hit root and bounce down
-					if (r == nullptr) r = &root;
-					cn.second->rewind = r;
-				}
-			}
-			layer = next_layer;
-		}
+	//trie with rewind pointers (from wordlist.asc, or wordlist.pmw if there is no text):
+	Trie trie;
+	if (!trie.load("wordlist")) {
+		std::cerr << "Failed to load word list." << std::endl;
+		exit(1);
 	}
+	const uint32_t root = 0;
+	const uint32_t start = trie.find("portmanteau");
+	assert(start != Trie::None && trie.terminal[start]);
 
 	{ //dump some info about the tree:
-		uint32_t nodes = 0;
-		uint32_t edges = 0;
 		uint32_t rewinds = 0;
 		uint32_t terminal = 0;
 		uint32_t steps = 0;
-		std::function< void(Node *) > count = [&](Node *n) {
-			nodes += 1;
-			if (n->rewind) rewinds += 1;
-			if (n->terminal) terminal += 1;
-			for (auto &c : *n) {
-				steps += 1;
-				edges += 1;
-				if (c.first != '\0') {
-					count(c.second);
-				}
-			}
+		for (uint32_t n = 0; n < trie.size(); ++n) {
+			if (trie.rewind[n] != Trie::None) rewinds += 1;
+			steps += trie.children(n);
 			//add valid next steps from rewind pointers:
-			if (n->terminal) {
-				for (Node *r = n->rewind; r != &root; r = r->rewind) {
-					assert(r);
-					steps += r->size();
+			if (trie.terminal[n]) {
+				terminal += 1;
+				for (uint32_t r = trie.rewind[n]; r != root; r = trie.rewind[r]) {
+					assert(r != Trie::None);
+					steps += trie.children(r);
 				}
 			}
-		};
-		count(&root);
-		std::cout << "Built tree with " << nodes << " nodes and " << edges << " edges." << std::endl;
+		}
+		std::cout << "Built tree with " << trie.size() << " nodes and " << trie.child.size() << " edges." << std::endl;
 		std::cout << "Have " << terminal << " terminal nodes." << std::endl;
 		std::cout << "Have " << rewinds << " rewind pointers." << std::endl;
 		std::cout << "Have " << steps << " 'next step' edges (includes rewinds at terminals)." << std::endl;
 	}
 
-	//set indices:
-	std::vector< Node * > nodes;
-	uint32_t adjacencies = 0;
-	{
-		std::function< void(Node *) > index = [&](Node *n) {
-			n->index = nodes.size();
-			nodes.emplace_back(n);
-
-			adjacencies += n->size();
-			//add valid next steps from rewind pointers:
-			if (n->terminal) {
-				for (Node *r = n->rewind; r != &root; r = r->rewind) {
-					assert(r);
-					adjacencies += r->size();
-				}
-			}
-			for (auto cn : *n) {
-				index(cn.second);
-			}
-		};
-		index(&root);
-	}
-
-	for (auto n : nodes) {
-		if (n->terminal && n->size() == 0) n->maximal = true;
+	std::vector< bool > wanted(trie.size(), false); //maximal words (terminals that aren't substrings)
+	for (uint32_t n = 0; n < trie.size(); ++n) {
+		if (trie.terminal[n] && trie.children(n) == 0) wanted[n] = true;
 	}
 	{
 		uint32_t maximal = 0;
-		for (auto n : nodes) {
-			if (n->maximal) ++maximal;
+		for (auto w : wanted) {
+			if (w) ++maximal;
 		}
 		std::cout << "Have " << maximal << " maximal words based on child counting." << std::endl;
 	}
-	for (auto n : nodes) {
-		if (n->rewind) n->rewind->maximal = false;
+	for (uint32_t n = 0; n < trie.size(); ++n) {
+		if (trie.rewind[n] != Trie::None) wanted[trie.rewind[n]] = false;
 	}
 	{
 		uint32_t maximal = 0;
-		for (auto n : nodes) {
-			if (n->maximal) ++maximal;
+		for (auto w : wanted) {
+			if (w) ++maximal;
 		}
 		std::cout << "Have " << maximal << " maximal words after rewind culling." << std::endl;
 	}
@@ -184,32 +82,34 @@ void build_tree() {
 	std::vector< uint32_t > adj;
 	std::vector< char > adj_char;
 
+	adj_start.reserve(trie.size() + 1);
 
-	adj_start.reserve(nodes.size() + 1);
-	adj.reserve(adjacencies);
-	adj_char.reserve(adjacencies);
-
-	for (auto const &n : nodes) {
-		assert(&n - &nodes[0] == n->index);
+	std::vector< std::pair< char, uint32_t > > valid;
+	for (uint32_t n = 0; n < trie.size(); ++n) {
 		adj_start.emplace_back(adj.size());
-		std::vector< std::pair< char, Node * > > valid(n->begin(), n->end());
-		if (n->terminal) {
-			for (Node *r = n->rewind; r != &root; r = r->rewind) {
-				assert(r);
-				valid.insert(valid.end(), r->begin(), r->end());
+		valid.clear();
+		auto add = [&](uint32_t m) {
+			for (uint32_t c = trie.child_start[m]; c < trie.child_start[m+1]; ++c) {
+				valid.emplace_back(trie.child_char[c], trie.child[c]);
+			}
+		};
+		add(n);
+		if (trie.terminal[n]) {
+			for (uint32_t r = trie.rewind[n]; r != root; r = trie.rewind[r]) {
+				assert(r != Trie::None);
+				add(r);
 			}
 		}
-		std::stable_sort(valid.begin(), valid.end());
+		std::sort(valid.begin(), valid.end());
 		for (auto v : valid) {
-			adj.emplace_back(v.second->index);
+			adj.emplace_back(v.second);
 			adj_char.emplace_back(v.first);
 		}
 	}
 	adj_start.emplace_back(adj.size());
 
-	assert(adj.size() == adjacencies);
-	assert(adj_char.size() == adjacencies);
-	assert(adj_start.size() == nodes.size() + 1);
+	assert(adj_char.size() == adj.size());
+	assert(adj_start.size() == trie.size() + 1);
 
 	/* possible optimization
 	std::vector< uint32_t > inv_adj_start;
@@ -221,38 +121,25 @@ void build_tree() {
 
 	std::cout << "Built " << adj.size() << "-entry adjacency list." << std::endl;
 
-	std::vector< uint8_t > depth;
-	depth.reserve(nodes.size());
-	std::vector< bool > wanted;
-	wanted.reserve(nodes.size());
-	std::vector< bool > terminal;
-	terminal.reserve(nodes.size());
-	for (uint32_t i = 0; i < nodes.size(); ++i) {
-		assert(nodes[i]->index == i);
-		depth.emplace_back(nodes[i]->depth);
-		terminal.emplace_back(nodes[i]->terminal);
-		wanted.emplace_back(nodes[i]->maximal);
-	}
-	assert(terminal.size() == nodes.size());
-	assert(wanted.size() == nodes.size());
+	std::vector< uint8_t > const &depth = trie.depth;
 
 /*
 	stopwatch("before bfs");
 	uint32_t max_terminal_distance = 0;
-	for (uint32_t seed = 0; seed < nodes.size(); ++seed) {
+	for (uint32_t seed = 0; seed < trie.size(); ++seed) {
 		if (!(seed == 0 || wanted[seed])) continue;
-		std::vector< bool > visited(nodes.size(), false);
-		std::vector< uint8_t > distance(nodes.size(), 0xff);
+		std::vector< bool > visited(trie.size(), false);
+		std::vector< uint8_t > distance(trie.size(), 0xff);
 		std::vector< uint32_t > ply;
 		ply.emplace_back(seed);
 		visited[seed] = true;
 		uint32_t dis = 0;
 		while (!ply.empty()) {
 			std::vector< uint32_t > next_ply;
-			//next_ply.reserve(nodes.size()); //maybe?
+			//next_ply.reserve(trie.size()); //maybe?
 			for (auto i : ply) {
 				distance[i] = dis;
-				if (terminal[i]) {
+				if (trie.terminal[i]) {
 					max_terminal_distance = std::max(max_terminal_distance, dis);
 				}
 				for (uint32_t a = adj_start[i]; a < adj_start[i+1]; ++a) {
@@ -270,7 +157,7 @@ void build_tree() {
 		step += 1;
 		if (step == 500) {
 			stopwatch("bfs * 500");
-			std::cout << seed << " / " << nodes.size()
+			std::cout << seed << " / " << trie.size()
 				<< " -- longest path so far: " << max_terminal_distance << "."
 				<< std::endl;
 			step = 0;
@@ -297,9 +184,9 @@ void build_tree() {
 		assert(path.wanted_remain > 0);
 		assert(!path.wanted[path.at]);
 
-		std::vector< uint32_t > from(nodes.size(), -1U);
-		std::vector< uint8_t > sum(nodes.size(), 0);
-		std::vector< uint8_t > length(nodes.size(), 0xff);
+		std::vector< uint32_t > from(trie.size(), -1U);
+		std::vector< uint8_t > sum(trie.size(), 0);
+		std::vector< uint8_t > length(trie.size(), 0xff);
 		std::vector< uint32_t > ply;
 
 		ply.emplace_back(path.at);
@@ -329,17 +216,17 @@ void build_tree() {
 		}
 
 		{ //DEBUG:
-			/*std::cout << "At: " << nodes[path.at]->prefix() << std::endl;
+			/*std::cout << "At: " << trie.prefix(path.at) << std::endl;
 			{
-				if (nodes[path.at]->terminal) {
-					Node *r = nodes[path.at]->rewind;
-					while (r != &root) {
-						std::cout << "  rewinds to " << r->prefix() << " (" << r->index << ") { ";
-						for (auto cn : *r) {
-							std::cout << cn.first << " ";
+				if (trie.terminal[path.at]) {
+					uint32_t r = trie.rewind[path.at];
+					while (r != root) {
+						std::cout << "  rewinds to " << trie.prefix(r) << " (" << r << ") { ";
+						for (uint32_t c = trie.child_start[r]; c < trie.child_start[r+1]; ++c) {
+							std::cout << trie.child_char[c] << " ";
 						}
 						std::cout << "}" << std::endl;
-						r = r->rewind;
+						r = trie.rewind[r];
 					}
 				} else {
 					std::cout << "  (not terminal)" << std::endl;
@@ -348,11 +235,11 @@ void build_tree() {
 
 			bool unreach = false;
 
-			for (uint32_t i = 0; i < nodes.size(); ++i) {
+			for (uint32_t i = 0; i < trie.size(); ++i) {
 				if (from[i] == -1U) {
-					if (nodes[i]->maximal) {
+					if (wanted[i]) {
 						unreach = true;
-						std::cout << "Can't reach '" << nodes[i]->prefix() << "' (" << i << ") from '" << nodes[path.at]->prefix() << "'" << std::endl;
+						std::cout << "Can't reach '" << trie.prefix(i) << "' (" << i << ") from '" << trie.prefix(path.at) << "'" << std::endl;
 					}
 				}
 			}
@@ -365,7 +252,7 @@ void build_tree() {
 		{
 			int32_t best_savings = std::numeric_limits< int32_t >::min();
 			std::vector< uint32_t > best;
-			for (uint32_t i = 0; i < nodes.size(); ++i) {
+			for (uint32_t i = 0; i < trie.size(); ++i) {
 				if (path.wanted[i]) {
 					assert(from[i] != -1U); //everything is reachable
 	
@@ -398,13 +285,13 @@ void build_tree() {
 				selected = p.second;
 			}
 		}
-		if (selected >= nodes.size()) {
+		if (selected >= trie.size()) {
 			std::cout << "Failed to sample properly; have " << sample << " leftover." << std::endl;
 			selected = possible.back().second;
 		}
 		*/
 
-		assert(selected < nodes.size());
+		assert(selected < trie.size());
 		assert(path.wanted[selected]);
 
 		//read back:
@@ -446,9 +333,9 @@ void build_tree() {
 		Path origin;
 		origin.wanted = wanted;
 
-		origin.so_far = start->prefix();
-		origin.at = start->index;
-		origin.wanted[start->index] = false; //not needed, it turns out
+		origin.so_far = trie.prefix(start);
+		origin.at = start;
+		origin.wanted[start] = false; //not needed, it turns out
 
 		origin.wanted_remain = 0;
 		for (auto w : origin.wanted) {
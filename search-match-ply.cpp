@@ -6,6 +6,7 @@
 
 #include "graph.hpp"
 #include "stopwatch.hpp"
+#include "distances.hpp"
 
 
 int main(int argc, char **argv) {
@@ -53,13 +54,17 @@ int main(int argc, char **argv) {
 	}
 	assert(start != -1U);
 
-	std::unique_ptr< uint8_t[] > distances(new uint8_t[maximal.size() * maximal.size()]);
+	Distances distances;
+	if (!distances.map("distances.table", maximal.size())) {
+		std::cerr << "failed to map distance table." << std::endl;
+		return 1;
+	}
 
-	
-	std::ifstream in("distances.table");
-	if (!in.read(reinterpret_cast< char * >(distances.get()), maximal.size() * maximal.size())) {
-		std::cerr << "failed to read distance table." << std::endl;
-		return false;
+	//cheapest successors first (from build-knn), full rows of the table only when those run out:
+	Successors successors;
+	bool sparse = successors.read("successors.table", graph.hash(), maximal.size());
+	if (!sparse) {
+		std::cout << "No (or stale) successors.table; using the full distance table." << std::endl;
 	}
 
 	stopwatch("read distances");
@@ -84,30 +89,72 @@ int main(int argc, char **argv) {
 
 			std::vector< std::pair< uint32_t, uint32_t > > next_particles;
 			std::vector< bool > used(particles.size(), false);
+			std::vector< uint32_t > starts(maximal.size(), -1U);
+			for (uint32_t p = 0; p < particles.size(); ++p) {
+				starts[particles[p].first] = p;
+			}
+			uint32_t dense_rows = 0;
 			while (1) {
 				std::vector< std::pair< uint32_t, uint32_t > > best;
 				int32_t best_cost = std::numeric_limits< int32_t >::max();
-				for (auto const &p1 : particles) {
-					if (used[&p1 - &particles[0]]) continue;
-					for (auto const &p2 : particles) {
-						if (&p2 == &p1) continue;
-						if (used[&p2 - &particles[0]]) continue;
-						if (p2.first == start) continue; //can't merge with start symbol, no matter how much one might wish to
+				std::vector< uint32_t > tied;
+				for (uint32_t p1 = 0; p1 < particles.size(); ++p1) {
+					if (used[p1]) continue;
+					uint32_t end = particles[p1].second;
+					if (sparse) {
+						//walk the successor list (sorted by cost) for the cheapest unused particles:
+						tied.clear();
+						int32_t p1_best_cost = std::numeric_limits< int32_t >::max();
+						bool passed = false; //saw a costlier successor, so no ties were cut off the list
+						for (uint32_t e = successors.begin(end); e != successors.end(end); ++e) {
+							uint32_t c = successors.next[e];
+							int32_t cost = int32_t(successors.distance[e]) - int32_t(graph.depth[maximal[c]]);
+							if (cost > p1_best_cost || cost > best_cost) {
+								passed = true;
+								break;
+							}
+							uint32_t p2 = starts[c];
+							if (p2 == -1U || p2 == p1 || used[p2] || c == start) continue;
+							p1_best_cost = cost;
+							tied.emplace_back(p2);
+						}
+						if (passed || successors.complete(end)) {
+							if (!tied.empty()) {
+								if (p1_best_cost < best_cost) {
+									best_cost = p1_best_cost;
+									best.clear();
+								}
+								std::sort(tied.begin(), tied.end());
+								for (auto p2 : tied) {
+									best.emplace_back(p1, p2);
+								}
+							}
+							continue;
+						}
+						++dense_rows;
+					}
+					for (uint32_t p2 = 0; p2 < particles.size(); ++p2) {
+						if (p2 == p1) continue;
+						if (used[p2]) continue;
+						if (particles[p2].first == start) continue; //can't merge with start symbol, no matter how much one might wish to
 	
 						//p1 then p2 incurs:
-						int32_t cost = distances[p1.second * maximal.size() + p2.first];
-						cost -= int32_t(graph.depth[maximal[p2.first]]); //basically, cost is -overlap
+						int32_t cost = distances(end, particles[p2].first);
+						cost -= int32_t(graph.depth[maximal[particles[p2].first]]); //basically, cost is -overlap
 
 						if (cost < best_cost) {
 							best_cost = cost;
 							best.clear();
 						}
 						if (cost == best_cost) {
-							best.emplace_back(std::make_pair(&p1 - &particles[0], &p2 - &particles[0]));
+							best.emplace_back(p1, p2);
 						}
 					}
 				}
 				if (best.empty()) break;
+				if (dense_rows) {
+					std::cout << "   (" << dense_rows << " rows so far needed the full distance table)" << std::endl;
+				}
 				std::cout << "   " << best.size() << " have cost " << best_cost << std::endl;
 
 				{ //reverse?
@@ -137,7 +184,7 @@ int main(int argc, char **argv) {
 					used[b.second] = true;
 					merges.insert(std::make_pair(particles[b.first].second, particles[b.second].first));
 					next_particles.emplace_back(particles[b.first].first, particles[b.second].second);
-					total_length += distances[particles[b.first].second * maximal.size() + particles[b.second].first];
+					total_length += distances(particles[b.first].second, particles[b.second].first);
 				}
 				std::cout << "Total length so far: " << total_length << std::endl;
 			}
@@ -165,7 +212,7 @@ int main(int argc, char **argv) {
 			path.emplace_back(maximal[at]);
 			auto f = merges.find(at);
 			if (f == merges.end()) break;
-			len += distances[at * maximal.size() + f->second];
+			len += distances(at, f->second);
 			at = f->second;
 		}
 		std::cout << "Path of " << path.size() << " steps (extracted from " << merges.size() << " merges) -- len " << len << " (not counting first word)" << std::endl;
@@ -4,10 +4,15 @@
 #include <chrono>
 #include <random>
 
+#ifdef USE_BLOSSOM5
 #include "blossom5/PerfectMatching.h"
+#endif
 
 #include "graph.hpp"
 #include "stopwatch.hpp"
+#include "parallel.hpp"
+#include "hungarian.hpp"
+#include "distances.hpp"
 
 struct {
 	std::string prefix = "portmanteaux";
@@ -15,14 +20,20 @@ struct {
 	std::string order = "reverse"; //"random";
 	bool block = true;
 	uint32_t chunk = 2000;
+	uint32_t keep = 50; //cheapest edges kept per row when matching (0 == keep all)
+	std::string solver = "assignment"; //"blossom"; //"compare";
+	bool sparse = true; //use successors.table (from build-knn) when it is there
 	void describe() {
 		std::cout << "Options:\n";
 		std::cout << "\tStarting prefix: " << prefix << "\n";
 		std::cout << "\tMerge cost: " << merge << "\n";
 		std::cout << "\tMerge order: " << order << "\n";
 		std::cout << "\tBlocking: " << (block ? "yes" : "no") << "\n";
+		std::cout << "\tSuccessor lists: " << (sparse ? "yes" : "no") << "\n";
 		if (merge == "matching") {
 			std::cout << "\tMatching chunk size: " << chunk << "\n";
+			std::cout << "\tMatching edges kept per row: " << (keep ? std::to_string(keep) : "all") << "\n";
+			std::cout << "\tMatching solver: " << solver << "\n";
 		}
 	}
 } options;
@@ -44,14 +55,29 @@ int main(int argc, char **argv) {
 			options.order = value;
 		} else if (tag == "chunk:") {
 			options.chunk = std::atoi(value.c_str());
+		} else if (tag == "keep:") {
+			options.keep = std::atoi(value.c_str());
+		} else if (tag == "solver:") {
+			options.solver = value;
 		} else if (tag == "block:") {
 			options.block = (value == "true" || value == "yes" || value == "t" || value == "1" || value =="y");
+		} else if (tag == "sparse:") {
+			options.sparse = (value == "true" || value == "yes" || value == "t" || value == "1" || value =="y");
 		} else {
 			std::cerr << "Unknown tag '" << tag << "'" << std::endl;
 			return 1;
 		}
 	}
 
+#ifdef USE_BLOSSOM5
+	if (options.solver != "assignment" && options.solver != "blossom" && options.solver != "compare") {
+#else
+	if (options.solver != "assignment") {
+#endif
+		std::cerr << "Unknown (or not compiled in) solver '" << options.solver << "'" << std::endl;
+		return 1;
+	}
+
 	options.describe();
 
 	stopwatch("start");
@@ -102,13 +128,19 @@ int main(int argc, char **argv) {
 	}
 	assert(start != -1U);
 
-	std::unique_ptr< uint8_t[] > distances(new uint8_t[maximal.size() * maximal.size()]);
+	//the full table is only paged in where it is actually looked at:
+	Distances distances;
+	if (!distances.map("distances.table", maximal.size())) {
+		std::cerr << "failed to map distance table." << std::endl;
+		return 1;
+	}
 
-	
-	std::ifstream in("distances.table");
-	if (!in.read(reinterpret_cast< char * >(distances.get()), maximal.size() * maximal.size())) {
-		std::cerr << "failed to read distance table." << std::endl;
-		return false;
+	//with successor lists, the merge searches only look at each word's cheapest
+	// successors and fall back to a full row of the table when those are used up:
+	Successors successors;
+	if (options.sparse && !successors.read("successors.table", graph.hash(), maximal.size())) {
+		std::cout << "No (or stale) successors.table; using the full distance table." << std::endl;
+		options.sparse = false;
 	}
 
 	stopwatch("read distances");
@@ -134,28 +166,72 @@ int main(int argc, char **argv) {
 
 			std::vector< std::pair< uint32_t, uint32_t > > next_particles;
 
-			std::vector< std::pair< uint32_t, uint32_t > > best; //*words* to merge, not particles
-			if (options.merge == "max min") {
+			std::vector< uint32_t > starts(maximal.size(), -1U);
+			std::vector< uint32_t > ends(maximal.size(), -1U);
+			for (uint32_t p = 0; p < particles.size(); ++p) {
+				assert(particles[p].first < starts.size());
+				assert(particles[p].second < ends.size());
+				starts[particles[p].first] = p;
+				ends[particles[p].second] = p;
+			}
+
+			//cheapest particles to put after p1 (as words to merge, in particle order); returns their cost:
+			uint32_t dense_rows = 0;
+			std::vector< uint32_t > tied;
+			auto cheapest_after = [&](uint32_t p1, std::vector< std::pair< uint32_t, uint32_t > > &into) -> int32_t {
+				uint32_t end = particles[p1].second;
 				int32_t best_cost = std::numeric_limits< int32_t >::max();
-				for (auto const &p1 : particles) {
-					int32_t p1_best_cost = std::numeric_limits< int32_t >::max();
-					std::vector< std::pair< uint32_t, uint32_t > > p1_best;
-					for (auto const &p2 : particles) {
-						if (&p2 == &p1) continue;
-						if (p2.first == start) continue; //can't merge with start symbol, no matter how much one might wish to
-
-						//p1 then p2 incurs:
-						int32_t cost = distances[p1.second * maximal.size() + p2.first];
-						cost -= int32_t(graph.depth[maximal[p2.first]]); //basically, cost is -overlap
-
-						if (cost < p1_best_cost) {
-							p1_best_cost = cost;
-							p1_best.clear();
+				into.clear();
+				if (options.sparse) {
+					tied.clear();
+					bool passed = false; //saw a costlier successor, so no ties were cut off the list
+					for (uint32_t e = successors.begin(end); e != successors.end(end); ++e) {
+						uint32_t c = successors.next[e];
+						int32_t cost = int32_t(successors.distance[e]) - int32_t(graph.depth[maximal[c]]);
+						if (cost > best_cost) {
+							passed = true;
+							break;
 						}
-						if (cost == p1_best_cost) {
-							p1_best.emplace_back(p1.second, p2.first);
+						uint32_t p2 = starts[c];
+						if (p2 == -1U || p2 == p1 || c == start) continue;
+						best_cost = cost;
+						tied.emplace_back(p2);
+					}
+					if (!tied.empty() && (passed || successors.complete(end))) {
+						std::sort(tied.begin(), tied.end());
+						for (auto p2 : tied) {
+							into.emplace_back(end, particles[p2].first);
 						}
+						return best_cost;
+					}
+					best_cost = std::numeric_limits< int32_t >::max();
+					++dense_rows;
+				}
+				for (auto const &p2 : particles) {
+					if (&p2 == &particles[p1]) continue;
+					if (p2.first == start) continue; //can't merge with start symbol, no matter how much one might wish to
+
+					//p1 then p2 incurs:
+					int32_t cost = distances(end, p2.first);
+					cost -= int32_t(graph.depth[maximal[p2.first]]); //basically, cost is -overlap
+
+					if (cost < best_cost) {
+						best_cost = cost;
+						into.clear();
+					}
+					if (cost == best_cost) {
+						into.emplace_back(end, p2.first);
 					}
+				}
+				return best_cost;
+			};
+
+			std::vector< std::pair< uint32_t, uint32_t > > best; //*words* to merge, not particles
+			if (options.merge == "max min") {
+				int32_t best_cost = std::numeric_limits< int32_t >::max();
+				std::vector< std::pair< uint32_t, uint32_t > > p1_best;
+				for (uint32_t p1 = 0; p1 < particles.size(); ++p1) {
+					int32_t p1_best_cost = cheapest_after(p1, p1_best);
 					p1_best_cost = -p1_best_cost;
 					if (!p1_best.empty() && p1_best_cost < best_cost) {
 						best_cost = p1_best_cost;
@@ -167,47 +243,25 @@ int main(int argc, char **argv) {
 				}
 				std::cout << "   " << best.size() << " have cost " << best_cost << std::endl;
 			} else if (options.merge == "greedy") {
-				for (auto const &p1 : particles) {
-					int32_t p1_best_cost = std::numeric_limits< int32_t >::max();
-					std::vector< std::pair< uint32_t, uint32_t > > p1_best;
-					for (auto const &p2 : particles) {
-						if (&p2 == &p1) continue;
-						if (p2.first == start) continue; //can't merge with start symbol, no matter how much one might wish to
-
-						//p1 then p2 incurs:
-						int32_t cost = distances[p1.second * maximal.size() + p2.first];
-						cost -= int32_t(graph.depth[maximal[p2.first]]); //basically, cost is -overlap
-
-						if (cost < p1_best_cost) {
-							p1_best_cost = cost;
-							p1_best.clear();
-						}
-						if (cost == p1_best_cost) {
-							p1_best.emplace_back(p1.second, p2.first);
-						}
-					}
+				std::vector< std::pair< uint32_t, uint32_t > > p1_best;
+				for (uint32_t p1 = 0; p1 < particles.size(); ++p1) {
+					cheapest_after(p1, p1_best);
 					best.insert(best.end(), p1_best.begin(), p1_best.end());
 				}
 				std::cout << "   " << best.size() << " have optimal cost" << std::endl;
 
 			} else if (options.merge == "min" || (options.merge == "min, matching" && particles.size() > options.chunk)) {
-int32_t best_cost = std::numeric_limits< int32_t >::max();
-				for (auto const &p1 : particles) {
-					for (auto const &p2 : particles) {
-						if (&p2 == &p1) continue;
-						if (p2.first == start) continue; //can't merge with start symbol, no matter how much one might wish to
-
-						//p1 then p2 incurs:
-						int32_t cost = distances[p1.second * maximal.size() + p2.first];
-						cost -= int32_t(graph.depth[maximal[p2.first]]); //basically, cost is -overlap
-
-						if (cost < best_cost) {
-							best_cost = cost;
-							best.clear();
-						}
-						if (cost == best_cost) {
-							best.emplace_back(p1.second, p2.first);
-						}
+				int32_t best_cost = std::numeric_limits< int32_t >::max();
+				std::vector< std::pair< uint32_t, uint32_t > > p1_best;
+				for (uint32_t p1 = 0; p1 < particles.size(); ++p1) {
+					int32_t p1_best_cost = cheapest_after(p1, p1_best);
+					if (p1_best.empty()) continue;
+					if (p1_best_cost < best_cost) {
+						best_cost = p1_best_cost;
+						best.clear();
+					}
+					if (p1_best_cost == best_cost) {
+						best.insert(best.end(), p1_best.begin(), p1_best.end());
 					}
 				}
 				std::cout << "   " << best.size() << " have cost " << best_cost << std::endl;
@@ -221,52 +275,157 @@ int32_t best_cost = std::numeric_limits< int32_t >::max();
 				for (uint32_t p = 0; p < particles.size(); ++p) {
 					chunks[size_t(p) * chunks.size() / particles.size()].push_back(p);
 				}
-				for (auto const &chunk : chunks) {
-					std::cout << "  matching chunk " << &chunk - &chunks[0] << " of " << chunks.size() << std::endl; //DEBUG
-					PerfectMatching pm(chunk.size() * 2, chunk.size() * chunk.size());
-					pm.options.verbose = false;
+				//each chunk is matched independently (with its own cost buffer) on a worker thread:
+				std::vector< std::vector< std::pair< uint32_t, uint32_t > > > chunk_best(chunks.size());
+				std::vector< int64_t > chunk_cost(chunks.size(), 0);
+				std::vector< uint32_t > chunk_edges(chunks.size(), 0);
+				std::vector< std::pair< double, double > > chunk_time(chunks.size(), std::make_pair(0.0, 0.0)); //assignment, blossom seconds
+				std::vector< uint32_t > chunk_clamped(chunks.size(), 0); //edges the assignment used at a clamped weight
+				parallel_for(chunks.size(), [&](uint32_t c, uint32_t) {
+					auto const &chunk = chunks[c];
+
+					//cost-matrix-to-edges: compute one row of costs at a time and keep only the cheap ones:
+					struct Edge {
+						uint32_t i1, i2;
+						int32_t cost;
+					};
+					std::vector< Edge > edges;
+					std::vector< int32_t > row(chunk.size());
+					std::vector< int32_t > sorted;
 					for (uint32_t i1 = 0; i1 < chunk.size(); ++i1) {
 						auto const &p1 = particles[chunk[i1]];
 						for (uint32_t i2 = 0; i2 < chunk.size(); ++i2) {
 							auto const &p2 = particles[chunk[i2]];
-							if (&p2 == &p1) continue;
-
-							int32_t cost = distances[p1.second * maximal.size() + p2.first];
+							int32_t cost = distances(p1.second, p2.first);
 							cost -= int32_t(graph.depth[maximal[p2.first]]); //basically, cost is -overlap
 
 							if (p2.first == start) {
 								cost = -10; //uniformly cheap because we never actually do it
 							}
+							row[i2] = cost;
+						}
 
-							pm.AddEdge(i1, chunk.size() + i2, cost); //matching end to start, I guess?
+						//threshold is the cost of the keep'th cheapest (non-self) edge in the row:
+						int32_t threshold = std::numeric_limits< int32_t >::max();
+						if (options.keep != 0 && options.keep + 1 < chunk.size()) {
+							sorted.assign(row.begin(), row.end());
+							sorted.erase(sorted.begin() + i1);
+							std::nth_element(sorted.begin(), sorted.begin() + (options.keep - 1), sorted.end());
+							threshold = sorted[options.keep - 1];
+						}
+
+						//the (i1 -> i1 + 1) edges form a cycle, so are always kept to make sure a perfect matching exists:
+						uint32_t next = (i1 + 1) % chunk.size();
+						for (uint32_t i2 = 0; i2 < chunk.size(); ++i2) {
+							if (i2 == i1) continue;
+							if (row[i2] <= threshold || i2 == next) {
+								edges.push_back(Edge{i1, i2, row[i2]});
+							}
 						}
 					}
-					pm.Solve();
+
+					chunk_edges[c] = edges.size();
+
+					//which start (i2) each end (i1) is matched to:
+					std::vector< uint32_t > match(chunk.size(), -1U);
+
+					if (options.solver == "assignment" || options.solver == "compare") {
+						//shift costs to be small and non-negative (doesn't change the optimal assignment),
+						// clamping any more than 0xff above the cheapest to fit the solver's uint8_t weights:
+						int32_t min_cost = std::numeric_limits< int32_t >::max();
+						for (auto const &e : edges) {
+							min_cost = std::min(min_cost, e.cost);
+						}
+						SparseRows rows;
+						auto e = edges.begin();
+						for (uint32_t i1 = 0; i1 < chunk.size(); ++i1) {
+							for (; e != edges.end() && e->i1 == i1; ++e) {
+								rows.add(e->i2, uint8_t(std::min(e->cost - min_cost, 0xff)));
+							}
+							rows.finish_row();
+						}
+						assert(e == edges.end());
+
+						auto before = std::chrono::high_resolution_clock::now();
+						Assignment assignment;
+						bool solved = assignment.solve(rows);
+						assert(solved);
+						auto after = std::chrono::high_resolution_clock::now();
+						chunk_time[c].first = std::chrono::duration< double >(after - before).count();
+						match = assignment.row_to_column;
+						//(a clamped edge in the matching means it might not be the cheapest one)
+						for (auto const &e : edges) {
+							if (e.i2 == match[e.i1] && e.cost - min_cost > 0xff) ++chunk_clamped[c];
+						}
+					}
+#ifdef USE_BLOSSOM5
+					if (options.solver == "blossom" || options.solver == "compare") {
+						auto before = std::chrono::high_resolution_clock::now();
+						PerfectMatching pm(chunk.size() * 2, edges.size());
+						pm.options.verbose = false;
+						for (auto const &e : edges) {
+							pm.AddEdge(e.i1, chunk.size() + e.i2, e.cost); //matching end to start, I guess?
+						}
+						pm.Solve();
+						auto after = std::chrono::high_resolution_clock::now();
+						chunk_time[c].second = std::chrono::duration< double >(after - before).count();
+
+						std::vector< uint32_t > blossom_match(chunk.size());
+						for (uint32_t i1 = 0; i1 < chunk.size(); ++i1) {
+							uint32_t m = pm.GetMatch(i1);
+							assert(m >= chunk.size());
+							blossom_match[i1] = m - chunk.size();
+						}
+						int64_t blossom_cost = 0;
+						int64_t assignment_cost = 0;
+						for (auto const &e : edges) {
+							if (e.i2 == blossom_match[e.i1]) blossom_cost += e.cost;
+							if (e.i2 == match[e.i1]) assignment_cost += e.cost;
+						}
+						if (options.solver == "blossom") match = blossom_match;
+						if (options.solver == "compare" && blossom_cost != assignment_cost) {
+							std::cerr << "WARNING: chunk " << c << " blossom cost " << blossom_cost << " != assignment cost " << assignment_cost << std::endl;
+						}
+					}
+#endif
+					edges.clear();
+					edges.shrink_to_fit();
+
 					int64_t total_cost = 0;
 					for (uint32_t i1 = 0; i1 < chunk.size(); ++i1) {
-						uint32_t m = pm.GetMatch(i1);
-						assert(m >= chunk.size());
-						m -= chunk.size();
+						uint32_t m = match[i1];
+						assert(m < chunk.size());
 						if (particles[chunk[m]].first == start) continue;
-						int32_t cost = distances[particles[chunk[i1]].second * maximal.size() + particles[chunk[m]].first];
+						int32_t cost = distances(particles[chunk[i1]].second, particles[chunk[m]].first);
 						cost -= int32_t(graph.depth[maximal[particles[chunk[m]].first]]); //basically, cost is -overlap
 						total_cost += cost;
 
-
-						best.emplace_back(particles[chunk[i1]].second, particles[chunk[m]].first);
+						chunk_best[c].emplace_back(particles[chunk[i1]].second, particles[chunk[m]].first);
+					}
+					chunk_cost[c] = total_cost;
+				});
+				//merge in chunk order so results don't depend on thread scheduling:
+				for (uint32_t c = 0; c < chunks.size(); ++c) {
+					std::cout << "  matched chunk " << c << " of " << chunks.size() << " using " << chunk_edges[c] << " edges; average cost: " << chunk_cost[c] / double(chunks[c].size()) << std::endl;
+					if (chunk_clamped[c]) {
+						std::cout << "    (" << chunk_clamped[c] << " matched edges cost over 0xff more than the cheapest, so were clamped; the matching may not be optimal)" << std::endl;
+					}
+					best.insert(best.end(), chunk_best[c].begin(), chunk_best[c].end());
+				}
+				if (options.solver == "compare") {
+					double assignment_time = 0.0;
+					double blossom_time = 0.0;
+					for (auto const &t : chunk_time) {
+						assignment_time += t.first;
+						blossom_time += t.second;
 					}
-					std::cout << "Average cost: " << total_cost / double(chunk.size()) << std::endl;
+					std::cout << "  solve time: assignment " << assignment_time * 1000.0 << "ms vs blossom " << blossom_time * 1000.0 << "ms" << std::endl;
 				}
 			} else {
 				assert(0 && "Unknown merge option");
 			}
-			std::vector< uint32_t > starts(maximal.size(), -1U);
-			std::vector< uint32_t > ends(maximal.size(), -1U);
-			for (uint32_t p = 0; p < particles.size(); ++p) {
-				assert(particles[p].first < starts.size());
-				assert(particles[p].second < ends.size());
-				starts[particles[p].first] = p;
-				ends[particles[p].second] = p;
+			if (dense_rows) {
+				std::cout << "   (" << dense_rows << " rows needed the full distance table)" << std::endl;
 			}
 
 			if (options.order == "default") {
@@ -316,7 +475,7 @@ int32_t best_cost = std::numeric_limits< int32_t >::max();
 				starts[b.second] = -1U;
 
 				merges.insert(b);
-				total_length += distances[b.first * maximal.size() + b.second];
+				total_length += distances(b.first, b.second);
 			}
 			std::cout << "  (did " << performed << " merges.)" << std::endl;
 			for (uint32_t p = 0; p < particles.size(); ++p) {
@@ -344,7 +503,7 @@ int32_t best_cost = std::numeric_limits< int32_t >::max();
 			path.emplace_back(maximal[at]);
 			auto f = merges.find(at);
 			if (f == merges.end()) break;
-			len += distances[at * maximal.size() + f->second];
+			len += distances(at, f->second);
 			at = f->second;
 		}
 		std::cout << "Path of " << path.size() << " steps (extracted from " << merges.size() << " merges) -- len " << len << std::endl;
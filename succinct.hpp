@@ -0,0 +1,439 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+#include "trie.hpp"
+
+//The rewind automaton (what wordlist.graph stores) in a few bits per node, for
+// keeping several word lists' graphs in memory at once:
+// - the trie's shape as LOUDS bits (each node's child count in unary, in level
+//   order), navigated with select;
+// - each node's incoming letter, packed into just enough bits for the alphabet;
+// - terminal and maximal flags as plain bits;
+// - rewind pointers packed into just enough bits for the node count (and, if asked
+//   for, their inverse, for searching backward: see index_rewound()).
+// Nothing is stored per edge: a node's children are a contiguous run of ids, and
+// its graph steps (see build-graph) are its children plus, at a terminal, the
+// children of each (non-root) node along its rewind chain.
+//
+//Node ids are in level order (root 0, then by depth, siblings in letter order), not
+// the preorder wordlist.graph uses; from_preorder() translates.
+
+//Bits with rank and select directories: a count of ones before every 512-bit
+// block, and the block holding every 512th one (and zero) -- about 7% over the
+// bits themselves.
+class BitVector {
+public:
+	enum : uint32_t {
+		BlockBits = 512,
+		SampleRate = 512,
+	};
+
+	uint32_t size() const { return bits; }
+	bool operator[](uint32_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+
+	void push_back(bool bit) {
+		if (bits % 64 == 0) words.emplace_back(0);
+		if (bit) words.back() |= uint64_t(1) << (bits % 64);
+		++bits;
+	}
+
+	//call after the last push_back:
+	void finish() {
+		const uint32_t blocks = (bits + BlockBits - 1) / BlockBits;
+		block_rank.assign(blocks + 1, 0);
+		select_ones.clear();
+		select_zeros.clear();
+		uint32_t ones = 0;
+		for (uint32_t b = 0; b < blocks; ++b) {
+			block_rank[b] = ones;
+			for (uint32_t w = b * (BlockBits / 64); w < std::min< uint32_t >(words.size(), (b + 1) * (BlockBits / 64)); ++w) {
+				//(note the block of each SampleRate'th one / zero that falls in this word)
+				uint32_t word_ones = popcount(words[w]);
+				uint32_t word_bits = std::min< uint32_t >(64, bits - w * 64);
+				uint32_t zeros = w * 64 - ones;
+				while (select_ones.size() * SampleRate < ones + word_ones) select_ones.emplace_back(b);
+				while (select_zeros.size() * SampleRate < zeros + (word_bits - word_ones)) select_zeros.emplace_back(b);
+				ones += word_ones;
+			}
+		}
+		block_rank[blocks] = ones;
+	}
+
+	//ones in [0, i):
+	uint32_t rank1(uint32_t i) const {
+		uint32_t b = i / BlockBits;
+		uint32_t ret = block_rank[b];
+		for (uint32_t w = b * (BlockBits / 64); w < i / 64; ++w) {
+			ret += popcount(words[w]);
+		}
+		if (i % 64) ret += popcount(words[i / 64] & ((uint64_t(1) << (i % 64)) - 1));
+		return ret;
+	}
+	uint32_t rank0(uint32_t i) const { return i - rank1(i); }
+
+	//position of the k'th one / zero (from zero):
+	uint32_t select1(uint32_t k) const {
+		assert(k < block_rank.back());
+		uint32_t b = select_ones[k / SampleRate];
+		while (block_rank[b + 1] <= k) ++b;
+		k -= block_rank[b];
+		uint32_t w = b * (BlockBits / 64);
+		while (true) {
+			uint32_t count = popcount(words[w]);
+			if (k < count) break;
+			k -= count;
+			++w;
+		}
+		return w * 64 + select_in_word(words[w], k);
+	}
+	uint32_t select0(uint32_t k) const {
+		assert(k < bits - block_rank.back());
+		uint32_t b = select_zeros[k / SampleRate];
+		while ((b + 1) * BlockBits - block_rank[b + 1] <= k) ++b;
+		k -= b * BlockBits - block_rank[b];
+		uint32_t w = b * (BlockBits / 64);
+		while (true) {
+			uint32_t count = 64 - popcount(words[w]);
+			if (k < count) break;
+			k -= count;
+			++w;
+		}
+		return w * 64 + select_in_word(~words[w], k);
+	}
+
+	//position of the first zero at or after i (bits past the end count as zeros):
+	uint32_t next0(uint32_t i) const {
+		uint32_t w = i / 64;
+		uint64_t zeros = ~words[w] & (~uint64_t(0) << (i % 64));
+		while (zeros == 0) {
+			++w;
+			zeros = (w < words.size() ? ~words[w] : ~uint64_t(0));
+		}
+		return w * 64 + __builtin_ctzll(zeros);
+	}
+
+	size_t bytes() const {
+		return 8 * words.size() + 4 * (block_rank.size() + select_ones.size() + select_zeros.size());
+	}
+
+private:
+	std::vector< uint64_t > words;
+	uint32_t bits = 0;
+	std::vector< uint32_t > block_rank; //ones before each block (and in all of them, at the end)
+	std::vector< uint32_t > select_ones, select_zeros; //block holding each SampleRate'th one / zero
+
+	static uint32_t popcount(uint64_t w) {
+		return __builtin_popcountll(w);
+	}
+	static uint32_t select_in_word(uint64_t w, uint32_t k) {
+		uint32_t shift = 0;
+		while (true) {
+			uint32_t count = popcount(w & 0xff);
+			if (k < count) break;
+			k -= count;
+			w >>= 8;
+			shift += 8;
+		}
+		for (uint32_t i = 0; i < k; ++i) {
+			w &= w - 1;
+		}
+		return shift + __builtin_ctzll(w);
+	}
+};
+
+//Fixed-width unsigned integers, packed end to end:
+class PackedArray {
+public:
+	PackedArray(uint32_t width_ = 1) : width(width_) {
+		assert(width >= 1 && width <= 32);
+	}
+
+	//bits needed for values in [0, count):
+	static uint32_t width_for(uint32_t count) {
+		uint32_t w = 1;
+		while (w < 32 && (uint64_t(1) << w) < count) ++w;
+		return w;
+	}
+
+	uint32_t size() const { return count; }
+
+	void push_back(uint32_t v) {
+		assert(width == 32 || v < (1U << width));
+		uint64_t at = uint64_t(count) * width;
+		if ((at + width + 63) / 64 > words.size()) words.emplace_back(0);
+		words[at / 64] |= uint64_t(v) << (at % 64);
+		if (at % 64 + width > 64) words[at / 64 + 1] |= uint64_t(v) >> (64 - at % 64);
+		++count;
+	}
+
+	uint32_t operator[](uint32_t i) const {
+		uint64_t at = uint64_t(i) * width;
+		uint64_t v = words[at / 64] >> (at % 64);
+		if (at % 64 + width > 64) v |= words[at / 64 + 1] << (64 - at % 64);
+		return uint32_t(v & ((uint64_t(1) << width) - 1));
+	}
+
+	size_t bytes() const { return 8 * words.size(); }
+
+private:
+	uint32_t width;
+	uint32_t count = 0;
+	std::vector< uint64_t > words;
+};
+
+class SuccinctGraph {
+public:
+	enum : uint32_t { None = -1U };
+
+	uint32_t nodes = 0;
+
+	//n's children are the ids [first, second), in letter order:
+	std::pair< uint32_t, uint32_t > child_range(uint32_t n) const {
+		uint32_t start = block_start(n);
+		return std::make_pair(1 + start - n, 1 + louds.next0(start) - n);
+	}
+	char letter(uint32_t n) const { //letter into n ('\0' at the root)
+		return (n == 0 ? '\0' : alphabet[letters[n - 1]]);
+	}
+	uint32_t find_child(uint32_t n, char c) const {
+		auto range = child_range(n);
+		//(few enough children that a scan beats a binary search's unpacking; letter
+		// order is unsigned byte order, as in trie.hpp)
+		for (uint32_t i = range.first; i < range.second; ++i) {
+			uint8_t l = uint8_t(letter(i));
+			if (l == uint8_t(c)) return i;
+			if (l > uint8_t(c)) break;
+		}
+		return None;
+	}
+	uint32_t parent(uint32_t n) const {
+		if (n == 0) return None;
+		//n is the (n-1)'th one; count the blocks (zeros) before it:
+		return louds.select1(n - 1) - (n - 1);
+	}
+	uint32_t depth(uint32_t n) const {
+		return std::upper_bound(level_start.begin(), level_start.end(), n) - level_start.begin() - 1;
+	}
+	uint32_t rewind(uint32_t n) const {
+		return (n == 0 ? None : rewinds[n]);
+	}
+	bool terminal(uint32_t n) const { return terminals[n]; }
+	bool maximal(uint32_t n) const { return maximals[n]; }
+
+	//fn(m) for n and every node whose rewind chain passes through n (its subtree in the
+	// tree the rewind pointers form), parents before children; where fn(m) returns
+	// false, the rest of m's subtree is skipped. Only once index_rewound() has laid
+	// that tree out (otherwise unneeded), for searching the graph backward:
+	template< typename F >
+	void rewound(uint32_t n, F const &fn) const {
+		assert(rewound_order.size() == nodes);
+		uint32_t i = rewound_at[n];
+		uint32_t end = i + rewound_size[n];
+		while (i < end) {
+			uint32_t m = rewound_order[i];
+			if (fn(m)) ++i;
+			else i += rewound_size[m];
+		}
+	}
+
+	//is a an ancestor of (or) n?
+	bool holds(uint32_t a, uint32_t n) const {
+		uint32_t d = depth(a);
+		for (uint32_t i = depth(n); i > d; --i) {
+			n = parent(n);
+		}
+		return n == a;
+	}
+
+	//the letters from the root to n:
+	std::string prefix(uint32_t n) const {
+		std::string ret(depth(n), '\0');
+		for (uint32_t i = ret.size(); i > 0; --i) {
+			ret[i-1] = letter(n);
+			n = parent(n);
+		}
+		return ret;
+	}
+
+	//fn(letter, to) for every step of the graph out of n (as wordlist.graph's adj
+	// lists, though not merged into letter order):
+	template< typename F >
+	void steps(uint32_t n, F const &fn) const {
+		auto children = [&](uint32_t m) {
+			auto range = child_range(m);
+			for (uint32_t i = range.first; i < range.second; ++i) {
+				fn(letter(i), i);
+			}
+		};
+		children(n);
+		if (terminal(n)) {
+			for (uint32_t r = rewind(n); r != 0 && r != None; r = rewind(r)) {
+				children(r);
+			}
+		}
+	}
+
+	void build(Trie const &trie) {
+		nodes = trie.size();
+		//level order, by walking the (preorder) trie breadth-first:
+		std::vector< uint32_t > order;
+		std::vector< uint32_t > id(nodes, None);
+		order.reserve(nodes);
+		order.emplace_back(0);
+		id[0] = 0;
+		for (uint32_t i = 0; i < order.size(); ++i) {
+			uint32_t t = order[i];
+			for (uint32_t c = trie.child_start[t]; c < trie.child_start[t+1]; ++c) {
+				id[trie.child[c]] = order.size();
+				order.emplace_back(trie.child[c]);
+			}
+		}
+		assert(order.size() == nodes);
+
+		std::vector< bool > is_alphabet(256, false);
+		for (auto c : trie.child_char) is_alphabet[uint8_t(c)] = true;
+		alphabet.clear();
+		std::vector< uint32_t > code(256, 0);
+		for (uint32_t c = 0; c < 256; ++c) {
+			if (!is_alphabet[c]) continue;
+			code[c] = alphabet.size();
+			alphabet.push_back(char(c));
+		}
+
+		//maximal as build-graph has it: terminal, childless, and not anyone's rewind:
+		std::vector< bool > rewound(nodes, false);
+		for (uint32_t t = 0; t < nodes; ++t) {
+			if (trie.rewind[t] != Trie::None) rewound[trie.rewind[t]] = true;
+		}
+
+		louds = BitVector();
+		terminals = BitVector();
+		maximals = BitVector();
+		letters = PackedArray(PackedArray::width_for(alphabet.size()));
+		rewinds = PackedArray(PackedArray::width_for(nodes));
+		level_start.clear();
+		for (uint32_t i = 0; i < nodes; ++i) {
+			uint32_t t = order[i];
+			for (uint32_t c = trie.child_start[t]; c < trie.child_start[t+1]; ++c) {
+				louds.push_back(true);
+			}
+			louds.push_back(false);
+			if (i > 0) letters.push_back(code[uint8_t(trie.letter[t])]);
+			rewinds.push_back(trie.rewind[t] == Trie::None ? 0 : id[trie.rewind[t]]);
+			terminals.push_back(trie.terminal[t]);
+			maximals.push_back(trie.terminal[t] && trie.children(t) == 0 && !rewound[t]);
+			while (level_start.size() <= trie.depth[t]) level_start.emplace_back(i);
+		}
+		louds.finish();
+		terminals.finish();
+		maximals.finish();
+	}
+
+	//the inverse of rewind(): the rewind tree in preorder, so every subtree is one run
+	// of rewound_order, found without any select:
+	void index_rewound() {
+		std::vector< uint32_t > start(nodes + 1, 0);
+		for (uint32_t n = 1; n < nodes; ++n) {
+			start[rewinds[n] + 1] += 1;
+		}
+		for (uint32_t n = 0; n < nodes; ++n) {
+			start[n + 1] += start[n];
+		}
+		std::vector< uint32_t > ids(nodes - 1);
+		{
+			std::vector< uint32_t > fill(start.begin(), start.end() - 1);
+			for (uint32_t n = 1; n < nodes; ++n) {
+				ids[fill[rewinds[n]]++] = n;
+			}
+		}
+		std::vector< uint32_t > order;
+		std::vector< uint32_t > at(nodes, 0);
+		std::vector< uint32_t > size(nodes, 1);
+		order.reserve(nodes);
+		std::vector< uint32_t > stack(1, 0);
+		while (!stack.empty()) {
+			uint32_t n = stack.back();
+			stack.pop_back();
+			at[n] = order.size();
+			order.emplace_back(n);
+			for (uint32_t i = start[n + 1]; i > start[n]; --i) {
+				stack.emplace_back(ids[i - 1]);
+			}
+		}
+		assert(order.size() == nodes);
+		for (uint32_t i = nodes; i-- > 1; ) {
+			size[rewinds[order[i]]] += size[order[i]];
+		}
+		rewound_order = PackedArray(PackedArray::width_for(nodes));
+		rewound_at = PackedArray(PackedArray::width_for(nodes));
+		rewound_size = PackedArray(PackedArray::width_for(nodes + 1));
+		for (uint32_t i = 0; i < nodes; ++i) {
+			rewound_order.push_back(order[i]);
+		}
+		for (uint32_t n = 0; n < nodes; ++n) {
+			rewound_at.push_back(at[n]);
+			rewound_size.push_back(size[n]);
+		}
+	}
+
+	//ids for the given preorder (wordlist.graph) indices, by walking the trie in
+	// preorder once (so no per-node table is needed):
+	std::vector< uint32_t > from_preorder(std::vector< uint32_t > const &indices) const {
+		std::vector< std::pair< uint32_t, uint32_t > > wanted; //(index, position)
+		for (uint32_t i = 0; i < indices.size(); ++i) {
+			wanted.emplace_back(indices[i], i);
+		}
+		std::sort(wanted.begin(), wanted.end());
+		std::vector< uint32_t > ret(indices.size(), None);
+		auto next = wanted.begin();
+		struct Open {
+			uint32_t next_child, end_child;
+		};
+		std::vector< Open > stack;
+		uint32_t index = 0;
+		auto visit = [&](uint32_t n) {
+			while (next != wanted.end() && next->first == index) {
+				ret[next->second] = n;
+				++next;
+			}
+			++index;
+			auto range = child_range(n);
+			stack.emplace_back(Open{range.first, range.second});
+		};
+		visit(0);
+		while (!stack.empty() && next != wanted.end()) {
+			Open &top = stack.back();
+			if (top.next_child == top.end_child) {
+				stack.pop_back();
+				continue;
+			}
+			visit(top.next_child++); //(invalidates 'top')
+		}
+		return ret;
+	}
+
+	size_t bytes() const {
+		return louds.bytes() + letters.bytes() + rewinds.bytes() + terminals.bytes() + maximals.bytes()
+			+ 4 * level_start.size() + alphabet.size() + rewound_order.bytes() + rewound_at.bytes() + rewound_size.bytes();
+	}
+
+private:
+	BitVector louds; //per node (level order): a one per child, then a zero
+	PackedArray letters; //per node but the root: index into alphabet
+	PackedArray rewinds; //per node (the root's is unused)
+	BitVector terminals, maximals;
+	std::vector< uint32_t > level_start; //first id at each depth
+	std::string alphabet;
+	//(if indexed) the rewind tree in preorder; and per node, where it is in that order and its subtree's size:
+	PackedArray rewound_order, rewound_at, rewound_size;
+
+	//where n's run of ones starts in louds (just past the n'th zero):
+	uint32_t block_start(uint32_t n) const {
+		return (n == 0 ? 0 : louds.select0(n - 1) + 1);
+	}
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "pmw.hpp"
+
+//The word list's trie, with rewind pointers, as flat arrays -- the structure
+// build-graph, search-gen, and check-fasterer used to grow out of std::maps.
+//
+//Nodes are numbered in preorder (children in letter order, letters compared as
+// unsigned bytes, as std::string and memcmp sort them). For ASCII word lists that is
+// the order the old recursive indexing produced, so node indices match
+// wordlist.graph's; the old std::map< char > put bytes >= 0x80 first instead.
+//
+//Nodes are only ever appended in preorder, by walking either:
+// - a .pmw's DAWG (see pmw.hpp), expanding each shared node at every reference; or
+// - the text's lines in sorted order, each adding only what it doesn't share with
+//   the line before (i.e., the list front-coded on the fly);
+// so no per-word strings (and no per-node allocations) are made either way.
+//
+//A node's rewind is the node for the longest proper suffix of its prefix that is in
+// the trie (None at the root), as the old level-by-level loops set them.
+
+class Trie {
+public:
+	enum : uint32_t { None = -1U };
+
+	//per node:
+	std::vector< uint32_t > parent; //None at the root
+	std::vector< char > letter; //letter into the node ('\0' at the root)
+	std::vector< uint8_t > depth;
+	std::vector< bool > terminal;
+	std::vector< uint32_t > rewind;
+	std::vector< uint32_t > child_start; //(one extra at the end)
+
+	//per child, grouped by parent, in letter order:
+	std::vector< uint32_t > child;
+	std::vector< char > child_char;
+
+	uint32_t size() const { return parent.size(); }
+	uint32_t children(uint32_t n) const { return child_start[n+1] - child_start[n]; }
+
+	uint32_t find_child(uint32_t n, char c) const {
+		auto begin = child_char.begin() + child_start[n];
+		auto end = child_char.begin() + child_start[n+1];
+		//(children are in unsigned byte order; see above)
+		auto f = std::lower_bound(begin, end, c, [](char a, char b) {
+			return uint8_t(a) < uint8_t(b);
+		});
+		if (f == end || *f != c) return None;
+		return child[f - child_char.begin()];
+	}
+
+	uint32_t find(std::string const &word) const {
+		uint32_t at = 0;
+		for (uint32_t i = 0; i < word.size() && at != None; ++i) {
+			at = find_child(at, word[i]);
+		}
+		return at;
+	}
+
+	std::string prefix(uint32_t n) const {
+		std::string ret(depth[n], '\0');
+		for (uint32_t i = depth[n]; i > 0; --i) {
+			ret[i-1] = letter[n];
+			n = parent[n];
+		}
+		return ret;
+	}
+
+	//load 'base'.asc if there is one, otherwise 'base'.pmw. (Building the trie is most of
+	// the work either way, and from the text it is no slower than decoding a .pmw,
+	// so a .pmw is only for when the text isn't there; nor can it be out of date.)
+	bool load(std::string const &base = "wordlist") {
+		std::vector< uint8_t > bytes;
+		if (read_file(base + ".asc", bytes)) {
+			from_text(reinterpret_cast< char const * >(bytes.data()), bytes.size());
+			return true;
+		}
+		PMW::Contents contents;
+		if (read_file(base + ".pmw", bytes) && PMW::decode_dawg(bytes, contents)) {
+			from_dawg(contents.dawg);
+			return true;
+		}
+		return false;
+	}
+
+	void from_dawg(DAWG const &dawg) {
+		clear();
+		if (dawg.root == DAWG::None) {
+			finish();
+			return;
+		}
+		terminal[0] = dawg.states[dawg.root].terminal;
+		struct Open {
+			uint32_t node;
+			uint32_t next_edge, end_edge;
+		};
+		std::vector< Open > stack;
+		auto open = [&](uint32_t node, uint32_t s) {
+			DAWG::State const &state = dawg.states[s];
+			stack.emplace_back(Open{node, state.first_edge, state.first_edge + state.edge_count});
+		};
+		open(0, dawg.root);
+		while (!stack.empty()) {
+			Open &top = stack.back();
+			if (top.next_edge == top.end_edge) {
+				stack.pop_back();
+				continue;
+			}
+			DAWG::Edge const &edge = dawg.edges[top.next_edge++];
+			uint32_t n = add(top.node, edge.letter);
+			terminal[n] = dawg.states[edge.to].terminal;
+			open(n, edge.to); //(invalidates 'top')
+		}
+		finish();
+	}
+
+	//one word per line; lines needn't be sorted (or unique):
+	void from_text(char const *text, size_t size) {
+		clear();
+		std::vector< uint32_t > starts; //of each line, plus where a line after the last would start
+		size_t at = 0;
+		while (at < size) {
+			starts.emplace_back(at);
+			char const *end = static_cast< char const * >(std::memchr(text + at, '\n', size - at));
+			at = (end ? end - text + 1 : size + 1); //(as if there were a final '\n')
+		}
+		uint32_t lines = starts.size();
+		starts.emplace_back(at);
+		auto length = [&](uint32_t l) -> uint32_t {
+			return starts[l+1] - starts[l] - 1;
+		};
+
+		//the order to add lines in; the file is usually sorted but for a few words, so
+		// only those are sorted, then merged back in:
+		auto less = [&](uint32_t a, uint32_t b) {
+			uint32_t la = length(a), lb = length(b);
+			int c = std::memcmp(text + starts[a], text + starts[b], std::min(la, lb));
+			return c < 0 || (c == 0 && la < lb);
+		};
+		std::vector< uint32_t > order;
+		std::vector< uint32_t > stray;
+		order.reserve(lines);
+		for (uint32_t l = 0; l < lines; ++l) {
+			if (order.empty() || !less(l, order.back())) order.emplace_back(l);
+			else stray.emplace_back(l);
+		}
+		if (!stray.empty()) {
+			std::sort(stray.begin(), stray.end(), less);
+			std::vector< uint32_t > merged(lines);
+			std::merge(order.begin(), order.end(), stray.begin(), stray.end(), merged.begin(), less);
+			order.swap(merged);
+		}
+
+		std::vector< uint32_t > path(1, 0); //node at each depth along the previous line
+		char const *prev = nullptr;
+		uint32_t prev_length = 0;
+		for (auto l : order) {
+			char const *word = text + starts[l];
+			uint32_t word_length = length(l);
+			uint32_t common = 0;
+			while (common < prev_length && common < word_length && prev[common] == word[common]) ++common;
+			path.resize(common + 1);
+			for (uint32_t i = common; i < word_length; ++i) {
+				path.emplace_back(add(path.back(), word[i]));
+			}
+			terminal[path.back()] = true;
+			prev = word;
+			prev_length = word_length;
+		}
+		finish();
+	}
+
+private:
+	static bool read_file(std::string const &filename, std::vector< uint8_t > &bytes) {
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file) return false;
+		bytes.resize(file.tellg());
+		file.seekg(0);
+		return bool(file.read(reinterpret_cast< char * >(bytes.data()), bytes.size()));
+	}
+
+	void clear() {
+		parent.assign(1, None);
+		letter.assign(1, '\0');
+		depth.assign(1, 0);
+		terminal.assign(1, false);
+		rewind.clear();
+		child_start.clear();
+		child.clear();
+		child_char.clear();
+	}
+
+	uint32_t add(uint32_t p, char c) {
+		assert(depth[p] < 255);
+		parent.emplace_back(p);
+		letter.emplace_back(c);
+		depth.emplace_back(depth[p] + 1);
+		terminal.push_back(false);
+		return parent.size() - 1;
+	}
+
+	//child lists and rewind pointers, from parent/letter:
+	void finish() {
+		const uint32_t n = size();
+		child_start.assign(n + 1, 0);
+		for (uint32_t i = 1; i < n; ++i) {
+			child_start[parent[i] + 1] += 1;
+		}
+		for (uint32_t i = 0; i < n; ++i) {
+			child_start[i + 1] += child_start[i];
+		}
+		child.resize(n - 1);
+		child_char.resize(n - 1);
+		{
+			//(preorder visits each node's children in letter order)
+			std::vector< uint32_t > next(child_start.begin(), child_start.end() - 1);
+			for (uint32_t i = 1; i < n; ++i) {
+				uint32_t at = next[parent[i]]++;
+				child[at] = i;
+				child_char[at] = letter[i];
+			}
+		}
+
+		//rewinds only look shallower, so set them level-by-level:
+		std::vector< uint32_t > by_depth;
+		{
+			std::vector< uint32_t > depth_start;
+			for (uint32_t i = 0; i < n; ++i) {
+				if (depth_start.size() < depth[i] + 2U) depth_start.resize(depth[i] + 2, 0);
+				depth_start[depth[i] + 1] += 1;
+			}
+			for (uint32_t d = 1; d < depth_start.size(); ++d) {
+				depth_start[d] += depth_start[d-1];
+			}
+			by_depth.resize(n);
+			for (uint32_t i = 0; i < n; ++i) {
+				by_depth[depth_start[depth[i]]++] = i;
+			}
+		}
+		rewind.assign(n, None);
+		for (auto i : by_depth) {
+			if (i == 0) continue;
+			uint32_t r = rewind[parent[i]];
+			while (r != None) {
+				uint32_t f = find_child(r, letter[i]);
+				if (f != None) {
+					//great, can extend this rewind:
+					r = f;
+					break;
+				}
+				//have to rewind further:
+				r = rewind[r];
+			}
+			rewind[i] = (r == None ? 0 : r);
+		}
+	}
+};